@@ -0,0 +1,274 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef CACHEDQUERYMETHODS_H
+#define CACHEDQUERYMETHODS_H
+
+#define RESULT  (query->result)
+
+/***
+ * An immutable, cached result of a world database query.
+ *
+ * Works like an [ElunaQuery], but the data is shared with the query cache
+ * and every [Global:WorldDBQueryCached] call returns a new cursor to it.
+ *
+ * E.g. the return value of [Global:WorldDBQueryCached].
+ */
+namespace LuaCachedQuery
+{
+    static uint32 CheckFields(lua_State* L, ElunaCachedQuery* query)
+    {
+        uint32 col = Eluna::CHECKVAL<uint32>(L, 2);
+        if (col >= RESULT->columns)
+            luaL_argerror(L, 2, "invalid field index");
+        return query->row * RESULT->columns + col;
+    }
+
+    static const char* GetValue(lua_State* L, ElunaCachedQuery* query)
+    {
+        return RESULT->values[CheckFields(L, query)].c_str();
+    }
+
+    /* BOOLEAN */
+    /**
+     * Returns `true` if the specified column of the current row is `NULL`, otherwise `false`.
+     *
+     * @param uint32 column
+     * @return bool isNull
+     */
+    int IsNull(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, RESULT->nulls[CheckFields(L, query)]);
+        return 1;
+    }
+
+    /* GETTERS */
+    /**
+     * Returns the number of columns in the result set.
+     *
+     * @return uint32 columnCount
+     */
+    int GetColumnCount(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, RESULT->columns);
+        return 1;
+    }
+
+    /**
+     * Returns the number of rows in the result set.
+     *
+     * @return uint32 rowCount
+     */
+    int GetRowCount(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, RESULT->rows);
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a boolean.
+     *
+     * @param uint32 column
+     * @return bool data
+     */
+    int GetBool(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, strtol(GetValue(L, query), NULL, 10) != 0);
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to an unsigned 8-bit integer.
+     *
+     * @param uint32 column
+     * @return uint8 data
+     */
+    int GetUInt8(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, uint8(strtoul(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to an unsigned 16-bit integer.
+     *
+     * @param uint32 column
+     * @return uint16 data
+     */
+    int GetUInt16(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, uint16(strtoul(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to an unsigned 32-bit integer.
+     *
+     * @param uint32 column
+     * @return uint32 data
+     */
+    int GetUInt32(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, uint32(strtoul(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to an unsigned 64-bit integer.
+     *
+     * @param uint32 column
+     * @return uint64 data
+     */
+    int GetUInt64(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, uint64(strtoull(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a signed 8-bit integer.
+     *
+     * @param uint32 column
+     * @return int8 data
+     */
+    int GetInt8(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, int8(strtol(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a signed 16-bit integer.
+     *
+     * @param uint32 column
+     * @return int16 data
+     */
+    int GetInt16(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, int16(strtol(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a signed 32-bit integer.
+     *
+     * @param uint32 column
+     * @return int32 data
+     */
+    int GetInt32(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, int32(strtol(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a signed 64-bit integer.
+     *
+     * @param uint32 column
+     * @return int64 data
+     */
+    int GetInt64(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, int64(strtoll(GetValue(L, query), NULL, 10)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a 32-bit floating point value.
+     *
+     * @param uint32 column
+     * @return float data
+     */
+    int GetFloat(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, float(strtod(GetValue(L, query), NULL)));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a 64-bit floating point value.
+     *
+     * @param uint32 column
+     * @return double data
+     */
+    int GetDouble(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, strtod(GetValue(L, query), NULL));
+        return 1;
+    }
+
+    /**
+     * Returns the data in the specified column of the current row, casted to a string.
+     *
+     * @param uint32 column
+     * @return string data
+     */
+    int GetString(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        Eluna::Push(L, GetValue(L, query));
+        return 1;
+    }
+
+    /* OTHER */
+
+    /**
+     * Advances the [CachedQuery] to the next row in the result set.
+     *
+     * *Do not* call this immediately after a query, or you'll skip the first row.
+     *
+     * Returns `false` if there was no new row, otherwise `true`.
+     *
+     * @return bool hadNextRow
+     */
+    int NextRow(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        if (query->row + 1 >= RESULT->rows)
+        {
+            Eluna::Push(L, false);
+            return 1;
+        }
+
+        ++query->row;
+        Eluna::Push(L, true);
+        return 1;
+    }
+
+    /**
+     * Returns a table from the current row where keys are field names and values are the row's values.
+     *
+     * All numerical values will be numbers and everything else is returned as a string.
+     *
+     * See [ElunaQuery:GetRow] for an example.
+     *
+     * @return table rowData : table filled with row columns and data where `T[column] = data`
+     */
+    int GetRow(Eluna* /*E*/, lua_State* L, ElunaCachedQuery* query)
+    {
+        lua_createtable(L, 0, RESULT->columns);
+        int tbl = lua_gettop(L);
+
+        uint32 offset = query->row * RESULT->columns;
+        for (uint32 i = 0; i < RESULT->columns; ++i)
+        {
+            Eluna::Push(L, RESULT->names[i]);
+
+            if (RESULT->nulls[offset + i])
+                Eluna::Push(L);
+            else if (RESULT->numeric[i])
+                Eluna::Push(L, strtod(RESULT->values[offset + i].c_str(), NULL));
+            else
+                Eluna::Push(L, RESULT->values[offset + i]);
+
+            lua_settable(L, tbl);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+};
+#undef RESULT
+
+#endif
@@ -605,6 +605,108 @@ namespace LuaCreature
         return 4;
     }
 
+    /**
+     * Schedules an ability of the [Creature]'s encounter timeline.
+     *
+     * The timers run natively and the function is only called when the ability is due, as `(abilityId, creature)`.
+     * Due abilities wait while the [Creature] is casting and while the current phase is not in their phase mask.
+     * An ability with a repeat time is called again after a random time between repeatMin and repeatMax.
+     * If the function returns a number, the ability is called again after that many milliseconds instead.
+     * Scheduling an ability ID again replaces the previous one.
+     * All abilities are removed and the phase is reset when the [Creature] evades, dies or respawns, whatever its AI is.
+     *
+     *     creature:ScheduleAbility(1, CastFireball, 5000, 8000, 12000)     -- every 8 to 12 seconds
+     *     creature:ScheduleAbility(2, CastEnrage, 60000, 0, 0, 0x2)        -- once, only in phase 2
+     *
+     * @param uint32 abilityId : ID of the ability, used to cancel or delay it
+     * @param function function : function to call when the ability is due
+     * @param uint32 delay : time in milliseconds until the first call
+     * @param uint32 repeatMin = 0 : minimum time between calls, 0 calls the ability once
+     * @param uint32 repeatMax = repeatMin : maximum time between calls
+     * @param uint32 phaseMask = 0 : phases the ability is called in, bit 1 is phase 1. 0 for all phases
+     */
+    int ScheduleAbility(Eluna* /*E*/, lua_State* L, Creature* creature)
+    {
+        uint32 abilityId = Eluna::CHECKVAL<uint32>(L, 2);
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+        uint32 delay = Eluna::CHECKVAL<uint32>(L, 4);
+        uint32 repeatMin = Eluna::CHECKVAL<uint32>(L, 5, 0);
+        uint32 repeatMax = Eluna::CHECKVAL<uint32>(L, 6, repeatMin);
+        uint32 phaseMask = Eluna::CHECKVAL<uint32>(L, 7, 0);
+
+        lua_pushvalue(L, 3);
+        int functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        if (functionRef != LUA_REFNIL && functionRef != LUA_NOREF)
+            creature->elunaEvents->ScheduleAbility(functionRef, abilityId, delay, repeatMin, repeatMax, phaseMask);
+        return 0;
+    }
+
+    /**
+     * Cancels the scheduled ability, see [Creature:ScheduleAbility]
+     *
+     * @param uint32 abilityId : ID of the ability to cancel, 0 cancels all abilities
+     */
+    int CancelAbility(Eluna* /*E*/, lua_State* L, Creature* creature)
+    {
+        uint32 abilityId = Eluna::CHECKVAL<uint32>(L, 2);
+        creature->elunaEvents->CancelAbility(abilityId);
+        return 0;
+    }
+
+    /**
+     * Delays the scheduled abilities, see [Creature:ScheduleAbility]
+     *
+     * @param uint32 delay : time in milliseconds to delay the abilities by
+     * @param uint32 abilityId = 0 : ID of the ability to delay, 0 delays all abilities
+     */
+    int DelayAbilities(Eluna* /*E*/, lua_State* L, Creature* creature)
+    {
+        uint32 delay = Eluna::CHECKVAL<uint32>(L, 2);
+        uint32 abilityId = Eluna::CHECKVAL<uint32>(L, 3, 0);
+        creature->elunaEvents->DelayAbility(abilityId, delay);
+        return 0;
+    }
+
+    /**
+     * Sets the phase of the [Creature]'s scheduled abilities, see [Creature:ScheduleAbility]
+     *
+     * @param uint32 phase : phase from 1 to 32, 0 calls abilities of all phases
+     */
+    int SetAbilityPhase(Eluna* /*E*/, lua_State* L, Creature* creature)
+    {
+        uint32 phase = Eluna::CHECKVAL<uint32>(L, 2);
+        if (phase > 32)
+            return luaL_argerror(L, 2, "phase from 0 to 32 expected");
+
+        creature->elunaEvents->SetAbilityPhase(phase);
+        return 0;
+    }
+
+    /**
+     * Returns the phase of the [Creature]'s scheduled abilities, see [Creature:ScheduleAbility]
+     *
+     * @return uint32 phase
+     */
+    int GetAbilityPhase(Eluna* /*E*/, lua_State* L, Creature* creature)
+    {
+        Eluna::Push(L, creature->elunaEvents->GetAbilityPhase());
+        return 1;
+    }
+
+    /**
+     * Calls the function when the [Creature] moves further than the given distance from its home position.
+     * See [Unit:WatchHealthPct] for how watchers work.
+     *
+     * @param float distance : distance from home to watch for
+     * @param function function : function to call when the distance is exceeded
+     * @param float hysteresis = 0 : how far the [Creature] has to move back before the function can be called again
+     * @return int watcherId : unique ID for the watcher used to remove it or nil
+     */
+    int WatchDistanceFromHome(Eluna* /*E*/, lua_State* L, Creature* creature)
+    {
+        return LuaWorldObject::AddWatcherHelper(L, creature, ElunaWatcher::WATCH_DISTANCE_FROM_HOME, 0, 2, 3, 0, true);
+    }
+
     /**
      * Sets the position the [Creature] returns to when evading from combat
      *   or respawning.
@@ -0,0 +1,62 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaAIBatch.h"
+
+void ElunaAIBatch::Add(uint64 mapKey, uint32 entry, uint64 guid, uint32 interval)
+{
+    WriteGuard guard(GetLock());
+
+    Batch& batch = batches[mapKey][entry];
+    batch.entry = entry;
+    batch.interval = interval;
+    batch.guids.push_back(guid);
+}
+
+void ElunaAIBatch::Take(uint64 mapKey, uint32 diff, std::vector<Batch>& due)
+{
+    WriteGuard guard(GetLock());
+
+    MapBatches::iterator mapItr = batches.find(mapKey);
+    if (mapItr == batches.end())
+        return;
+
+    EntryBatches& entries = mapItr->second;
+    for (EntryBatches::iterator itr = entries.begin(); itr != entries.end();)
+    {
+        Batch& batch = itr->second;
+
+        // No creature of the entry was updated, the grids are inactive or the creatures are gone
+        if (batch.guids.empty())
+        {
+            itr = entries.erase(itr);
+            continue;
+        }
+
+        batch.elapsed += diff;
+        if (batch.elapsed >= batch.interval)
+        {
+            due.push_back(Batch());
+            due.back().entry = batch.entry;
+            due.back().interval = batch.interval;
+            due.back().elapsed = batch.elapsed;
+            due.back().guids.swap(batch.guids);
+            batch.elapsed = 0;
+        }
+        else
+            batch.guids.clear();
+        ++itr;
+    }
+
+    if (entries.empty())
+        batches.erase(mapItr);
+}
+
+void ElunaAIBatch::Erase(uint64 mapKey)
+{
+    WriteGuard guard(GetLock());
+    batches.erase(mapKey);
+}
@@ -0,0 +1,48 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_AI_BATCH_H
+#define _ELUNA_AI_BATCH_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+
+/*
+ * Creatures waiting for CREATURE_EVENT_ON_AIUPDATE_BATCH.
+ *
+ * Creatures queue themselves from their AI update on the map threads and the map
+ * update hook takes the queued creatures of its own map, so each entry gets one Lua call
+ * per map update. Creatures are stored by GUID and looked up from the map again
+ * when the batch is run, so removed creatures simply drop out.
+ */
+class ElunaAIBatch : public ElunaUtil::RWLockable
+{
+public:
+    struct Batch
+    {
+        Batch() : entry(0), interval(0), elapsed(0) { }
+
+        uint32 entry;
+        uint32 interval;            // minimum time between runs
+        uint32 elapsed;             // time since the batch was last run
+        std::vector<uint64> guids;  // creatures queued since the last map update
+    };
+
+    // Queues the creature for the next batch of its entry in the map instance
+    void Add(uint64 mapKey, uint32 entry, uint64 guid, uint32 interval);
+    // Adds diff to the batches of the map instance and moves out the ones whose interval has passed
+    void Take(uint64 mapKey, uint32 diff, std::vector<Batch>& due);
+    // Drops the batches of a destroyed map instance
+    void Erase(uint64 mapKey);
+
+private:
+    typedef UNORDERED_MAP<uint32, Batch> EntryBatches;
+    typedef UNORDERED_MAP<uint64, EntryBatches> MapBatches;
+
+    MapBatches batches;
+};
+
+#endif
@@ -0,0 +1,458 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaBehaviorTree.h"
+#include "LuaEngine.h"
+#include "ElunaIncludes.h"
+#include <cstring>
+
+#define BEHAVIOR_TREE_MAX_DEPTH 64
+
+namespace
+{
+    uint32 lastTreeId = 0;
+
+    bool GetNumberField(lua_State* L, int index, const char* name, lua_Number& value)
+    {
+        lua_getfield(L, index, name);
+        bool found = lua_type(L, -1) == LUA_TNUMBER;
+        if (found)
+            value = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        return found;
+    }
+
+    bool GetBoolField(lua_State* L, int index, const char* name)
+    {
+        lua_getfield(L, index, name);
+        bool value = lua_toboolean(L, -1) != 0;
+        lua_pop(L, 1);
+        return value;
+    }
+
+    std::string GetStringField(lua_State* L, int index, const char* name)
+    {
+        lua_getfield(L, index, name);
+        std::string value;
+        if (lua_type(L, -1) == LUA_TSTRING)
+            value = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return value;
+    }
+}
+
+ElunaBehaviorTree::ElunaBehaviorTree(lua_State* _L) : L(_L), id(++lastTreeId), slotCount(0), interval(0)
+{
+}
+
+ElunaBehaviorTree::~ElunaBehaviorTree()
+{
+    // The last reference to a replaced tree can be released by a map thread
+    LOCK_ELUNA;
+    for (std::vector<Node>::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+        if (it->funcRef != LUA_NOREF)
+            luaL_unref(L, LUA_REGISTRYINDEX, it->funcRef);
+}
+
+ElunaBehaviorTree* ElunaBehaviorTree::Build(lua_State* L, int index, std::string& error)
+{
+    if (!lua_istable(L, index))
+    {
+        error = "behavior tree must be a table";
+        return NULL;
+    }
+    index = lua_absindex(L, index);
+
+    ElunaBehaviorTree* tree = new ElunaBehaviorTree(L);
+
+    lua_Number interval = 0;
+    if (GetNumberField(L, index, "interval", interval) && interval > 0)
+        tree->interval = uint32(interval);
+
+    if (tree->BuildNode(L, index, 0, error) < 0)
+    {
+        delete tree;
+        return NULL;
+    }
+    return tree;
+}
+
+int ElunaBehaviorTree::BuildNode(lua_State* L, int index, uint32 depth, std::string& error)
+{
+    if (depth > BEHAVIOR_TREE_MAX_DEPTH)
+    {
+        error = "behavior tree is nested too deep";
+        return -1;
+    }
+    if (!lua_istable(L, index))
+    {
+        error = "behavior tree node must be a table";
+        return -1;
+    }
+
+    std::string type = GetStringField(L, index, "type");
+    Node node;
+    lua_Number number = 0;
+    uint32 childCount = 0;
+
+    if (type == "selector" || type == "sequence")
+    {
+        node.type = type == "selector" ? NODE_SELECTOR : NODE_SEQUENCE;
+        childCount = lua_rawlen(L, index);
+        if (!childCount)
+        {
+            error = type + " node needs at least one child";
+            return -1;
+        }
+    }
+    else if (type == "invert" || type == "cooldown")
+    {
+        node.type = type == "invert" ? NODE_INVERT : NODE_COOLDOWN;
+        childCount = lua_rawlen(L, index);
+        if (childCount != 1)
+        {
+            error = type + " node needs exactly one child";
+            return -1;
+        }
+        if (node.type == NODE_COOLDOWN)
+        {
+            if (!GetNumberField(L, index, "time", number) || number <= 0)
+            {
+                error = "cooldown node needs a time";
+                return -1;
+            }
+            node.time = uint32(number);
+            node.slot = slotCount++;
+        }
+    }
+    else if (type == "healthBelow")
+    {
+        node.type = NODE_HEALTH_BELOW;
+        if (!GetNumberField(L, index, "pct", number))
+        {
+            error = "healthBelow node needs a pct";
+            return -1;
+        }
+        node.value = float(number);
+    }
+    else if (type == "inCombat")
+        node.type = NODE_IN_COMBAT;
+    else if (type == "selectTarget")
+    {
+        node.type = NODE_SELECT_TARGET;
+        std::string target = GetStringField(L, index, "target");
+        if (target.empty() || target == "victim")
+            node.target = TARGET_VICTIM;
+        else if (target == "self")
+            node.target = TARGET_SELF;
+        else if (target == "random")
+            node.target = TARGET_RANDOM;
+        else if (target == "top")
+            node.target = TARGET_TOP_AGGRO;
+        else if (target == "bottom")
+            node.target = TARGET_BOTTOM_AGGRO;
+        else if (target == "nearest")
+            node.target = TARGET_NEAREST;
+        else if (target == "farthest")
+            node.target = TARGET_FARTHEST;
+        else
+        {
+            error = "unknown selectTarget target '" + target + "'";
+            return -1;
+        }
+        node.flag = GetBoolField(L, index, "playerOnly");
+        if (GetNumberField(L, index, "range", number))
+            node.value = float(number);
+    }
+    else if (type == "castSpell")
+    {
+        node.type = NODE_CAST_SPELL;
+        if (!GetNumberField(L, index, "spell", number) || number <= 0)
+        {
+            error = "castSpell node needs a spell";
+            return -1;
+        }
+        node.spell = uint32(number);
+        node.flag = GetBoolField(L, index, "triggered");
+        node.target = GetBoolField(L, index, "self") ? TARGET_SELF : TARGET_VICTIM;
+    }
+    else if (type == "moveTo")
+    {
+        node.type = NODE_MOVE_TO;
+        lua_Number x = 0, y = 0, z = 0;
+        if (GetNumberField(L, index, "x", x) && GetNumberField(L, index, "y", y) && GetNumberField(L, index, "z", z))
+        {
+            node.x = float(x);
+            node.y = float(y);
+            node.z = float(z);
+        }
+        else if (GetBoolField(L, index, "target"))
+            node.flag = true;
+        else
+        {
+            error = "moveTo node needs x, y and z or target = true";
+            return -1;
+        }
+        node.value = 1.0f;
+        if (GetNumberField(L, index, "distance", number) && number >= 0)
+            node.value = float(number);
+        node.slot = slotCount++;
+    }
+    else if (type == "lua")
+    {
+        node.type = NODE_LUA;
+        lua_getfield(L, index, "fn");
+        if (!lua_isfunction(L, -1))
+        {
+            lua_pop(L, 1);
+            error = "lua node needs a function fn";
+            return -1;
+        }
+        node.funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else
+    {
+        error = "unknown behavior tree node type '" + type + "'";
+        return -1;
+    }
+
+    // Stored before the children are built so a failed build still frees the function reference
+    uint32 nodeIndex = nodes.size();
+    nodes.push_back(node);
+
+    for (uint32 i = 1; i <= childCount; ++i)
+    {
+        lua_rawgeti(L, index, i);
+        int child = BuildNode(L, lua_gettop(L), depth + 1, error);
+        lua_pop(L, 1);
+        if (child < 0)
+            return -1;
+        nodes[nodeIndex].children.push_back(child);
+    }
+    return nodeIndex;
+}
+
+void ElunaBehaviorTree::Update(Creature* me, uint32 diff, ElunaBehaviorState& state) const
+{
+    if (state.treeId != id)
+    {
+        state.treeId = id;
+        state.slots.assign(slotCount, 0);
+        state.elapsed = interval;
+        // Starts at 1 so the cleared slots never match the previous run
+        state.runs = 1;
+        state.target = 0;
+    }
+
+    state.time += diff;
+    state.elapsed += diff;
+    if (state.elapsed < interval)
+        return;
+    state.elapsed = 0;
+
+    Run(0, me, state);
+    ++state.runs;
+}
+
+ElunaBehaviorTree::Status ElunaBehaviorTree::Run(uint32 index, Creature* me, ElunaBehaviorState& state) const
+{
+    Node const& node = nodes[index];
+    switch (node.type)
+    {
+        case NODE_SELECTOR:
+            for (std::vector<uint32>::const_iterator it = node.children.begin(); it != node.children.end(); ++it)
+            {
+                Status status = Run(*it, me, state);
+                if (status != STATUS_FAILURE)
+                    return status;
+            }
+            return STATUS_FAILURE;
+        case NODE_SEQUENCE:
+            for (std::vector<uint32>::const_iterator it = node.children.begin(); it != node.children.end(); ++it)
+            {
+                Status status = Run(*it, me, state);
+                if (status != STATUS_SUCCESS)
+                    return status;
+            }
+            return STATUS_SUCCESS;
+        case NODE_INVERT:
+        {
+            Status status = Run(node.children[0], me, state);
+            if (status == STATUS_RUNNING)
+                return status;
+            return status == STATUS_SUCCESS ? STATUS_FAILURE : STATUS_SUCCESS;
+        }
+        case NODE_COOLDOWN:
+        {
+            if (state.slots[node.slot] > state.time)
+                return STATUS_FAILURE;
+            Status status = Run(node.children[0], me, state);
+            if (status == STATUS_SUCCESS)
+                state.slots[node.slot] = state.time + node.time;
+            return status;
+        }
+        case NODE_HEALTH_BELOW:
+#ifndef TRINITY
+            return me->GetHealthPercent() < node.value ? STATUS_SUCCESS : STATUS_FAILURE;
+#else
+            return me->GetHealthPct() < node.value ? STATUS_SUCCESS : STATUS_FAILURE;
+#endif
+        case NODE_IN_COMBAT:
+#ifdef CMANGOS
+            return me->isInCombat() ? STATUS_SUCCESS : STATUS_FAILURE;
+#else
+            return me->IsInCombat() ? STATUS_SUCCESS : STATUS_FAILURE;
+#endif
+        case NODE_SELECT_TARGET:
+        {
+            Unit* target = SelectTarget(node, me);
+            state.target = target ? uint64(target->GET_GUID()) : 0;
+            return target ? STATUS_SUCCESS : STATUS_FAILURE;
+        }
+        case NODE_CAST_SPELL:
+        {
+#ifdef TRINITY
+            if (me->HasUnitState(UNIT_STATE_CASTING))
+#else
+            if (me->IsNonMeleeSpellCasted(false))
+#endif
+                return STATUS_FAILURE;
+            Unit* target = node.target == TARGET_SELF ? me : GetTarget(me, state);
+            if (!target)
+                return STATUS_FAILURE;
+            me->CastSpell(target, node.spell, node.flag);
+            return STATUS_SUCCESS;
+        }
+        case NODE_MOVE_TO:
+        {
+            // The movement is started again if the node did not run on the previous run of the tree
+            bool moving = state.slots[node.slot] == state.runs;
+            state.slots[node.slot] = state.runs + 1;
+            if (node.flag)
+            {
+                Unit* target = GetTarget(me, state);
+                if (!target)
+                    return STATUS_FAILURE;
+                if (me->IsWithinDistInMap(target, node.value))
+                    return STATUS_SUCCESS;
+                if (!moving)
+                    me->GetMotionMaster()->MoveChase(target, node.value);
+                return STATUS_RUNNING;
+            }
+            if (me->GetDistance(node.x, node.y, node.z) <= node.value)
+                return STATUS_SUCCESS;
+            if (!moving)
+                me->GetMotionMaster()->MovePoint(0, node.x, node.y, node.z);
+            return STATUS_RUNNING;
+        }
+        case NODE_LUA:
+            return RunLua(node, me, GetTarget(me, state));
+    }
+    return STATUS_FAILURE;
+}
+
+ElunaBehaviorTree::Status ElunaBehaviorTree::RunLua(Node const& node, Creature* me, Unit* target) const
+{
+    LOCK_ELUNA;
+    lua_State* L = sEluna->L;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, node.funcRef);
+    Eluna::Push(L, me);
+    Eluna::Push(L, target);
+    sEluna->ExecuteCall(2, 1);
+
+    // true succeeds, "running" keeps running and anything else fails
+    Status status = STATUS_FAILURE;
+    if (lua_type(L, -1) == LUA_TSTRING && !strcmp(lua_tostring(L, -1), "running"))
+        status = STATUS_RUNNING;
+    else if (lua_toboolean(L, -1))
+        status = STATUS_SUCCESS;
+    lua_pop(L, 1);
+
+    ASSERT(!sEluna->event_level);
+    sEluna->InvalidateObjects();
+    return status;
+}
+
+Unit* ElunaBehaviorTree::SelectTarget(Node const& node, Creature* me) const
+{
+    if (node.target == TARGET_SELF)
+        return me;
+    if (node.target == TARGET_VICTIM)
+#ifndef TRINITY
+        return me->getVictim();
+#else
+        return me->GetVictim();
+#endif
+
+#ifdef MANGOS
+    ThreatList const& threatlist = me->GetThreatManager().getThreatList();
+#else
+    ThreatList const& threatlist = me->getThreatManager().getThreatList();
+#endif
+    std::list<Unit*> targetList;
+    for (ThreatList::const_iterator itr = threatlist.begin(); itr != threatlist.end(); ++itr)
+    {
+        Unit* target = (*itr)->getTarget();
+        if (!target)
+            continue;
+        if (node.flag && target->GetTypeId() != TYPEID_PLAYER)
+            continue;
+        if (node.value > 0.0f && !me->IsWithinDist(target, node.value))
+            continue;
+        targetList.push_back(target);
+    }
+    if (targetList.empty())
+        return NULL;
+
+    switch (node.target)
+    {
+        case TARGET_NEAREST:
+        case TARGET_FARTHEST:
+            targetList.sort(ElunaUtil::ObjectDistanceOrderPred(me));
+            return node.target == TARGET_NEAREST ? targetList.front() : targetList.back();
+        case TARGET_TOP_AGGRO:
+            return targetList.front();
+        case TARGET_BOTTOM_AGGRO:
+            return targetList.back();
+        default:
+        {
+            std::list<Unit*>::const_iterator itr = targetList.begin();
+            std::advance(itr, urand(0, targetList.size() - 1));
+            return *itr;
+        }
+    }
+}
+
+Unit* ElunaBehaviorTree::GetTarget(Creature* me, ElunaBehaviorState const& state) const
+{
+    // Nodes use the victim until a target is selected
+    if (!state.target)
+#ifndef TRINITY
+        return me->getVictim();
+#else
+        return me->GetVictim();
+#endif
+
+    uint64 guid = me->GET_GUID();
+    if (guid == state.target)
+        return me;
+
+#ifdef MANGOS
+    ThreatList const& threatlist = me->GetThreatManager().getThreatList();
+#else
+    ThreatList const& threatlist = me->getThreatManager().getThreatList();
+#endif
+    for (ThreatList::const_iterator itr = threatlist.begin(); itr != threatlist.end(); ++itr)
+    {
+        Unit* target = (*itr)->getTarget();
+        if (!target)
+            continue;
+        guid = target->GET_GUID();
+        if (guid == state.target)
+            return target;
+    }
+    return NULL;
+}
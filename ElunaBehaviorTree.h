@@ -0,0 +1,120 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_BEHAVIOR_TREE_H
+#define _ELUNA_BEHAVIOR_TREE_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+};
+
+class Creature;
+class Unit;
+
+// Per creature state of a behavior tree, kept by the creature's AI
+struct ElunaBehaviorState
+{
+    ElunaBehaviorState() : treeId(0), time(0), elapsed(0), runs(1), target(0) { }
+
+    uint32 treeId;              // tree the state was made for, the state is reset when the tree changes
+    std::vector<uint64> slots;  // node data, cooldown end times and started movements
+    uint64 time;                // time the state has been updated for
+    uint32 elapsed;             // time since the tree last ran
+    uint64 runs;                // number of the next run, starts at 1
+    uint64 target;              // GUID of the target picked by selectTarget
+};
+
+/*
+ * Behavior tree defined from a Lua table, see RegisterCreatureBehaviorTree.
+ *
+ * The tree is compiled once into a flat node array. Composite, decorator and most leaf nodes
+ * run natively, only "lua" leaf nodes call back into Lua. Selectors and sequences are
+ * evaluated from the root on every run, nodes that keep running return STATUS_RUNNING.
+ */
+class ElunaBehaviorTree
+{
+public:
+    enum Status
+    {
+        STATUS_FAILURE,
+        STATUS_SUCCESS,
+        STATUS_RUNNING
+    };
+
+    ~ElunaBehaviorTree();
+
+    // Builds a tree from the table at index. Returns NULL and sets error if the definition is invalid
+    static ElunaBehaviorTree* Build(lua_State* L, int index, std::string& error);
+
+    // Runs the tree for the creature once its interval has passed
+    void Update(Creature* me, uint32 diff, ElunaBehaviorState& state) const;
+
+private:
+    enum NodeType
+    {
+        NODE_SELECTOR,      // succeeds with the first child that doesn't fail
+        NODE_SEQUENCE,      // fails with the first child that doesn't succeed
+        NODE_INVERT,        // swaps success and failure of its child
+        NODE_COOLDOWN,      // fails while on cooldown, starts the cooldown when its child succeeds
+        NODE_HEALTH_BELOW,  // succeeds if the health percent is below value
+        NODE_IN_COMBAT,     // succeeds if in combat
+        NODE_SELECT_TARGET, // picks the target for the nodes after it
+        NODE_CAST_SPELL,    // casts the spell on the target or self
+        NODE_MOVE_TO,       // moves to the point or the target, runs until within value yards
+        NODE_LUA            // calls a Lua function with (creature, target)
+    };
+
+    enum TargetType
+    {
+        TARGET_SELF,
+        TARGET_VICTIM,
+        TARGET_RANDOM,
+        TARGET_TOP_AGGRO,
+        TARGET_BOTTOM_AGGRO,
+        TARGET_NEAREST,
+        TARGET_FARTHEST
+    };
+
+    struct Node
+    {
+        Node() : type(NODE_SELECTOR), slot(0), spell(0), time(0), value(0.0f), x(0.0f), y(0.0f), z(0.0f),
+            target(TARGET_VICTIM), flag(false), funcRef(LUA_NOREF) { }
+
+        NodeType type;
+        std::vector<uint32> children;
+        uint32 slot;        // index of the node's data in the state
+        uint32 spell;
+        uint32 time;        // cooldown
+        float value;        // health percent, range or movement distance
+        float x, y, z;
+        TargetType target;
+        bool flag;          // triggered cast, player only target or move to target
+        int funcRef;
+    };
+
+    ElunaBehaviorTree(lua_State* L);
+
+    // Builds the node at index and its children, returns the node's index or -1 on error
+    int BuildNode(lua_State* L, int index, uint32 depth, std::string& error);
+    Status Run(uint32 index, Creature* me, ElunaBehaviorState& state) const;
+    Status RunLua(Node const& node, Creature* me, Unit* target) const;
+    Unit* SelectTarget(Node const& node, Creature* me) const;
+    // Returns the target picked earlier if it is still the creature itself or in its threat list, the victim if none was picked
+    Unit* GetTarget(Creature* me, ElunaBehaviorState const& state) const;
+
+    lua_State* L;
+    uint32 id;
+    std::vector<Node> nodes;
+    uint32 slotCount;
+    uint32 interval;
+};
+
+#endif
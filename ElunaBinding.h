@@ -10,6 +10,7 @@
 #include "Common.h"
 #include "LuaEngine.h"
 #include "ElunaUtility.h"
+#include <atomic>
 
 extern "C"
 {
@@ -243,4 +244,247 @@ public:
     EntryToEventsMap Bindings; // Binding store Bindings[entryId][eventId] = {(funcRef, counter)};
 };
 
+/*
+ * Packet bindings are looked up for every packet sent or received.
+ * Opcodes are a small dense range, so instead of hash maps the bindings are kept
+ * in a flat table indexed by opcode and event, with an atomic bit per slot
+ * to check for bindings without locking.
+ */
+template<>
+class EntryBind<HookMgr::PacketEvents> : public ElunaBind
+{
+public:
+    EntryBind(const char* bindGroupName, Eluna& _E, uint32 opcodeCount) : ElunaBind(bindGroupName, _E),
+        entryCount(opcodeCount),
+        slotCount(opcodeCount * HookMgr::PACKET_EVENT_COUNT),
+        slots(new Slot*[slotCount]()),
+        presence(new std::atomic<uint32>[(slotCount + 31) / 32]()),
+        generation(0)
+    {
+    }
+
+    ~EntryBind()
+    {
+        Clear();
+        delete[] slots;
+        delete[] presence;
+    }
+
+    // unregisters all registered functions and clears all registered events from the bind table
+    void Clear() override
+    {
+        WriteGuard guard(GetLock());
+
+        for (uint32 i = 0; i < slotCount; ++i)
+            ClearSlot(i);
+    }
+
+    void Clear(uint32 entry, uint32 event_id)
+    {
+        WriteGuard guard(GetLock());
+
+        if (IsValid(event_id, entry))
+            ClearSlot(GetIndex(event_id, entry));
+    }
+
+    // Pushes the function references and updates the counters on the binds and erases them if the counter would reach 0
+    void PushFuncRefs(lua_State* L, int event_id, uint32 entry)
+    {
+        PushFuncRefs(L, event_id, entry, NULL, NULL);
+    }
+
+    // Same as above, but skips the binds whose filter doesn't match the packet. Skipped binds don't use up shots
+    void PushFuncRefs(lua_State* L, int event_id, uint32 entry, WorldPacket const* packet, Player const* player)
+    {
+        PushFuncRefs(L, event_id, entry, packet, player, NULL);
+    }
+
+    // Same as above, but uses the filter results of MatchEvents unless the binds changed since
+    void PushFuncRefs(lua_State* L, int event_id, uint32 entry, WorldPacket const* packet, Player const* player, ElunaPacketMatch const* match)
+    {
+        if (!IsValid(event_id, entry))
+            return;
+        uint32 index = GetIndex(event_id, entry);
+
+        {
+            ReadGuard guard(GetLock());
+
+            Slot* slot = slots[index];
+            if (!slot)
+                return;
+
+            // Permanent bindings only need reading
+            if (!slot->temporaryCount)
+            {
+                bool matched = match && match->generation == generation;
+                for (uint32 i = 0; i < slot->bindings.size(); ++i)
+                    if (Matches(slot->filters[i], packet, player, matched ? match : NULL, i))
+                        lua_rawgeti(L, LUA_REGISTRYINDEX, slot->bindings[i]->functionReference);
+                return;
+            }
+        }
+
+        WriteGuard guard(GetLock());
+
+        Slot* slot = slots[index];
+        if (!slot)
+            return;
+
+        // Indexes of the match are of the binds before any is erased below
+        bool matched = match && match->generation == generation;
+        for (uint32 i = 0, matchIndex = 0; i < slot->bindings.size(); ++matchIndex)
+        {
+            Binding* binding = slot->bindings[i];
+            if (!Matches(slot->filters[i], packet, player, matched ? match : NULL, matchIndex))
+            {
+                ++i;
+                continue;
+            }
+
+            lua_rawgeti(L, LUA_REGISTRYINDEX, binding->functionReference);
+
+            if (binding->isTemporary && --binding->remainingShots == 0)
+            {
+                --slot->temporaryCount;
+                delete binding;
+                delete slot->filters[i];
+                slot->bindings.erase(slot->bindings.begin() + i);
+                slot->filters.erase(slot->filters.begin() + i);
+                ++generation;
+            }
+            else
+                ++i;
+        }
+
+        if (slot->bindings.empty())
+            ClearSlot(index);
+    }
+
+    // Inserts a new registered event, the filter is copied
+    void Insert(uint32 entryId, int eventId, int funcRef, uint32 shots, ElunaUtil::PacketFilter const* filter = NULL)
+    {
+        WriteGuard guard(GetLock());
+
+        if (!IsValid(eventId, entryId))
+        {
+            luaL_unref(E.L, LUA_REGISTRYINDEX, funcRef);
+            return;
+        }
+
+        uint32 index = GetIndex(eventId, entryId);
+        Slot*& slot = slots[index];
+        if (!slot)
+            slot = new Slot();
+
+        slot->bindings.push_back(new Binding(E, funcRef, shots));
+        slot->filters.push_back(filter ? new ElunaUtil::PacketFilter(*filter) : NULL);
+        if (shots)
+            ++slot->temporaryCount;
+        ++generation;
+
+        presence[index / 32].fetch_or(1u << (index % 32));
+    }
+
+    // Returns true if any bind of the entry would be called for the packet.
+    // The filter results are kept in match for PushFuncRefs, so the filters are checked once per packet
+    bool MatchEvents(HookMgr::PacketEvents eventId, uint32 entryId, WorldPacket const& packet, Player const* player, ElunaPacketMatch& match)
+    {
+        match = ElunaPacketMatch();
+        if (!HasEvents(eventId, entryId))
+            return false;
+
+        ReadGuard guard(GetLock());
+
+        Slot* slot = slots[GetIndex(eventId, entryId)];
+        if (!slot)
+            return false;
+
+        match.generation = generation;
+        bool any = false;
+        for (uint32 i = 0; i < slot->filters.size(); ++i)
+        {
+            if (!Matches(slot->filters[i], &packet, player))
+                continue;
+            if (i < 64)
+                match.mask |= uint64(1) << i;
+            any = true;
+        }
+        return any;
+    }
+
+    // Returns true if the entry has registered binds
+    bool HasEvents(HookMgr::PacketEvents eventId, uint32 entryId) const
+    {
+        if (!IsValid(eventId, entryId))
+            return false;
+
+        uint32 index = GetIndex(eventId, entryId);
+        return (presence[index / 32].load(std::memory_order_relaxed) & (1u << (index % 32))) != 0;
+    }
+
+    bool HasEvents(uint32 entryId) const
+    {
+        for (int i = 0; i < HookMgr::PACKET_EVENT_COUNT; ++i)
+            if (HasEvents(HookMgr::PacketEvents(i), entryId))
+                return true;
+        return false;
+    }
+
+private:
+    struct Slot
+    {
+        Slot() : temporaryCount(0) { }
+
+        FunctionRefVector bindings;
+        std::vector<ElunaUtil::PacketFilter*> filters;  // filters[i] belongs to bindings[i], NULL if unfiltered
+        uint32 temporaryCount;
+    };
+
+    static bool Matches(ElunaUtil::PacketFilter const* filter, WorldPacket const* packet, Player const* player)
+    {
+        return !filter || !packet || (*filter)(*packet, player);
+    }
+
+    static bool Matches(ElunaUtil::PacketFilter const* filter, WorldPacket const* packet, Player const* player, ElunaPacketMatch const* match, uint32 index)
+    {
+        if (match && index < 64)
+            return (match->mask & (uint64(1) << index)) != 0;
+        return Matches(filter, packet, player);
+    }
+
+    bool IsValid(int eventId, uint32 entryId) const
+    {
+        return entryId < entryCount && eventId >= 0 && eventId < HookMgr::PACKET_EVENT_COUNT;
+    }
+
+    uint32 GetIndex(int eventId, uint32 entryId) const
+    {
+        return entryId * HookMgr::PACKET_EVENT_COUNT + eventId;
+    }
+
+    // Caller must hold the write lock
+    void ClearSlot(uint32 index)
+    {
+        presence[index / 32].fetch_and(~(1u << (index % 32)));
+        ++generation;
+
+        Slot* slot = slots[index];
+        if (!slot)
+            return;
+
+        for (FunctionRefVector::iterator it = slot->bindings.begin(); it != slot->bindings.end(); ++it)
+            delete *it;
+        for (std::vector<ElunaUtil::PacketFilter*>::iterator it = slot->filters.begin(); it != slot->filters.end(); ++it)
+            delete *it;
+        delete slot;
+        slots[index] = NULL;
+    }
+
+    const uint32 entryCount;
+    const uint32 slotCount;
+    Slot** slots;                    // slots[opcode * PACKET_EVENT_COUNT + event]
+    std::atomic<uint32>* presence;   // one bit per slot
+    uint32 generation;               // changed with the binds under the write lock, see ElunaPacketMatch
+};
+
 #endif
@@ -7,6 +7,11 @@
 #include "ElunaEventMgr.h"
 #include "LuaEngine.h"
 #include "Object.h"
+#include "Unit.h"
+#include "Creature.h"
+#include "SpellAuras.h"
+#include "Util.h"
+#include <algorithm>
 
 extern "C"
 {
@@ -41,7 +46,81 @@ void LuaEvent::Execute()
     (*events->E)->InvalidateObjects();
 }
 
-ElunaEventProcessor::ElunaEventProcessor(Eluna** _E, WorldObject* _obj) : m_time(0), obj(_obj), E(_E)
+ElunaWatcher::ElunaWatcher(ElunaEventProcessor* _events, int _funcRef, WatchType _type, uint32 _param, float _threshold, float _hysteresis, bool _above) :
+to_Abort(false), events(_events), funcRef(_funcRef), type(_type), param(_param), threshold(_threshold), hysteresis(_hysteresis), above(_above), triggered(false)
+{
+}
+
+ElunaWatcher::~ElunaWatcher()
+{
+    luaL_unref((*events->E)->L, LUA_REGISTRYINDEX, funcRef); // Free lua function ref
+}
+
+bool ElunaWatcher::GetValue(WorldObject* obj, float& value) const
+{
+    Unit* unit = obj->ToUnit();
+    if (!unit)
+        return false;
+
+    switch (type)
+    {
+        case WATCH_HEALTH_PCT:
+#ifndef TRINITY
+            value = unit->GetHealthPercent();
+#else
+            value = unit->GetHealthPct();
+#endif
+            return true;
+        case WATCH_POWER_PCT:
+        {
+            uint32 maxPower = unit->GetMaxPower(Powers(param));
+            if (!maxPower)
+                return false;
+            value = float(unit->GetPower(Powers(param))) * 100.0f / float(maxPower);
+            return true;
+        }
+        case WATCH_DISTANCE_FROM_HOME:
+        {
+            Creature* creature = unit->ToCreature();
+            if (!creature)
+                return false;
+            float x, y, z, o;
+#ifndef TRINITY
+            creature->GetRespawnCoord(x, y, z, &o);
+#else
+            creature->GetHomePosition(x, y, z, o);
+#endif
+            value = creature->GetDistance(x, y, z);
+            return true;
+        }
+        case WATCH_AURA_STACKS:
+        {
+#ifndef TRINITY
+            Aura* aura = unit->GetAura(param, EFFECT_INDEX_0);
+#else
+            Aura* aura = unit->GetAura(param);
+#endif
+            value = aura ? float(aura->GetStackAmount()) : 0.0f;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ElunaWatcher::Execute(float value)
+{
+    LOCK_ELUNA;
+    lua_rawgeti((*events->E)->L, LUA_REGISTRYINDEX, funcRef);
+    Eluna::Push((*events->E)->L, funcRef);
+    Eluna::Push((*events->E)->L, value);
+    Eluna::Push((*events->E)->L, events->obj);
+    (*events->E)->ExecuteCall(3, 0);
+
+    ASSERT(!(*events->E)->event_level);
+    (*events->E)->InvalidateObjects();
+}
+
+ElunaEventProcessor::ElunaEventProcessor(Eluna** _E, WorldObject* _obj) : abilityPhase(0), abilitiesReset(false), m_time(0), obj(_obj), E(_E)
 {
     if (obj)
     {
@@ -63,7 +142,13 @@ ElunaEventProcessor::~ElunaEventProcessor()
 
 void ElunaEventProcessor::Update(uint32 diff)
 {
+    if (!watchers.empty())
+        UpdateWatchers();
+
     m_time += diff;
+
+    if (!abilities.empty())
+        UpdateAbilities();
     for (EventList::iterator it = eventList.begin(); it != eventList.end() && it->first <= m_time; it = eventList.begin())
     {
         LuaEvent* event = it->second;
@@ -87,6 +172,170 @@ void ElunaEventProcessor::Update(uint32 diff)
     }
 }
 
+void ElunaEventProcessor::UpdateWatchers()
+{
+    for (WatcherMap::iterator it = watchers.begin(); it != watchers.end();)
+    {
+        ElunaWatcher* watcher = it->second;
+        if (watcher->to_Abort)
+        {
+            delete watcher;
+            watchers.erase(it++);
+            continue;
+        }
+        ++it; // The callback can add and remove watchers
+
+        float value;
+        if (!watcher->GetValue(obj, value))
+            continue;
+
+        if (watcher->triggered)
+        {
+            if (watcher->above ? value < watcher->threshold - watcher->hysteresis : value > watcher->threshold + watcher->hysteresis)
+                watcher->triggered = false;
+            continue;
+        }
+
+        if (watcher->above ? value >= watcher->threshold : value <= watcher->threshold)
+        {
+            watcher->triggered = true;
+            watcher->Execute(value);
+        }
+    }
+}
+
+void ElunaEventProcessor::AddWatcher(int funcRef, ElunaWatcher::WatchType type, uint32 param, float threshold, float hysteresis, bool above)
+{
+    watchers[funcRef] = new ElunaWatcher(this, funcRef, type, param, threshold, hysteresis, above);
+}
+
+void ElunaEventProcessor::RemoveWatcher(int watcherId)
+{
+    WatcherMap::iterator it = watchers.find(watcherId);
+    if (it != watchers.end())
+        it->second->to_Abort = true;
+}
+
+void ElunaEventProcessor::RemoveWatchers()
+{
+    for (WatcherMap::iterator it = watchers.begin(); it != watchers.end(); ++it)
+        it->second->to_Abort = true;
+}
+
+void ElunaEventProcessor::ResetWatchers()
+{
+    for (WatcherMap::iterator it = watchers.begin(); it != watchers.end(); ++it)
+        it->second->triggered = false;
+}
+
+void ElunaEventProcessor::UpdateAbilities()
+{
+    Unit* unit = obj ? obj->ToUnit() : NULL;
+
+    // On_Reset only runs for creatures with Eluna's AI, so death and evade are also checked here for any AI.
+    // Abilities scheduled while dead or evading, like from the death hook, are kept
+    if (Creature* creature = obj ? obj->ToCreature() : NULL)
+    {
+#ifdef CMANGOS
+        bool reset = !creature->isAlive() || creature->IsInEvadeMode();
+#else
+        bool reset = !creature->IsAlive() || creature->IsInEvadeMode();
+#endif
+        if (reset && !abilitiesReset)
+            ClearAbilities();
+        abilitiesReset = reset;
+    }
+
+    for (AbilityList::iterator it = abilities.begin(); it != abilities.end();)
+    {
+        ElunaAbility* ability = *it;
+        if (ability->to_Abort)
+        {
+            luaL_unref((*E)->L, LUA_REGISTRYINDEX, ability->funcRef);
+            delete ability;
+            it = abilities.erase(it);
+            continue;
+        }
+        ++it; // The function can schedule and cancel abilities
+
+        if (ability->due > m_time)
+            continue;
+        if (abilityPhase && ability->phaseMask && !(ability->phaseMask & (1u << (abilityPhase - 1))))
+            continue;
+
+        // Due abilities wait while casting, checked again after each call as the ability may have started a cast
+        if (unit)
+        {
+#ifdef TRINITY
+            if (unit->HasUnitState(UNIT_STATE_CASTING))
+                return;
+#else
+            if (unit->IsNonMeleeSpellCasted(false))
+                return;
+#endif
+        }
+
+        ExecuteAbility(ability);
+    }
+}
+
+void ElunaEventProcessor::ExecuteAbility(ElunaAbility* ability)
+{
+    // Rescheduled before calling so the function can reschedule or cancel it
+    bool repeats = ability->repeatMin != 0;
+    if (repeats)
+        ability->due = m_time + urand(ability->repeatMin, ability->repeatMax);
+
+    LOCK_ELUNA;
+    lua_State* L = (*E)->L;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ability->funcRef);
+    Eluna::Push(L, ability->id);
+    Eluna::Push(L, obj);
+    (*E)->ExecuteCall(2, 1);
+
+    // Returning a number calls the ability again after that many milliseconds
+    if (!ability->to_Abort)
+    {
+        if (lua_isnumber(L, -1))
+        {
+            lua_Number delay = lua_tonumber(L, -1);
+            ability->due = m_time + (delay > 0 ? uint64(delay) : 0);
+        }
+        else if (!repeats)
+            ability->to_Abort = true;
+    }
+    lua_pop(L, 1);
+
+    ASSERT(!(*E)->event_level);
+    (*E)->InvalidateObjects();
+}
+
+void ElunaEventProcessor::ScheduleAbility(int funcRef, uint32 abilityId, uint32 delay, uint32 repeatMin, uint32 repeatMax, uint32 phaseMask)
+{
+    CancelAbility(abilityId);
+    abilities.push_back(new ElunaAbility(funcRef, abilityId, m_time + delay, repeatMin, std::max(repeatMin, repeatMax), phaseMask));
+}
+
+void ElunaEventProcessor::CancelAbility(uint32 abilityId)
+{
+    for (AbilityList::iterator it = abilities.begin(); it != abilities.end(); ++it)
+        if (!abilityId || (*it)->id == abilityId)
+            (*it)->to_Abort = true;
+}
+
+void ElunaEventProcessor::DelayAbility(uint32 abilityId, uint32 delay)
+{
+    for (AbilityList::iterator it = abilities.begin(); it != abilities.end(); ++it)
+        if (!abilityId || (*it)->id == abilityId)
+            (*it)->due = std::max((*it)->due, m_time) + delay;
+}
+
+void ElunaEventProcessor::ClearAbilities()
+{
+    CancelAbility(0);
+    abilityPhase = 0;
+}
+
 void ElunaEventProcessor::RemoveEvents()
 {
     for (EventList::iterator it = eventList.begin(); it != eventList.end(); ++it)
@@ -107,6 +356,17 @@ void ElunaEventProcessor::RemoveEvents_internal()
 
     eventList.clear();
     eventMap.clear();
+
+    for (WatcherMap::iterator it = watchers.begin(); it != watchers.end(); ++it)
+        delete it->second;
+    watchers.clear();
+
+    for (AbilityList::iterator it = abilities.begin(); it != abilities.end(); ++it)
+    {
+        luaL_unref((*E)->L, LUA_REGISTRYINDEX, (*it)->funcRef);
+        delete *it;
+    }
+    abilities.clear();
 }
 
 void ElunaEventProcessor::RemoveEvent(int eventId)
@@ -117,7 +377,12 @@ void ElunaEventProcessor::RemoveEvent(int eventId)
 
 void ElunaEventProcessor::AddEvent(LuaEvent* event)
 {
-    eventList.insert(std::pair<uint64, LuaEvent*>(m_time + event->delay, event));
+    AddEvent(event, event->delay);
+}
+
+void ElunaEventProcessor::AddEvent(LuaEvent* event, uint32 delay)
+{
+    eventList.insert(std::pair<uint64, LuaEvent*>(m_time + delay, event));
     eventMap[event->funcRef] = event;
 }
 
@@ -126,6 +391,45 @@ void ElunaEventProcessor::AddEvent(int funcRef, uint32 delay, uint32 repeats)
     AddEvent(new LuaEvent(this, funcRef, delay, repeats));
 }
 
+void ElunaEventProcessor::AddEvent(int funcRef, uint32 delay, uint32 repeats, uint32 firstDelay)
+{
+    AddEvent(new LuaEvent(this, funcRef, delay, repeats), firstDelay);
+}
+
+void ElunaEventProcessor::SaveEvents(lua_State* L, std::vector<ElunaSavedTimer>& timers)
+{
+    for (EventList::const_iterator it = eventList.begin(); it != eventList.end(); ++it)
+    {
+        LuaEvent* event = it->second;
+        if (event->to_Abort)
+            continue;
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, event->funcRef);
+        if (!lua_isfunction(L, -1))
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        // pops the function, C functions have no line
+        lua_Debug ar;
+        lua_getinfo(L, ">S", &ar);
+        if (ar.linedefined <= 0)
+            continue;
+
+        ElunaSavedTimer timer;
+        timer.processor = this;
+        timer.source = ar.source;
+        timer.line = ar.linedefined;
+        timer.lastLine = ar.lastlinedefined;
+        timer.sourceHash = 0;
+        timer.delay = event->delay;
+        timer.calls = event->calls;
+        timer.remaining = it->first > m_time ? uint32(it->first - m_time) : 0;
+        timers.push_back(timer);
+    }
+}
+
 EventMgr::EventMgr(Eluna** _E) : globalProcessor(new ElunaEventProcessor(_E, NULL)), E(_E)
 {
 }
@@ -152,6 +456,13 @@ void EventMgr::RemoveEvents()
     globalProcessor->RemoveEvents();
 }
 
+void EventMgr::SaveTimers(lua_State* L, std::vector<ElunaSavedTimer>& timers)
+{
+    ReadGuard guard(GetLock());
+    for (ProcessorSet::const_iterator it = processors.begin(); it != processors.end(); ++it)
+        (*it)->SaveEvents(L, timers);
+}
+
 void EventMgr::RemoveEvent(int eventId)
 {
     ReadGuard guard(GetLock());
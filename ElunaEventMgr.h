@@ -10,6 +10,7 @@
 #include "ElunaUtility.h"
 #include "Common.h"
 #include <map>
+#include <list>
 
 #ifdef TRINITY
 #include "Define.h"
@@ -21,6 +22,20 @@ class Eluna;
 class EventMgr;
 class ElunaEventProcessor;
 class WorldObject;
+struct lua_State;
+
+// Timed event of a WorldObject kept over a reload, matched to the reloaded function by where it is defined
+struct ElunaSavedTimer
+{
+    ElunaEventProcessor* processor;
+    std::string source;
+    int line;
+    int lastLine;
+    uint32 sourceHash;  // crc32 of the script file when the timer was saved, 0 if unknown
+    uint32 delay;
+    uint32 calls;
+    uint32 remaining;   // time until the next call
+};
 
 class LuaEvent
 {
@@ -42,14 +57,70 @@ private:
     uint32 calls;   // Amount of calls to make, 0 for infinite
 };
 
+// Native condition of a WorldObject checked on each of its updates.
+// The Lua function is only called when the watched value crosses the threshold, after that the
+// watcher is re-armed when the value moves back past the threshold by the hysteresis
+class ElunaWatcher
+{
+    friend class ElunaEventProcessor;
+
+public:
+    enum WatchType
+    {
+        WATCH_HEALTH_PCT,
+        WATCH_POWER_PCT,            // param is the power type
+        WATCH_DISTANCE_FROM_HOME,   // creatures only
+        WATCH_AURA_STACKS           // param is the spell ID
+    };
+
+    bool to_Abort;
+
+private:
+    ElunaWatcher(ElunaEventProcessor* _events, int _funcRef, WatchType _type, uint32 _param, float _threshold, float _hysteresis, bool _above);
+    ~ElunaWatcher();
+
+    // Returns false if the value can't be read from the object
+    bool GetValue(WorldObject* obj, float& value) const;
+    void Execute(float value);
+
+    ElunaEventProcessor* events;
+    int funcRef;        // Lua function reference ID, also used as watcher ID
+    WatchType type;
+    uint32 param;
+    float threshold;
+    float hysteresis;
+    bool above;         // fires when the value rises to the threshold instead of falling to it
+    bool triggered;     // fired and waiting to be re-armed
+};
+
+// Timed ability of a creature's scheduler, see Creature:ScheduleAbility
+struct ElunaAbility
+{
+    ElunaAbility(int _funcRef, uint32 _id, uint64 _due, uint32 _repeatMin, uint32 _repeatMax, uint32 _phaseMask) :
+        funcRef(_funcRef), id(_id), due(_due), repeatMin(_repeatMin), repeatMax(_repeatMax), phaseMask(_phaseMask), to_Abort(false)
+    {
+    }
+
+    int funcRef;        // Lua function reference ID
+    uint32 id;
+    uint64 due;         // processor time of the next call
+    uint32 repeatMin;   // 0 for a single call
+    uint32 repeatMax;
+    uint32 phaseMask;   // phases the ability is called in, 0 for all
+    bool to_Abort;
+};
+
 class ElunaEventProcessor
 {
     friend class LuaEvent;
+    friend class ElunaWatcher;
     friend class EventMgr;
 
 public:
     typedef std::multimap<uint64, LuaEvent*> EventList;
     typedef UNORDERED_MAP<int, LuaEvent*> EventMap;
+    typedef std::map<int, ElunaWatcher*> WatcherMap;
+    typedef std::list<ElunaAbility*> AbilityList;
 
     ElunaEventProcessor(Eluna** _E, WorldObject* _obj);
     ~ElunaEventProcessor();
@@ -60,12 +131,43 @@ public:
     // set the event to be removed when executing
     void RemoveEvent(int eventId);
     void AddEvent(int funcRef, uint32 delay, uint32 repeats);
+    // adds an event that is called for the first time after firstDelay
+    void AddEvent(int funcRef, uint32 delay, uint32 repeats, uint32 firstDelay);
+    // saves the events that have a Lua function as callback
+    void SaveEvents(lua_State* L, std::vector<ElunaSavedTimer>& timers);
     EventMap eventMap;
 
+    void AddWatcher(int funcRef, ElunaWatcher::WatchType type, uint32 param, float threshold, float hysteresis, bool above);
+    // set the watcher to be removed on next update
+    void RemoveWatcher(int watcherId);
+    void RemoveWatchers();
+    // re-arms the watchers that have fired, used when a creature resets
+    void ResetWatchers();
+
+    // schedules the ability, replaces the ability with the same ID
+    void ScheduleAbility(int funcRef, uint32 abilityId, uint32 delay, uint32 repeatMin, uint32 repeatMax, uint32 phaseMask);
+    // set the abilities to be removed on next update, 0 for all abilities
+    void CancelAbility(uint32 abilityId);
+    // delays the abilities, 0 for all abilities
+    void DelayAbility(uint32 abilityId, uint32 delay);
+    // removes all abilities and resets the phase, used when a creature evades or dies
+    void ClearAbilities();
+    // phase 0 calls all abilities, otherwise only the ones whose phase mask has the bit for the phase
+    void SetAbilityPhase(uint32 phase) { abilityPhase = phase; }
+    uint32 GetAbilityPhase() const { return abilityPhase; }
+
 private:
+    void UpdateWatchers();
+    void UpdateAbilities();
+    void ExecuteAbility(ElunaAbility* ability);
     void RemoveEvents_internal();
     void AddEvent(LuaEvent* Event);
+    void AddEvent(LuaEvent* Event, uint32 delay);
     EventList eventList;
+    WatcherMap watchers;
+    AbilityList abilities;
+    uint32 abilityPhase;
+    bool abilitiesReset;    // the abilities were cleared for the current death or evade
     uint64 m_time;
     WorldObject* obj;
     Eluna** E;
@@ -89,6 +191,10 @@ public:
     // Removes the eventId from all events
     // Execute only in safe env
     void RemoveEvent(int eventId);
+
+    // Saves the timed events of all WorldObjects, the global events are not saved
+    // Execute only in safe env
+    void SaveTimers(lua_State* L, std::vector<ElunaSavedTimer>& timers);
 };
 
 #endif
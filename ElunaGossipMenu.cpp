@@ -0,0 +1,144 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaGossipMenu.h"
+#include "ElunaIncludes.h"
+
+namespace
+{
+    uint32 GetUIntField(lua_State* L, int index, const char* name)
+    {
+        lua_getfield(L, index, name);
+        uint32 value = 0;
+        if (lua_type(L, -1) == LUA_TNUMBER && lua_tonumber(L, -1) > 0)
+            value = uint32(lua_tonumber(L, -1));
+        lua_pop(L, 1);
+        return value;
+    }
+
+    bool GetStringField(lua_State* L, int index, const char* name, std::string& value)
+    {
+        lua_getfield(L, index, name);
+        bool found = lua_type(L, -1) == LUA_TSTRING;
+        if (found)
+            value = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return found;
+    }
+}
+
+bool ElunaGossipMenus::Item::IsAvailable(Player* player) const
+{
+    if (minLevel && player->getLevel() < minLevel)
+        return false;
+    if (maxLevel && player->getLevel() > maxLevel)
+        return false;
+    if (raceMask && !(player->getRaceMask() & raceMask))
+        return false;
+    if (classMask && !(player->getClassMask() & classMask))
+        return false;
+    if (quest && !player->GetQuestRewardStatus(quest))
+        return false;
+    if (item && !player->HasItemCount(item, 1))
+        return false;
+    if (spell && !player->HasSpell(spell))
+        return false;
+    if (gm)
+    {
+#ifndef TRINITY
+        bool isGM = player->isGameMaster();
+#else
+        bool isGM = player->IsGameMaster();
+#endif
+        if (isGM != (gm == 1))
+            return false;
+    }
+    return true;
+}
+
+bool ElunaGossipMenus::Build(lua_State* L, int index, Menu& menu, std::string& error)
+{
+    if (!lua_istable(L, index))
+    {
+        error = "gossip menu must be a table";
+        return false;
+    }
+    index = lua_absindex(L, index);
+
+    menu.textId = GetUIntField(L, index, "text");
+    if (!menu.textId)
+    {
+        error = "gossip menu needs a text";
+        return false;
+    }
+    menu.menuId = GetUIntField(L, index, "menuId");
+    lua_getfield(L, index, "quests");
+    menu.quests = lua_toboolean(L, -1) != 0;
+    lua_pop(L, 1);
+
+    uint32 count = lua_rawlen(L, index);
+    menu.items.reserve(count);
+    for (uint32 i = 1; i <= count; ++i)
+    {
+        lua_rawgeti(L, index, i);
+        int itemIndex = lua_gettop(L);
+        if (!lua_istable(L, itemIndex))
+        {
+            lua_pop(L, 1);
+            error = "gossip menu item must be a table";
+            return false;
+        }
+
+        Item item;
+        if (!GetStringField(L, itemIndex, "text", item.text))
+        {
+            lua_pop(L, 1);
+            error = "gossip menu item needs a text";
+            return false;
+        }
+        item.icon = GetUIntField(L, itemIndex, "icon");
+        item.sender = GetUIntField(L, itemIndex, "sender");
+        item.intid = GetUIntField(L, itemIndex, "intid");
+        GetStringField(L, itemIndex, "popup", item.popup);
+        item.money = GetUIntField(L, itemIndex, "money");
+        item.minLevel = GetUIntField(L, itemIndex, "minLevel");
+        item.maxLevel = GetUIntField(L, itemIndex, "maxLevel");
+        item.raceMask = GetUIntField(L, itemIndex, "raceMask");
+        item.classMask = GetUIntField(L, itemIndex, "classMask");
+        item.quest = GetUIntField(L, itemIndex, "quest");
+        item.item = GetUIntField(L, itemIndex, "item");
+        item.spell = GetUIntField(L, itemIndex, "spell");
+
+        lua_getfield(L, itemIndex, "code");
+        item.code = lua_toboolean(L, -1) != 0;
+        lua_pop(L, 1);
+
+        lua_getfield(L, itemIndex, "gm");
+        if (lua_isboolean(L, -1))
+            item.gm = lua_toboolean(L, -1) ? 1 : 2;
+        lua_pop(L, 2);
+
+        menu.items.push_back(item);
+    }
+    return true;
+}
+
+uint32 ElunaGossipMenus::Add(Menu const& menu)
+{
+    menus[++lastId] = menu;
+    return lastId;
+}
+
+ElunaGossipMenus::Menu const* ElunaGossipMenus::Get(uint32 id) const
+{
+    MenuMap::const_iterator itr = menus.find(id);
+    return itr != menus.end() ? &itr->second : NULL;
+}
+
+bool ElunaGossipMenus::Remove(uint32 id)
+{
+    return menus.erase(id) != 0;
+}
@@ -0,0 +1,84 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_GOSSIP_MENU_H
+#define _ELUNA_GOSSIP_MENU_H
+
+#include "Common.h"
+
+extern "C"
+{
+#include "lua.h"
+};
+
+class Player;
+
+/*
+ * Gossip menus built once from Lua tables, see CreateGossipMenu.
+ *
+ * A menu keeps its items with their conditions, so sending it to a player is a single
+ * call that checks the conditions natively. Menus are only used from Lua and
+ * are guarded by the Eluna lock.
+ */
+class ElunaGossipMenus
+{
+public:
+    struct Item
+    {
+        Item() : icon(0), sender(0), intid(0), code(false), money(0),
+            minLevel(0), maxLevel(0), raceMask(0), classMask(0), quest(0), item(0), spell(0), gm(0) { }
+
+        // Returns true if the player meets all conditions of the item
+        bool IsAvailable(Player* player) const;
+
+        uint32 icon;
+        std::string text;
+        uint32 sender;
+        uint32 intid;
+        bool code;
+        std::string popup;
+        uint32 money;
+
+        // Conditions, 0 is no condition
+        uint32 minLevel;
+        uint32 maxLevel;
+        uint32 raceMask;
+        uint32 classMask;
+        uint32 quest;       // rewarded quest
+        uint32 item;        // item in the bags
+        uint32 spell;       // known spell
+        uint8 gm;           // 1 only game masters, 2 only others
+    };
+
+    struct Menu
+    {
+        Menu() : textId(0), menuId(0), quests(false) { }
+
+        uint32 textId;      // npc_text shown with the menu
+        uint32 menuId;      // menu id for menus sent by players
+        bool quests;        // adds the quests of the sender
+        std::vector<Item> items;
+    };
+
+    ElunaGossipMenus() : lastId(0) { }
+
+    // Builds a menu from the table at index. Returns false and sets error if the definition is invalid
+    static bool Build(lua_State* L, int index, Menu& menu, std::string& error);
+
+    // Stores the menu and returns its id
+    uint32 Add(Menu const& menu);
+    // Returns NULL if there is no menu with the id
+    Menu const* Get(uint32 id) const;
+    bool Remove(uint32 id);
+
+private:
+    typedef std::map<uint32, Menu> MenuMap;
+
+    MenuMap menus;
+    uint32 lastId;
+};
+
+#endif
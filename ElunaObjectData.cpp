@@ -0,0 +1,84 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaObjectData.h"
+
+extern "C"
+{
+#include "lauxlib.h"
+};
+
+ElunaObjectData::ElunaObjectData()
+{
+}
+
+ElunaObjectData::~ElunaObjectData()
+{
+    // The tables are freed with the Lua state
+}
+
+void ElunaObjectData::ReleaseErased(lua_State* L)
+{
+    std::vector<int> released;
+    {
+        WriteGuard guard(GetLock());
+        if (erased.empty())
+            return;
+        released.swap(erased);
+    }
+
+    for (std::vector<int>::const_iterator it = released.begin(); it != released.end(); ++it)
+        luaL_unref(L, LUA_REGISTRYINDEX, *it);
+}
+
+void ElunaObjectData::Push(lua_State* L, StoreType type, uint64 key, bool create)
+{
+    ReleaseErased(L);
+
+    int ref = LUA_NOREF;
+    {
+        ReadGuard guard(GetLock());
+        RefMap::const_iterator it = refs[type].find(key);
+        if (it != refs[type].end())
+            ref = it->second;
+    }
+
+    if (ref != LUA_NOREF)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+        return;
+    }
+
+    if (!create)
+    {
+        lua_pushnil(L);
+        return;
+    }
+
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    WriteGuard guard(GetLock());
+    refs[type][key] = ref;
+}
+
+void ElunaObjectData::Erase(StoreType type, uint64 key)
+{
+    {
+        ReadGuard guard(GetLock());
+        if (refs[type].empty() || refs[type].find(key) == refs[type].end())
+            return;
+    }
+
+    WriteGuard guard(GetLock());
+    RefMap::iterator it = refs[type].find(key);
+    if (it == refs[type].end())
+        return;
+
+    erased.push_back(it->second);
+    refs[type].erase(it);
+}
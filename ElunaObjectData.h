@@ -0,0 +1,56 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_OBJECT_DATA_H
+#define _ELUNA_OBJECT_DATA_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+
+extern "C"
+{
+#include "lua.h"
+};
+
+/*
+ * Variables set from Lua with GetData and SetData.
+ *
+ * Each object or map instance owns one Lua table referenced from the registry,
+ * world objects are keyed by their full GUID and map instances by map and instance ID.
+ * The tables are dropped from the remove, logout and map destroy hooks. Those can run
+ * on map threads without the Eluna lock, so the references are only queued there
+ * and released from the Lua state on the next access.
+ */
+class ElunaObjectData : public ElunaUtil::RWLockable
+{
+public:
+    enum StoreType
+    {
+        STORE_OBJECT,
+        STORE_MAP,
+        STORE_TYPES
+    };
+
+    ElunaObjectData();
+    ~ElunaObjectData();
+
+    // Pushes the data table of key, creates it if create is true and otherwise pushes nil when missing
+    void Push(lua_State* L, StoreType type, uint64 key, bool create);
+    // Drops the data table of key, safe to call without the Eluna lock
+    void Erase(StoreType type, uint64 key);
+
+    static uint64 MakeMapKey(uint32 mapId, uint32 instanceId) { return (uint64(mapId) << 32) | instanceId; }
+
+private:
+    typedef UNORDERED_MAP<uint64, int> RefMap;
+
+    void ReleaseErased(lua_State* L);
+
+    RefMap refs[STORE_TYPES];
+    std::vector<int> erased;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaPacketPool.h"
+#include "ElunaIncludes.h"
+#include <algorithm>
+
+ElunaPacketPool::ElunaPacketPool(uint32 maxPerClass) :
+maxPerClass(maxPerClass), hits(0), misses(0), releases(0), discards(0)
+{
+}
+
+ElunaPacketPool::~ElunaPacketPool()
+{
+    for (int i = 0; i < PACKET_POOL_CLASSES; ++i)
+    {
+        for (std::vector<WorldPacket*>::iterator it = pooled[i].begin(); it != pooled[i].end(); ++it)
+            delete *it;
+        pooled[i].clear();
+    }
+}
+
+int ElunaPacketPool::GetClass(size_t size)
+{
+    for (int i = 0; i < PACKET_POOL_CLASSES; ++i)
+        if (size <= (size_t(64) << (2 * i)))
+            return i;
+    return -1;
+}
+
+int ElunaPacketPool::GetFilledClass(size_t size)
+{
+    for (int i = PACKET_POOL_CLASSES - 1; i >= 0; --i)
+        if (size >= (size_t(64) << (2 * i)))
+            return i;
+    return -1;
+}
+
+WorldPacket* ElunaPacketPool::Acquire(uint32 opcode, size_t size)
+{
+    int sizeClass = GetClass(size);
+    if (sizeClass < 0)
+    {
+        ++misses;
+        return new WorldPacket((OpcodesList)opcode, size);
+    }
+
+    WorldPacket* packet;
+    if (pooled[sizeClass].empty())
+    {
+        ++misses;
+        // reserve the whole class so the packet can be reused for any size in it
+        packet = new WorldPacket((OpcodesList)opcode, size_t(64) << (2 * sizeClass));
+    }
+    else
+    {
+        packet = pooled[sizeClass].back();
+        pooled[sizeClass].pop_back();
+        packet->SetOpcode((OpcodesList)opcode);
+        ++hits;
+    }
+    acquired[packet] = sizeClass;
+    return packet;
+}
+
+void ElunaPacketPool::Release(WorldPacket* packet)
+{
+    if (!packet)
+        return;
+
+    // The storage holds at least the reserved class and the content, whichever is larger.
+    // Packets that grew past the largest class are not kept
+    int sizeClass = GetFilledClass(packet->size());
+    UNORDERED_MAP<WorldPacket const*, int>::iterator itr = acquired.find(packet);
+    if (itr != acquired.end())
+    {
+        sizeClass = std::max(sizeClass, itr->second);
+        acquired.erase(itr);
+    }
+    if (sizeClass < 0 || GetClass(packet->size()) < 0 || pooled[sizeClass].size() >= maxPerClass)
+    {
+        ++discards;
+        delete packet;
+        return;
+    }
+
+    packet->clear();
+    pooled[sizeClass].push_back(packet);
+    ++releases;
+}
+
+uint32 ElunaPacketPool::GetPooledCount() const
+{
+    uint32 count = 0;
+    for (int i = 0; i < PACKET_POOL_CLASSES; ++i)
+        count += pooled[i].size();
+    return count;
+}
@@ -0,0 +1,61 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_PACKET_POOL_H
+#define _ELUNA_PACKET_POOL_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+
+class WorldPacket;
+
+// Amount of size classes, class n holds packets of up to 64 << (2 * n) bytes
+#define PACKET_POOL_CLASSES 5
+
+/*
+ * Recycles the WorldPackets created by Lua.
+ *
+ * Released packets keep their reserved storage and are handed out again
+ * by the next Acquire that fits their size class. A released packet is filed under
+ * the largest class its storage is known to hold: the class it was acquired for,
+ * or the class its content fills if it grew. Packets larger than the
+ * largest class are allocated and deleted normally.
+ * The pool is only used from the Lua state, which is guarded by the Eluna lock.
+ */
+class ElunaPacketPool
+{
+public:
+    ElunaPacketPool(uint32 maxPerClass);
+    ~ElunaPacketPool();
+
+    // Returns an empty packet with at least size bytes reserved
+    WorldPacket* Acquire(uint32 opcode, size_t size);
+    // Takes back ownership of a packet returned by Acquire
+    void Release(WorldPacket* packet);
+
+    uint64 GetHits() const { return hits; }
+    uint64 GetMisses() const { return misses; }
+    uint64 GetReleases() const { return releases; }
+    uint64 GetDiscards() const { return discards; }
+    uint32 GetPooledCount() const;
+
+private:
+    // Returns the smallest class that holds size bytes, -1 if none does
+    static int GetClass(size_t size);
+    // Returns the largest class whose size is at most size bytes, -1 if none is
+    static int GetFilledClass(size_t size);
+
+    std::vector<WorldPacket*> pooled[PACKET_POOL_CLASSES];
+    UNORDERED_MAP<WorldPacket const*, int> acquired;   // class each packet handed out was reserved for
+    uint32 maxPerClass;
+
+    uint64 hits;        // acquires served from the pool
+    uint64 misses;      // acquires that allocated a new packet
+    uint64 releases;    // packets put back into the pool
+    uint64 discards;    // released packets deleted because they were too big or the class was full
+};
+
+#endif
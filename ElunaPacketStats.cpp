@@ -0,0 +1,131 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaPacketStats.h"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    bool SortByTime(ElunaPacketStats::Snapshot const& left, ElunaPacketStats::Snapshot const& right)
+    {
+        if (left.time != right.time)
+            return left.time > right.time;
+        return left.seen > right.seen;
+    }
+}
+
+ElunaPacketStats::ElunaPacketStats(uint32 opcodeCount, bool enabled) :
+stats(new OpcodeStats[opcodeCount * PACKET_STATS_DIRECTIONS]), opcodeCount(opcodeCount), enabled(enabled)
+{
+    Reset();
+}
+
+ElunaPacketStats::~ElunaPacketStats()
+{
+    delete[] stats;
+}
+
+ElunaPacketStats::OpcodeStats* ElunaPacketStats::Get(Direction direction, uint32 opcode)
+{
+    if (opcode >= opcodeCount)
+        return NULL;
+    return &stats[direction * opcodeCount + opcode];
+}
+
+void ElunaPacketStats::RecordSeen(Direction direction, uint32 opcode, size_t size)
+{
+    OpcodeStats* entry = Get(direction, opcode);
+    if (!entry)
+        return;
+
+    entry->seen.fetch_add(1, std::memory_order_relaxed);
+    entry->bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void ElunaPacketStats::RecordHooked(Direction direction, uint32 opcode, uint64 micros, bool dropped, bool replaced)
+{
+    OpcodeStats* entry = Get(direction, opcode);
+    if (!entry)
+        return;
+
+    // bucket 0 holds 0us, bucket n holds [2^(n-1), 2^n) us
+    uint32 bucket = 0;
+    for (uint64 t = micros; t && bucket < PACKET_STATS_BUCKETS - 1; t >>= 1)
+        ++bucket;
+
+    entry->hooked.fetch_add(1, std::memory_order_relaxed);
+    entry->time.fetch_add(micros, std::memory_order_relaxed);
+    entry->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    if (dropped)
+        entry->dropped.fetch_add(1, std::memory_order_relaxed);
+    if (replaced)
+        entry->replaced.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ElunaPacketStats::Reset()
+{
+    for (uint32 i = 0; i < opcodeCount * PACKET_STATS_DIRECTIONS; ++i)
+    {
+        OpcodeStats& entry = stats[i];
+        entry.seen.store(0, std::memory_order_relaxed);
+        entry.hooked.store(0, std::memory_order_relaxed);
+        entry.bytes.store(0, std::memory_order_relaxed);
+        entry.time.store(0, std::memory_order_relaxed);
+        entry.dropped.store(0, std::memory_order_relaxed);
+        entry.replaced.store(0, std::memory_order_relaxed);
+        for (uint32 b = 0; b < PACKET_STATS_BUCKETS; ++b)
+            entry.buckets[b].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32 ElunaPacketStats::GetPercentile(OpcodeStats const& entry, uint64 count, uint32 percent)
+{
+    if (!count)
+        return 0;
+
+    uint64 target = (count * percent + 99) / 100;
+    uint64 sum = 0;
+    for (uint32 b = 0; b < PACKET_STATS_BUCKETS; ++b)
+    {
+        sum += entry.buckets[b].load(std::memory_order_relaxed);
+        if (sum >= target)
+            return (uint32(1) << b) - 1;
+    }
+    return (uint32(1) << (PACKET_STATS_BUCKETS - 1)) - 1;
+}
+
+void ElunaPacketStats::GetSnapshots(std::vector<Snapshot>& snapshots) const
+{
+    for (uint32 i = 0; i < opcodeCount * PACKET_STATS_DIRECTIONS; ++i)
+    {
+        OpcodeStats const& entry = stats[i];
+        uint64 seen = entry.seen.load(std::memory_order_relaxed);
+        if (!seen)
+            continue;
+
+        Snapshot snapshot;
+        snapshot.opcode = i % opcodeCount;
+        snapshot.direction = i / opcodeCount;
+        snapshot.seen = seen;
+        snapshot.hooked = entry.hooked.load(std::memory_order_relaxed);
+        snapshot.bytes = entry.bytes.load(std::memory_order_relaxed);
+        snapshot.time = entry.time.load(std::memory_order_relaxed);
+        snapshot.dropped = entry.dropped.load(std::memory_order_relaxed);
+        snapshot.replaced = entry.replaced.load(std::memory_order_relaxed);
+        snapshot.p50 = GetPercentile(entry, snapshot.hooked, 50);
+        snapshot.p99 = GetPercentile(entry, snapshot.hooked, 99);
+        snapshots.push_back(snapshot);
+    }
+
+    std::sort(snapshots.begin(), snapshots.end(), SortByTime);
+}
+
+uint64 ElunaPacketStats::GetMicroTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
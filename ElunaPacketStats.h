@@ -0,0 +1,84 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_PACKET_STATS_H
+#define _ELUNA_PACKET_STATS_H
+
+#include "Common.h"
+#include <atomic>
+
+// Amount of log2 buckets in the handler time histogram, the last one is open ended
+#define PACKET_STATS_BUCKETS 32
+
+/*
+ * Per opcode counters for packets passing through the packet hooks.
+ *
+ * Every packet is counted when enabled, handler time is measured only
+ * for packets that actually had a Lua handler bound to them.
+ * Counters are updated from the network and map threads without locking.
+ */
+class ElunaPacketStats
+{
+public:
+    enum Direction
+    {
+        PACKET_STATS_SEND,
+        PACKET_STATS_RECEIVE,
+        PACKET_STATS_DIRECTIONS
+    };
+
+    // Plain copy of the counters of one opcode in one direction
+    struct Snapshot
+    {
+        uint32 opcode;
+        uint32 direction;
+        uint64 seen;            // packets passing the hook
+        uint64 hooked;          // packets that had handlers called for them
+        uint64 bytes;           // size of all seen packets
+        uint64 time;            // total handler time in microseconds
+        uint64 dropped;         // packets a handler returned false for
+        uint64 replaced;        // packets a handler returned a new packet for
+        uint32 p50;             // handler time percentiles in microseconds, upper bound of the histogram bucket
+        uint32 p99;
+    };
+
+    ElunaPacketStats(uint32 opcodeCount, bool enabled);
+    ~ElunaPacketStats();
+
+    bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    void SetEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+
+    void RecordSeen(Direction direction, uint32 opcode, size_t size);
+    void RecordHooked(Direction direction, uint32 opcode, uint64 micros, bool dropped, bool replaced);
+    void Reset();
+
+    // Fills snapshots of all opcodes with seen packets, sorted by total handler time
+    void GetSnapshots(std::vector<Snapshot>& snapshots) const;
+
+    // Monotonic time in microseconds for measuring handlers
+    static uint64 GetMicroTime();
+
+private:
+    struct OpcodeStats
+    {
+        std::atomic<uint64> seen;
+        std::atomic<uint64> hooked;
+        std::atomic<uint64> bytes;
+        std::atomic<uint64> time;
+        std::atomic<uint64> dropped;
+        std::atomic<uint64> replaced;
+        std::atomic<uint32> buckets[PACKET_STATS_BUCKETS];
+    };
+
+    OpcodeStats* Get(Direction direction, uint32 opcode);
+    static uint32 GetPercentile(OpcodeStats const& stats, uint64 count, uint32 percent);
+
+    OpcodeStats* stats;
+    uint32 opcodeCount;
+    std::atomic<bool> enabled;
+};
+
+#endif
@@ -0,0 +1,438 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaPersistentStore.h"
+#include "ElunaIncludes.h"
+#include "zlib.h"
+
+#if PLATFORM == PLATFORM_WINDOWS
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// crc, key length, value length
+#define RECORD_HEADER_SIZE 12
+// Value length of a delete record
+#define RECORD_DELETED 0xFFFFFFFF
+
+static void WriteUInt32(char* dest, uint32 value)
+{
+    for (int i = 0; i < 4; ++i)
+        dest[i] = char(value >> (8 * i));
+}
+
+static uint32 ReadUInt32(const char* src)
+{
+    uint32 value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= uint32(uint8(src[i])) << (8 * i);
+    return value;
+}
+
+static uint64 GetRecordSize(std::string const& key, std::string const& value)
+{
+    return RECORD_HEADER_SIZE + key.size() + value.size();
+}
+
+ElunaPersistentStore& ElunaPersistentStore::Instance()
+{
+    static ElunaPersistentStore instance;
+    return instance;
+}
+
+ElunaPersistentStore::ElunaPersistentStore() :
+file(NULL), logSize(0), liveSize(0), syncInterval(0), syncTimer(0)
+{
+}
+
+ElunaPersistentStore::~ElunaPersistentStore()
+{
+    Close();
+}
+
+bool ElunaPersistentStore::Open(std::string const& filePath, uint32 interval)
+{
+    WriteGuard guard(GetLock());
+
+    syncInterval = interval;
+    if (file)
+        return true;
+
+    uint32 oldMSTime = ElunaUtil::GetCurrTime();
+    path = filePath;
+    if (!Load())
+    {
+        values.clear();
+        logSize = 0;
+        liveSize = 0;
+        return false;
+    }
+
+    ELUNA_LOG_INFO("[Eluna]: Loaded %u persistent store entries from `%s` in %u ms", uint32(values.size()), path.c_str(), ElunaUtil::GetTimeDiff(oldMSTime));
+    return true;
+}
+
+void ElunaPersistentStore::Close()
+{
+    WriteGuard guard(GetLock());
+    if (!file)
+        return;
+
+    if (!pending.empty() && !WritePending())
+        ELUNA_LOG_ERROR("[Eluna]: %u bytes of persistent store records could not be written to `%s` and are lost", uint32(pending.size()), path.c_str());
+    if (file)
+    {
+        fclose(file);
+        file = NULL;
+    }
+    pending.clear();
+
+    values.clear();
+    logSize = 0;
+    liveSize = 0;
+}
+
+size_t ElunaPersistentStore::Parse(const char* data, size_t size)
+{
+    size_t pos = 0;
+    while (size - pos >= RECORD_HEADER_SIZE)
+    {
+        const char* record = data + pos;
+        uint32 crc = ReadUInt32(record);
+        uint32 keyLen = ReadUInt32(record + 4);
+        uint32 valueLen = ReadUInt32(record + 8);
+        uint64 bodyLen = uint64(keyLen) + (valueLen == RECORD_DELETED ? 0 : valueLen);
+        if (bodyLen > size - pos - RECORD_HEADER_SIZE)
+            break;
+
+        uLong check = crc32(0L, Z_NULL, 0);
+        check = crc32(check, reinterpret_cast<const Bytef*>(record + 4), uInt(RECORD_HEADER_SIZE - 4 + bodyLen));
+        if (uint32(check) != crc)
+            break;
+
+        std::string key(record + RECORD_HEADER_SIZE, keyLen);
+        ValueMap::iterator it = values.find(key);
+        if (it != values.end())
+        {
+            liveSize -= GetRecordSize(it->first, it->second);
+            if (valueLen == RECORD_DELETED)
+                values.erase(it);
+        }
+        if (valueLen != RECORD_DELETED)
+        {
+            std::string& value = values[key];
+            value.assign(record + RECORD_HEADER_SIZE + keyLen, valueLen);
+            liveSize += GetRecordSize(key, value);
+        }
+
+        pos += size_t(RECORD_HEADER_SIZE + bodyLen);
+    }
+    return pos;
+}
+
+bool ElunaPersistentStore::Load()
+{
+    size_t size = 0;
+    size_t valid = 0;
+
+#if PLATFORM == PLATFORM_WINDOWS
+    if (FILE* f = fopen(path.c_str(), "rb"))
+    {
+        fseek(f, 0, SEEK_END);
+        long length = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        if (length > 0)
+        {
+            std::vector<char> data(length);
+            size = fread(&data[0], 1, length, f);
+            valid = Parse(&data[0], size);
+        }
+        fclose(f);
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            size = size_t(st.st_size);
+            void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                close(fd);
+                ELUNA_LOG_ERROR("[Eluna]: Could not map persistent store `%s`", path.c_str());
+                return false;
+            }
+            valid = Parse(static_cast<const char*>(data), size);
+            munmap(data, size);
+        }
+        close(fd);
+    }
+#endif
+
+    logSize = valid;
+    if (valid < size)
+    {
+        // A torn or corrupted tail is rewritten away, everything before it is intact
+        ELUNA_LOG_ERROR("[Eluna]: Persistent store `%s` has %u invalid bytes at its end, they are discarded", path.c_str(), uint32(size - valid));
+        if (Compact())
+            return true;
+
+        // Compact reopens the old log, records appended after its invalid tail would be lost on the next load
+        if (file)
+        {
+            fclose(file);
+            file = NULL;
+        }
+        ELUNA_LOG_ERROR("[Eluna]: Persistent store `%s` is not opened", path.c_str());
+        return false;
+    }
+
+    file = fopen(path.c_str(), "ab");
+    if (!file)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: Could not open persistent store `%s`", path.c_str());
+        values.clear();
+        return false;
+    }
+    return true;
+}
+
+void ElunaPersistentStore::AppendRecord(std::string& buffer, std::string const& key, std::string const* value)
+{
+    uint32 valueLen = value ? uint32(value->size()) : RECORD_DELETED;
+
+    char header[RECORD_HEADER_SIZE];
+    WriteUInt32(header + 4, uint32(key.size()));
+    WriteUInt32(header + 8, valueLen);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(header + 4), RECORD_HEADER_SIZE - 4);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(key.data()), uInt(key.size()));
+    if (value)
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(value->data()), uInt(value->size()));
+    WriteUInt32(header, uint32(crc));
+
+    buffer.append(header, RECORD_HEADER_SIZE);
+    buffer.append(key);
+    if (value)
+        buffer.append(*value);
+}
+
+void ElunaPersistentStore::Append(std::string const& key, std::string const* value)
+{
+    AppendRecord(pending, key, value);
+    logSize += RECORD_HEADER_SIZE + key.size() + (value ? value->size() : 0);
+}
+
+bool ElunaPersistentStore::Get(std::string const& key, std::string& value)
+{
+    ReadGuard guard(GetLock());
+    ValueMap::const_iterator it = values.find(key);
+    if (it == values.end())
+        return false;
+    value = it->second;
+    return true;
+}
+
+void ElunaPersistentStore::Put(std::string const& key, std::string const& value)
+{
+    WriteGuard guard(GetLock());
+    if (!file)
+        return;
+
+    ValueMap::iterator it = values.find(key);
+    if (it != values.end())
+    {
+        liveSize -= GetRecordSize(it->first, it->second);
+        it->second = value;
+    }
+    else
+        values[key] = value;
+    liveSize += GetRecordSize(key, value);
+
+    Append(key, &value);
+}
+
+bool ElunaPersistentStore::Delete(std::string const& key)
+{
+    WriteGuard guard(GetLock());
+    if (!file)
+        return false;
+
+    ValueMap::iterator it = values.find(key);
+    if (it == values.end())
+        return false;
+
+    liveSize -= GetRecordSize(it->first, it->second);
+    values.erase(it);
+
+    Append(key, NULL);
+    return true;
+}
+
+void ElunaPersistentStore::GetRange(std::string const& prefix, EntryList& entries)
+{
+    ReadGuard guard(GetLock());
+    for (ValueMap::const_iterator it = values.lower_bound(prefix); it != values.end(); ++it)
+    {
+        if (it->first.compare(0, prefix.size(), prefix) != 0)
+            break;
+        entries.push_back(*it);
+    }
+}
+
+bool ElunaPersistentStore::SyncFile(FILE* f)
+{
+    if (fflush(f) != 0)
+        return false;
+#if PLATFORM == PLATFORM_WINDOWS
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+void ElunaPersistentStore::SyncDirectory()
+{
+    // MoveFileEx writes through on Windows, a rename is only durable once its directory is synced
+#if PLATFORM != PLATFORM_WINDOWS
+    std::string::size_type slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : (slash ? path.substr(0, slash) : "/");
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0)
+        ELUNA_LOG_ERROR("[Eluna]: Could not sync the directory of the persistent store `%s`", path.c_str());
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+bool ElunaPersistentStore::WritePending()
+{
+    bool ok = fwrite(pending.data(), 1, pending.size(), file) == pending.size();
+    ok = SyncFile(file) && ok;
+    if (ok)
+    {
+        pending.clear();
+        return true;
+    }
+
+    ELUNA_LOG_ERROR("[Eluna]: Could not write to persistent store `%s`, the records are kept for the next sync", path.c_str());
+
+    // Cut off whatever part of the records reached the file
+    uint64 synced = logSize - pending.size();
+    clearerr(file);
+    fflush(file);
+#if PLATFORM == PLATFORM_WINDOWS
+    bool truncated = _chsize_s(_fileno(file), __int64(synced)) == 0;
+#else
+    bool truncated = ftruncate(fileno(file), off_t(synced)) == 0;
+#endif
+    fclose(file);
+    file = NULL;
+    if (!truncated)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: Could not truncate persistent store `%s` after a failed write, it is closed", path.c_str());
+        return false;
+    }
+
+    file = fopen(path.c_str(), "ab");
+    if (!file)
+        ELUNA_LOG_ERROR("[Eluna]: Could not open persistent store `%s`", path.c_str());
+    return false;
+}
+
+void ElunaPersistentStore::Sync()
+{
+    WriteGuard guard(GetLock());
+    syncTimer = 0;
+    if (!file || pending.empty())
+        return;
+
+    if (!WritePending())
+        return;
+
+    if (logSize >= PERSISTENT_STORE_COMPACT_MIN && logSize > 2 * liveSize)
+        Compact();
+}
+
+bool ElunaPersistentStore::Compact()
+{
+    std::string tmpPath = path + ".tmp";
+    FILE* tmp = fopen(tmpPath.c_str(), "wb");
+    if (!tmp)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: Could not create `%s` to compact the persistent store", tmpPath.c_str());
+        return false;
+    }
+
+    std::string buffer;
+    bool ok = true;
+    for (ValueMap::const_iterator it = values.begin(); it != values.end(); ++it)
+    {
+        AppendRecord(buffer, it->first, &it->second);
+        // Don't hold the whole store in memory twice
+        if (buffer.size() >= PERSISTENT_STORE_COMPACT_MIN)
+        {
+            ok = fwrite(buffer.data(), 1, buffer.size(), tmp) == buffer.size() && ok;
+            buffer.clear();
+        }
+    }
+    ok = fwrite(buffer.data(), 1, buffer.size(), tmp) == buffer.size() && ok;
+    ok = SyncFile(tmp) && ok;
+    ok = !ferror(tmp) && ok;
+    fclose(tmp);
+
+    if (!ok)
+    {
+        ELUNA_LOG_ERROR("[Eluna]: Could not write `%s` to compact the persistent store", tmpPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    if (file)
+    {
+        fclose(file);
+        file = NULL;
+    }
+
+    // The new log replaces the old one in a single step, a crash leaves either of them complete
+#if PLATFORM == PLATFORM_WINDOWS
+    ok = MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+    if (ok)
+    {
+        logSize = liveSize;
+        SyncDirectory();
+    }
+    else
+        remove(tmpPath.c_str());
+    if (!ok)
+        ELUNA_LOG_ERROR("[Eluna]: Could not replace the persistent store `%s` with its compacted log", path.c_str());
+
+    file = fopen(path.c_str(), "ab");
+    if (!file)
+        ELUNA_LOG_ERROR("[Eluna]: Could not open persistent store `%s`", path.c_str());
+    return ok && file;
+}
+
+void ElunaPersistentStore::Update(uint32 diff)
+{
+    if (!file || !syncInterval)
+        return;
+
+    syncTimer += diff;
+    if (syncTimer >= syncInterval)
+        Sync();
+}
@@ -0,0 +1,90 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_PERSISTENT_STORE_H
+#define _ELUNA_PERSISTENT_STORE_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+#include <map>
+#include <cstdio>
+
+// The log is only compacted when it is at least this big and twice the size of the live entries
+#define PERSISTENT_STORE_COMPACT_MIN (1024 * 1024)
+
+/*
+ * Local key value store for scripts, kept in an append-only log file.
+ *
+ * Every put and delete is appended as a record with a CRC. The records are
+ * batched in memory and written and synced to disk together, on the sync
+ * interval or when Sync is called. A record counts as committed once it is synced.
+ * When the log is loaded, records after the first torn or corrupted one are
+ * dropped, so a crash loses only the records that were not synced yet.
+ * The log is rewritten with only the live entries when it grows too big.
+ *
+ * The whole log is read through a memory mapping when it is opened. After that,
+ * reads are served from the in-memory index. The store is process wide and
+ * stays open over reloads.
+ */
+class ElunaPersistentStore : public ElunaUtil::RWLockable
+{
+public:
+    typedef std::map<std::string, std::string> ValueMap;
+    typedef std::vector<std::pair<std::string, std::string> > EntryList;
+
+    static ElunaPersistentStore& Instance();
+
+    // Opens and loads the log, does nothing if it is already open
+    bool Open(std::string const& path, uint32 syncInterval);
+    void Close();
+    bool IsOpen() const { return file != NULL; }
+
+    bool Get(std::string const& key, std::string& value);
+    void Put(std::string const& key, std::string const& value);
+    // Returns false if the key didn't exist
+    bool Delete(std::string const& key);
+    // Copies all entries whose key starts with prefix, in key order
+    void GetRange(std::string const& prefix, EntryList& entries);
+
+    // Writes and syncs all batched records, compacts the log if needed
+    void Sync();
+    // Syncs when the sync interval has passed
+    void Update(uint32 diff);
+
+private:
+    ElunaPersistentStore();
+    ~ElunaPersistentStore();
+    ElunaPersistentStore(ElunaPersistentStore const&);
+    ElunaPersistentStore& operator=(ElunaPersistentStore const&);
+
+    // Fills the index from the log data and returns the length of its valid part
+    size_t Parse(const char* data, size_t size);
+    bool Load();
+    static void AppendRecord(std::string& buffer, std::string const& key, std::string const* value);
+    // Appends a record to the pending records
+    void Append(std::string const& key, std::string const* value);
+    // Flushes and syncs the file, returns false on failure
+    static bool SyncFile(FILE* f);
+    // Syncs the directory of the log so a rename in it is durable
+    void SyncDirectory();
+    // Writes and syncs the pending records. On failure the log is cut back to its last synced
+    // record and the records are kept pending, so later records never follow a partial one
+    bool WritePending();
+    // Rewrites the log with only the live entries, requires the pending records to be written
+    bool Compact();
+
+    ValueMap values;
+    std::string pending;    // records not written to the log yet
+    std::string path;
+    FILE* file;
+
+    uint64 logSize;         // bytes in the log, including pending records, the synced part is logSize - pending.size()
+    uint64 liveSize;        // bytes the live entries would take as records
+    uint32 syncInterval;
+    uint32 syncTimer;
+};
+
+#endif
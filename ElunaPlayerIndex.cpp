@@ -0,0 +1,259 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaPlayerIndex.h"
+#include "ElunaIncludes.h"
+
+ElunaPlayerIndex::ElunaPlayerIndex()
+{
+}
+
+ElunaPlayerIndex::~ElunaPlayerIndex()
+{
+}
+
+void ElunaPlayerIndex::Rebuild()
+{
+    WriteGuard guard(GetLock());
+
+    entries.clear();
+    for (uint32 i = 0; i < 2; ++i)
+        teams[i].clear();
+    gmCandidates.clear();
+    maps.clear();
+    zones.clear();
+
+    SessionMap const& sessions = eWorld->GetAllSessions();
+    for (SessionMap::const_iterator it = sessions.begin(); it != sessions.end(); ++it)
+    {
+        Player* player = it->second->GetPlayer();
+        if (!player || !player->IsInWorld())
+            continue;
+
+        Entry entry;
+        entry.mapKey = MakeMapKey(player->GetMapId(), player->GetInstanceId());
+        entry.zoneId = player->GetZoneId();
+        entry.team = player->GetTeamId();
+        entry.gmCandidate = it->second->GetSecurity() > SEC_PLAYER;
+        Insert(player, entry);
+    }
+}
+
+bool ElunaPlayerIndex::IsGM(Player const* player)
+{
+#ifndef TRINITY
+    return player->isGameMaster();
+#else
+    return player->IsGameMaster();
+#endif
+}
+
+void ElunaPlayerIndex::Insert(Player* player, Entry const& entry)
+{
+    entries[player] = entry;
+    if (entry.team < 2)
+        teams[entry.team].insert(player);
+    if (entry.gmCandidate)
+        gmCandidates.insert(player);
+    maps[entry.mapKey].insert(player);
+    zones[entry.zoneId].insert(player);
+}
+
+void ElunaPlayerIndex::Erase(Player* player, Entry const& entry)
+{
+    if (entry.team < 2)
+        teams[entry.team].erase(player);
+    gmCandidates.erase(player);
+
+    KeyIndex::iterator it = maps.find(entry.mapKey);
+    if (it != maps.end())
+    {
+        it->second.erase(player);
+        if (it->second.empty())
+            maps.erase(it);
+    }
+    it = zones.find(entry.zoneId);
+    if (it != zones.end())
+    {
+        it->second.erase(player);
+        if (it->second.empty())
+            zones.erase(it);
+    }
+}
+
+void ElunaPlayerIndex::Add(Player* player)
+{
+    if (!player->GetSession())
+        return;
+
+    Entry entry;
+    entry.mapKey = MakeMapKey(player->GetMapId(), player->GetInstanceId());
+    entry.zoneId = player->GetZoneId();
+    entry.team = player->GetTeamId();
+    entry.gmCandidate = player->GetSession()->GetSecurity() > SEC_PLAYER;
+
+    WriteGuard guard(GetLock());
+    EntryMap::iterator it = entries.find(player);
+    if (it != entries.end())
+        Erase(player, it->second);
+    Insert(player, entry);
+}
+
+void ElunaPlayerIndex::Remove(Player* player)
+{
+    WriteGuard guard(GetLock());
+    EntryMap::iterator it = entries.find(player);
+    if (it == entries.end())
+        return;
+
+    Erase(player, it->second);
+    entries.erase(it);
+}
+
+void ElunaPlayerIndex::UpdateMap(Player* player, uint32 mapId, uint32 instanceId)
+{
+    uint64 mapKey = MakeMapKey(mapId, instanceId);
+
+    WriteGuard guard(GetLock());
+    EntryMap::iterator it = entries.find(player);
+    if (it == entries.end() || it->second.mapKey == mapKey)
+        return;
+
+    KeyIndex::iterator old = maps.find(it->second.mapKey);
+    if (old != maps.end())
+    {
+        old->second.erase(player);
+        if (old->second.empty())
+            maps.erase(old);
+    }
+    it->second.mapKey = mapKey;
+    maps[mapKey].insert(player);
+}
+
+void ElunaPlayerIndex::UpdateZone(Player* player, uint32 zoneId)
+{
+    WriteGuard guard(GetLock());
+    EntryMap::iterator it = entries.find(player);
+    if (it == entries.end() || it->second.zoneId == zoneId)
+        return;
+
+    KeyIndex::iterator old = zones.find(it->second.zoneId);
+    if (old != zones.end())
+    {
+        old->second.erase(player);
+        if (old->second.empty())
+            zones.erase(old);
+    }
+    it->second.zoneId = zoneId;
+    zones[zoneId].insert(player);
+}
+
+uint32 ElunaPlayerIndex::CountTeam(PlayerSet const& set, uint32 team) const
+{
+    if (team >= 2)
+        return set.size();
+
+    uint32 count = 0;
+    for (PlayerSet::const_iterator it = set.begin(); it != set.end(); ++it)
+    {
+        EntryMap::const_iterator entry = entries.find(*it);
+        if (entry != entries.end() && entry->second.team == team)
+            ++count;
+    }
+    return count;
+}
+
+void ElunaPlayerIndex::CollectTeam(std::vector<Player*>& players, PlayerSet const& set, uint32 team) const
+{
+    for (PlayerSet::const_iterator it = set.begin(); it != set.end(); ++it)
+    {
+        if (team < 2)
+        {
+            EntryMap::const_iterator entry = entries.find(*it);
+            if (entry == entries.end() || entry->second.team != team)
+                continue;
+        }
+        players.push_back(*it);
+    }
+}
+
+uint32 ElunaPlayerIndex::Count(uint32 team, bool onlyGM)
+{
+    ReadGuard guard(GetLock());
+    if (!onlyGM)
+        return team < 2 ? teams[team].size() : entries.size();
+
+    uint32 count = 0;
+    for (PlayerSet::const_iterator it = gmCandidates.begin(); it != gmCandidates.end(); ++it)
+    {
+        if (!IsGM(*it))
+            continue;
+        if (team < 2 && !teams[team].count(*it))
+            continue;
+        ++count;
+    }
+    return count;
+}
+
+uint32 ElunaPlayerIndex::CountInMap(uint32 mapId, uint32 instanceId, uint32 team)
+{
+    ReadGuard guard(GetLock());
+    KeyIndex::const_iterator it = maps.find(MakeMapKey(mapId, instanceId));
+    if (it == maps.end())
+        return 0;
+    return CountTeam(it->second, team);
+}
+
+uint32 ElunaPlayerIndex::CountInZone(uint32 zoneId, uint32 team)
+{
+    ReadGuard guard(GetLock());
+    KeyIndex::const_iterator it = zones.find(zoneId);
+    if (it == zones.end())
+        return 0;
+    return CountTeam(it->second, team);
+}
+
+void ElunaPlayerIndex::GetPlayers(std::vector<Player*>& players, uint32 team, bool onlyGM)
+{
+    ReadGuard guard(GetLock());
+    if (!onlyGM)
+    {
+        if (team < 2)
+            players.insert(players.end(), teams[team].begin(), teams[team].end());
+        else
+        {
+            players.reserve(players.size() + entries.size());
+            for (EntryMap::const_iterator it = entries.begin(); it != entries.end(); ++it)
+                players.push_back(it->first);
+        }
+        return;
+    }
+
+    for (PlayerSet::const_iterator it = gmCandidates.begin(); it != gmCandidates.end(); ++it)
+    {
+        if (!IsGM(*it))
+            continue;
+        if (team < 2 && !teams[team].count(*it))
+            continue;
+        players.push_back(*it);
+    }
+}
+
+void ElunaPlayerIndex::GetPlayersInMap(std::vector<Player*>& players, uint32 mapId, uint32 instanceId, uint32 team)
+{
+    ReadGuard guard(GetLock());
+    KeyIndex::const_iterator it = maps.find(MakeMapKey(mapId, instanceId));
+    if (it != maps.end())
+        CollectTeam(players, it->second, team);
+}
+
+void ElunaPlayerIndex::GetPlayersInZone(std::vector<Player*>& players, uint32 zoneId, uint32 team)
+{
+    ReadGuard guard(GetLock());
+    KeyIndex::const_iterator it = zones.find(zoneId);
+    if (it != zones.end())
+        CollectTeam(players, it->second, team);
+}
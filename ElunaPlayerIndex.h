@@ -0,0 +1,79 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_PLAYER_INDEX_H
+#define _ELUNA_PLAYER_INDEX_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+#include <set>
+
+class Player;
+
+/*
+ * Online players indexed by team, map instance and zone.
+ *
+ * The index is kept up to date from the login, logout, map and zone hooks
+ * so lookups never need to walk all sessions.
+ * Game master mode can be toggled without a hook, so only the players whose
+ * account could be a game master are indexed and their mode is checked on lookup.
+ * Hooks can be called from map threads, all access is guarded by the index lock.
+ */
+class ElunaPlayerIndex : public ElunaUtil::RWLockable
+{
+public:
+    typedef std::set<Player*> PlayerSet;
+
+    ElunaPlayerIndex();
+    ~ElunaPlayerIndex();
+
+    // Indexes all players that are currently in the world
+    void Rebuild();
+
+    // Adds the player or updates its map, uses the current map, zone and team of the player
+    void Add(Player* player);
+    void Remove(Player* player);
+    // Only updates players that are already indexed
+    void UpdateMap(Player* player, uint32 mapId, uint32 instanceId);
+    void UpdateZone(Player* player, uint32 zoneId);
+
+    // team TEAM_NEUTRAL matches all players
+    uint32 Count(uint32 team, bool onlyGM);
+    uint32 CountInMap(uint32 mapId, uint32 instanceId, uint32 team);
+    uint32 CountInZone(uint32 zoneId, uint32 team);
+
+    // Appends matching players to players, they can be used until the calling hook or function returns
+    void GetPlayers(std::vector<Player*>& players, uint32 team, bool onlyGM);
+    void GetPlayersInMap(std::vector<Player*>& players, uint32 mapId, uint32 instanceId, uint32 team);
+    void GetPlayersInZone(std::vector<Player*>& players, uint32 zoneId, uint32 team);
+
+private:
+    struct Entry
+    {
+        uint64 mapKey;
+        uint32 zoneId;
+        uint32 team;
+        bool gmCandidate;
+    };
+    typedef UNORDERED_MAP<Player*, Entry> EntryMap;
+    typedef UNORDERED_MAP<uint64, PlayerSet> KeyIndex;
+
+    static uint64 MakeMapKey(uint32 mapId, uint32 instanceId) { return (uint64(mapId) << 32) | instanceId; }
+    static bool IsGM(Player const* player);
+
+    void Insert(Player* player, Entry const& entry);
+    void Erase(Player* player, Entry const& entry);
+    uint32 CountTeam(PlayerSet const& set, uint32 team) const;
+    void CollectTeam(std::vector<Player*>& players, PlayerSet const& set, uint32 team) const;
+
+    EntryMap entries;
+    PlayerSet teams[2];         // alliance and horde
+    PlayerSet gmCandidates;
+    KeyIndex maps;
+    KeyIndex zones;
+};
+
+#endif
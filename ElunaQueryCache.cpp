@@ -0,0 +1,253 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaQueryCache.h"
+
+#ifndef TRINITY
+#define RESULT  result
+#else
+#define RESULT  (*result)
+#endif
+
+ElunaQueryCache::ElunaQueryCache(uint32 defaultTTL, uint32 maxEntries, size_t maxMemory) :
+memory(0), useCounter(0), defaultTTL(defaultTTL), maxEntries(maxEntries), maxMemory(maxMemory),
+hits(0), misses(0), evictions(0)
+{
+}
+
+ElunaQueryCache::~ElunaQueryCache()
+{
+    Clear();
+}
+
+ElunaCachedResultPtr ElunaQueryCache::Get(std::string const& key)
+{
+    ReadGuard guard(GetLock());
+
+    EntryMap::iterator itr = entries.find(key);
+    if (itr == entries.end() || ElunaUtil::GetTimeDiff(itr->second.storeTime) >= itr->second.ttl)
+    {
+        ++misses;
+        return ElunaCachedResultPtr();
+    }
+
+    // Shrink moves the entry to the front of the LRU list
+    itr->second.lastUse = ++useCounter;
+    ++hits;
+    return itr->second.result;
+}
+
+void ElunaQueryCache::Store(std::string const& key, ElunaCachedResultPtr const& result, uint32 ttl)
+{
+    if (!result)
+        return;
+
+    size_t size = result->memory + key.size() * 2 + sizeof(Entry);
+
+    WriteGuard guard(GetLock());
+
+    // Also drops an expired entry that the new result doesn't replace
+    EntryMap::iterator itr = entries.find(key);
+    if (itr != entries.end())
+        Remove(itr);
+
+    if (!maxEntries || size > maxMemory)
+        return;
+
+    lru.push_front(key);
+
+    Entry& entry = entries[key];
+    entry.result = result;
+    entry.storeTime = ElunaUtil::GetCurrTime();
+    entry.ttl = ttl ? ttl : defaultTTL;
+    entry.memory = size;
+    entry.lruPos = lru.begin();
+    entry.lruUse = entry.lastUse = ++useCounter;
+    memory += size;
+
+    Shrink();
+}
+
+bool ElunaQueryCache::Invalidate(std::string const& key)
+{
+    WriteGuard guard(GetLock());
+
+    EntryMap::iterator itr = entries.find(key);
+    if (itr == entries.end())
+        return false;
+
+    Remove(itr);
+    return true;
+}
+
+void ElunaQueryCache::Clear()
+{
+    WriteGuard guard(GetLock());
+
+    entries.clear();
+    lru.clear();
+    memory = 0;
+}
+
+uint32 ElunaQueryCache::GetEntryCount()
+{
+    ReadGuard guard(GetLock());
+    return entries.size();
+}
+
+size_t ElunaQueryCache::GetMemory()
+{
+    ReadGuard guard(GetLock());
+    return memory;
+}
+
+void ElunaQueryCache::Remove(EntryMap::iterator itr)
+{
+    memory -= itr->second.memory;
+    lru.erase(itr->second.lruPos);
+    entries.erase(itr);
+}
+
+void ElunaQueryCache::Shrink()
+{
+    while (!lru.empty() && (entries.size() > maxEntries || memory > maxMemory))
+    {
+        EntryMap::iterator itr = entries.find(lru.back());
+        ASSERT(itr != entries.end());
+
+        // Used since it was put at its position, give it another round at the front
+        uint64 lastUse = itr->second.lastUse;
+        if (lastUse != itr->second.lruUse)
+        {
+            itr->second.lruUse = lastUse;
+            lru.splice(lru.begin(), lru, itr->second.lruPos);
+            continue;
+        }
+
+        Remove(itr);
+        ++evictions;
+    }
+}
+
+std::string ElunaQueryCache::Normalize(const char* sql)
+{
+    std::string normalized;
+    normalized.reserve(strlen(sql));
+
+    char quote = 0;
+    bool space = false;
+    for (const char* c = sql; *c; ++c)
+    {
+        if (quote)
+        {
+            normalized += *c;
+            if (*c == '\\' && *(c + 1))
+                normalized += *++c;
+            else if (*c == quote)
+                quote = 0;
+            continue;
+        }
+
+        if (isspace(static_cast<unsigned char>(*c)))
+        {
+            space = !normalized.empty();
+            continue;
+        }
+
+        if (space)
+        {
+            normalized += ' ';
+            space = false;
+        }
+
+        if (*c == '\'' || *c == '"' || *c == '`')
+            quote = *c;
+        normalized += *c;
+    }
+
+    while (!normalized.empty() && normalized[normalized.size() - 1] == ';')
+    {
+        normalized.erase(normalized.size() - 1);
+        while (!normalized.empty() && normalized[normalized.size() - 1] == ' ')
+            normalized.erase(normalized.size() - 1);
+    }
+    return normalized;
+}
+
+ElunaCachedResultPtr ElunaQueryCache::Snapshot(ElunaQuery* result)
+{
+    ElunaCachedResult* snapshot = new ElunaCachedResult();
+    ElunaCachedResultPtr ptr(snapshot);
+
+#ifdef TRINITY
+    if (!result || !*result)
+        return ptr;
+#else
+    if (!result)
+        return ptr;
+#endif
+
+    snapshot->columns = RESULT->GetFieldCount();
+    snapshot->names.reserve(snapshot->columns);
+    snapshot->numeric.reserve(snapshot->columns);
+    snapshot->values.reserve(snapshot->columns * uint32(RESULT->GetRowCount()));
+    snapshot->nulls.reserve(snapshot->columns * uint32(RESULT->GetRowCount()));
+
+#ifndef TRINITY
+    const QueryFieldNames& names = RESULT->GetFieldNames();
+#endif
+
+    Field* row = RESULT->Fetch();
+    for (uint32 i = 0; i < snapshot->columns; ++i)
+    {
+#ifdef TRINITY
+        snapshot->names.push_back(RESULT->GetFieldName(i));
+#else
+        snapshot->names.push_back(names[i]);
+#endif
+        snapshot->memory += sizeof(std::string) + snapshot->names.back().capacity();
+
+        // MYSQL_TYPE_LONGLONG Interpreted as string for lua
+        switch (row[i].GetType())
+        {
+            case MYSQL_TYPE_TINY:
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_FLOAT:
+            case MYSQL_TYPE_DOUBLE:
+                snapshot->numeric.push_back(true);
+                break;
+            default:
+                snapshot->numeric.push_back(false);
+                break;
+        }
+    }
+
+    do
+    {
+        row = RESULT->Fetch();
+        for (uint32 i = 0; i < snapshot->columns; ++i)
+        {
+#ifdef TRINITY
+            const char* str = row[i].GetCString();
+            bool isNull = row[i].IsNull() || !str;
+#else
+            const char* str = row[i].GetString();
+            bool isNull = row[i].IsNULL() || !str;
+#endif
+            snapshot->values.push_back(isNull ? std::string() : std::string(str));
+            snapshot->nulls.push_back(isNull);
+            snapshot->memory += sizeof(std::string) + snapshot->values.back().capacity();
+        }
+        ++snapshot->rows;
+    } while (RESULT->NextRow());
+
+    snapshot->memory += sizeof(ElunaCachedResult) + snapshot->nulls.size() / 8;
+    return ptr;
+}
+
+#undef RESULT
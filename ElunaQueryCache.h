@@ -0,0 +1,111 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_QUERY_CACHE_H
+#define _ELUNA_QUERY_CACHE_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+#include <memory>
+#include <atomic>
+
+/*
+ * Immutable snapshot of a query result.
+ * Values are stored row by row as strings, the same way the DB layer delivers them.
+ */
+struct ElunaCachedResult
+{
+    ElunaCachedResult() : columns(0), rows(0), memory(0) { }
+
+    std::vector<std::string> names;     // column names
+    std::vector<bool> numeric;          // column holds a numeric MYSQL type
+    std::vector<std::string> values;    // values[row * columns + column]
+    std::vector<bool> nulls;            // nulls[row * columns + column]
+    uint32 columns;
+    uint32 rows;
+    size_t memory;                      // approximated size in bytes
+};
+
+typedef std::shared_ptr<const ElunaCachedResult> ElunaCachedResultPtr;
+
+// Cursor handed to Lua, the snapshot itself is shared with the cache
+class ElunaCachedQuery
+{
+public:
+    ElunaCachedQuery(ElunaCachedResultPtr const& result) : result(result), row(0)
+    {
+    }
+
+    ElunaCachedResultPtr result;
+    uint32 row;
+};
+
+/*
+ * Opt-in cache for read-only world database queries.
+ *
+ * Entries are keyed by the normalized query text with its parameters bound
+ * and are evicted by TTL, by least recent use and by the memory cap.
+ * Hits only take the read lock. They stamp the entry instead of moving it in the LRU list,
+ * and eviction moves stamped entries to the front before evicting, so the order is approximate.
+ */
+class ElunaQueryCache : public ElunaUtil::RWLockable
+{
+public:
+    ElunaQueryCache(uint32 defaultTTL, uint32 maxEntries, size_t maxMemory);
+    ~ElunaQueryCache();
+
+    // Returns the cached result or an empty pointer on a miss, expired entries are replaced by the next Store. Counts hits and misses
+    ElunaCachedResultPtr Get(std::string const& key);
+    // Caches the result for ttl milliseconds, 0 uses the default TTL
+    void Store(std::string const& key, ElunaCachedResultPtr const& result, uint32 ttl = 0);
+    // Removes a single entry, returns true if it existed
+    bool Invalidate(std::string const& key);
+    // Removes all entries
+    void Clear();
+
+    uint64 GetHits() const { return hits.load(); }
+    uint64 GetMisses() const { return misses.load(); }
+    uint64 GetEvictions() const { return evictions.load(); }
+    uint32 GetEntryCount();
+    size_t GetMemory();
+
+    // Collapses whitespace outside of quotes and strips trailing semicolons
+    static std::string Normalize(const char* sql);
+    // Copies the current and all following rows of a result, result can be NULL
+    static ElunaCachedResultPtr Snapshot(ElunaQuery* result);
+
+private:
+    typedef std::list<std::string> KeyList;
+    struct Entry
+    {
+        ElunaCachedResultPtr result;
+        uint32 storeTime;
+        uint32 ttl;
+        size_t memory;
+        KeyList::iterator lruPos;
+        std::atomic<uint64> lastUse;    // set by hits under the read lock
+        uint64 lruUse;                  // lastUse when the entry was put at lruPos
+    };
+    typedef UNORDERED_MAP<std::string, Entry> EntryMap;
+
+    void Remove(EntryMap::iterator itr);
+    void Shrink();
+
+    EntryMap entries;
+    KeyList lru; // most recently used first, entries used since then may be further back
+    size_t memory;
+    std::atomic<uint64> useCounter;
+
+    uint32 defaultTTL;
+    uint32 maxEntries;
+    size_t maxMemory;
+
+    std::atomic<uint64> hits;
+    std::atomic<uint64> misses;
+    std::atomic<uint64> evictions;
+};
+
+#endif
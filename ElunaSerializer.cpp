@@ -0,0 +1,392 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaSerializer.h"
+#include "LuaEngine.h"
+#include "ElunaIncludes.h"
+#include "ElunaTemplate.h"
+#include <cmath>
+
+static const char SERIALIZER_MAGIC[3] = { 'E', 'L', 'S' };
+// Doubles beyond this can't hold every integer, they are written as is
+static const double SERIALIZER_MAX_INTEGER = 9007199254740992.0;
+
+ElunaSerializer::ElunaSerializer(lua_State* L, std::string& error) :
+L(L), error(error), out(NULL), pos(NULL), end(NULL), tableCount(0)
+{
+}
+
+bool ElunaSerializer::Fail(const char* message)
+{
+    error = message;
+    return false;
+}
+
+bool ElunaSerializer::Serialize(lua_State* L, int index, std::string& out, std::string& error)
+{
+    if (index < 0)
+        index = lua_gettop(L) + index + 1;
+
+    ElunaSerializer serializer(L, error);
+    serializer.out = &out;
+
+    // Reserve for the header and the top level value, assuming a few bytes per array element.
+    // Nested tables and the hash part still grow the string
+    size_t estimate = sizeof(SERIALIZER_MAGIC) + 1 + 16;
+    if (lua_type(L, index) == LUA_TSTRING || lua_type(L, index) == LUA_TTABLE)
+        estimate += lua_rawlen(L, index) * (lua_type(L, index) == LUA_TTABLE ? 4 : 1);
+    out.reserve(out.size() + estimate);
+
+    out.append(SERIALIZER_MAGIC, sizeof(SERIALIZER_MAGIC));
+    serializer.WriteByte(SERIALIZER_VERSION);
+    return serializer.WriteValue(index, 0);
+}
+
+void ElunaSerializer::WriteVarInt(uint64 value)
+{
+    while (value >= 0x80)
+    {
+        WriteByte(uint8(value) | 0x80);
+        value >>= 7;
+    }
+    WriteByte(uint8(value));
+}
+
+void ElunaSerializer::WriteFixed(uint64 value)
+{
+    char bytes[8];
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = char(value >> (8 * i));
+    out->append(bytes, 8);
+}
+
+bool ElunaSerializer::WriteValue(int index, uint32 depth)
+{
+    switch (lua_type(L, index))
+    {
+        case LUA_TNIL:
+            WriteByte(TAG_NIL);
+            return true;
+        case LUA_TBOOLEAN:
+            WriteByte(lua_toboolean(L, index) ? TAG_TRUE : TAG_FALSE);
+            return true;
+        case LUA_TNUMBER:
+        {
+            double number = lua_tonumber(L, index);
+            if (std::floor(number) == number && std::fabs(number) <= SERIALIZER_MAX_INTEGER)
+            {
+                int64 integer = int64(number);
+                WriteByte(TAG_INTEGER);
+                WriteVarInt((uint64(integer) << 1) ^ uint64(integer >> 63));
+            }
+            else
+            {
+                uint64 bits;
+                memcpy(&bits, &number, sizeof(bits));
+                WriteByte(TAG_DOUBLE);
+                WriteFixed(bits);
+            }
+            return true;
+        }
+        case LUA_TSTRING:
+        {
+            size_t len = 0;
+            const char* str = lua_tolstring(L, index, &len);
+            WriteByte(TAG_STRING);
+            WriteVarInt(len);
+            out->append(str, len);
+            return true;
+        }
+        case LUA_TTABLE:
+            return WriteTable(index, depth);
+        case LUA_TUSERDATA:
+        {
+            if (unsigned long long* value = ElunaTemplate<unsigned long long>::Check(L, index, false))
+            {
+                WriteByte(TAG_UINT64);
+                WriteFixed(*value);
+                return true;
+            }
+            if (long long* value = ElunaTemplate<long long>::Check(L, index, false))
+            {
+                WriteByte(TAG_INT64);
+                WriteFixed(uint64(*value));
+                return true;
+            }
+            if (Object* obj = Eluna::CHECKOBJ<Object>(L, index, false))
+            {
+                uint64 guid = obj->GET_GUID();
+                WriteByte(TAG_GUID);
+                WriteFixed(guid);
+                return true;
+            }
+            return Fail("can't serialize userdata other than uint64, int64 and game objects");
+        }
+        default:
+            error = std::string("can't serialize a ") + luaL_typename(L, index);
+            return false;
+    }
+}
+
+bool ElunaSerializer::WriteTable(int index, uint32 depth)
+{
+    const void* ptr = lua_topointer(L, index);
+    TableMap::const_iterator it = tables.find(ptr);
+    if (it != tables.end())
+    {
+        WriteByte(TAG_REFERENCE);
+        WriteVarInt(it->second);
+        return true;
+    }
+
+    if (depth >= SERIALIZER_MAX_DEPTH)
+        return Fail("tables nested too deep");
+    if (!lua_checkstack(L, 4))
+        return Fail("stack overflow");
+
+    uint32 tableIndex = tables.size();
+    tables[ptr] = tableIndex;
+
+    // Count the array part first so it can be written without keys
+    uint32 arrayLength = 0;
+    for (;; ++arrayLength)
+    {
+        lua_rawgeti(L, index, arrayLength + 1);
+        bool isNil = lua_isnil(L, -1);
+        lua_pop(L, 1);
+        if (isNil)
+            break;
+    }
+
+    WriteByte(TAG_TABLE);
+    WriteVarInt(arrayLength);
+    for (uint32 i = 1; i <= arrayLength; ++i)
+    {
+        lua_rawgeti(L, index, i);
+        bool written = WriteValue(lua_gettop(L), depth + 1);
+        lua_pop(L, 1);
+        if (!written)
+            return false;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, index))
+    {
+        int value = lua_gettop(L);
+        int key = value - 1;
+
+        if (lua_type(L, key) == LUA_TNUMBER)
+        {
+            double number = lua_tonumber(L, key);
+            if (number >= 1 && number <= arrayLength && std::floor(number) == number)
+            {
+                lua_pop(L, 1);
+                continue;
+            }
+        }
+
+        if (!WriteValue(key, depth + 1) || !WriteValue(value, depth + 1))
+        {
+            lua_pop(L, 2);
+            return false;
+        }
+        lua_pop(L, 1);
+    }
+
+    // Keys can't be nil, so nil ends the hash part
+    WriteByte(TAG_NIL);
+    return true;
+}
+
+bool ElunaSerializer::Deserialize(lua_State* L, const char* data, size_t size, std::string& error)
+{
+    ElunaSerializer serializer(L, error);
+    serializer.pos = data;
+    serializer.end = data + size;
+
+    if (size < sizeof(SERIALIZER_MAGIC) + 1 || memcmp(data, SERIALIZER_MAGIC, sizeof(SERIALIZER_MAGIC)) != 0)
+        return serializer.Fail("not a serialized value");
+    serializer.pos += sizeof(SERIALIZER_MAGIC);
+
+    uint8 version = 0;
+    serializer.ReadByte(version);
+    if (version != SERIALIZER_VERSION)
+        return serializer.Fail("unsupported serializer version");
+
+    // Tables read so far, by index, for references
+    lua_newtable(L);
+    int refs = lua_gettop(L);
+
+    bool ok = serializer.ReadValue(refs, 0);
+    if (ok && serializer.pos != serializer.end)
+        ok = serializer.Fail("trailing data after the serialized value");
+
+    if (ok)
+        lua_replace(L, refs);
+    else
+        lua_settop(L, refs - 1);
+    return ok;
+}
+
+bool ElunaSerializer::ReadByte(uint8& value)
+{
+    if (pos >= end)
+        return Fail("unexpected end of data");
+    value = uint8(*pos++);
+    return true;
+}
+
+bool ElunaSerializer::ReadVarInt(uint64& value)
+{
+    value = 0;
+    for (uint32 shift = 0; shift < 64; shift += 7)
+    {
+        uint8 byte;
+        if (!ReadByte(byte))
+            return false;
+        value |= uint64(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return Fail("malformed integer");
+}
+
+bool ElunaSerializer::ReadFixed(uint64& value)
+{
+    if (end - pos < 8)
+        return Fail("unexpected end of data");
+
+    value = 0;
+    for (int i = 0; i < 8; ++i)
+        value |= uint64(uint8(pos[i])) << (8 * i);
+    pos += 8;
+    return true;
+}
+
+bool ElunaSerializer::ReadValue(int refs, uint32 depth)
+{
+    uint8 tag;
+    if (!ReadByte(tag))
+        return false;
+    if (!lua_checkstack(L, 4))
+        return Fail("stack overflow");
+
+    switch (tag)
+    {
+        case TAG_NIL:
+            lua_pushnil(L);
+            return true;
+        case TAG_FALSE:
+        case TAG_TRUE:
+            lua_pushboolean(L, tag == TAG_TRUE);
+            return true;
+        case TAG_DOUBLE:
+        {
+            uint64 bits;
+            if (!ReadFixed(bits))
+                return false;
+            double number;
+            memcpy(&number, &bits, sizeof(number));
+            lua_pushnumber(L, number);
+            return true;
+        }
+        case TAG_INTEGER:
+        {
+            uint64 zigzag;
+            if (!ReadVarInt(zigzag))
+                return false;
+            int64 integer = int64(zigzag >> 1) ^ -int64(zigzag & 1);
+            lua_pushnumber(L, double(integer));
+            return true;
+        }
+        case TAG_STRING:
+        {
+            uint64 len;
+            if (!ReadVarInt(len))
+                return false;
+            if (uint64(end - pos) < len)
+                return Fail("unexpected end of data");
+            lua_pushlstring(L, pos, size_t(len));
+            pos += len;
+            return true;
+        }
+        case TAG_TABLE:
+            return ReadTable(refs, depth);
+        case TAG_REFERENCE:
+        {
+            uint64 index;
+            if (!ReadVarInt(index))
+                return false;
+            if (index >= tableCount)
+                return Fail("invalid table reference");
+            lua_rawgeti(L, refs, int(index) + 1);
+            return true;
+        }
+        case TAG_UINT64:
+        case TAG_GUID:
+        {
+            uint64 value;
+            if (!ReadFixed(value))
+                return false;
+            Eluna::Push(L, value);
+            return true;
+        }
+        case TAG_INT64:
+        {
+            uint64 value;
+            if (!ReadFixed(value))
+                return false;
+            Eluna::Push(L, int64(value));
+            return true;
+        }
+        default:
+            return Fail("unknown value tag");
+    }
+}
+
+bool ElunaSerializer::ReadTable(int refs, uint32 depth)
+{
+    if (depth >= SERIALIZER_MAX_DEPTH)
+        return Fail("tables nested too deep");
+
+    uint64 arrayLength;
+    if (!ReadVarInt(arrayLength))
+        return false;
+    // Every value takes at least one byte
+    if (uint64(end - pos) < arrayLength)
+        return Fail("unexpected end of data");
+
+    lua_createtable(L, int(arrayLength), 0);
+    int table = lua_gettop(L);
+
+    // Registered before reading the contents so cycles can refer to it
+    lua_pushvalue(L, table);
+    lua_rawseti(L, refs, ++tableCount);
+
+    for (uint64 i = 1; i <= arrayLength; ++i)
+    {
+        if (!ReadValue(refs, depth + 1))
+            return false;
+        lua_rawseti(L, table, int(i));
+    }
+
+    for (;;)
+    {
+        if (pos < end && uint8(*pos) == TAG_NIL)
+        {
+            ++pos;
+            return true;
+        }
+
+        if (!ReadValue(refs, depth + 1))
+            return false;
+        if (lua_type(L, -1) == LUA_TNUMBER && lua_tonumber(L, -1) != lua_tonumber(L, -1))
+            return Fail("invalid table key");
+        if (!ReadValue(refs, depth + 1))
+            return false;
+        lua_rawset(L, table);
+    }
+}
@@ -0,0 +1,88 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_SERIALIZER_H
+#define _ELUNA_SERIALIZER_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+
+extern "C"
+{
+#include "lua.h"
+};
+
+#define SERIALIZER_VERSION      1
+// Maximum depth of nested tables, shared and cyclic tables are written as references and don't count
+#define SERIALIZER_MAX_DEPTH    128
+
+/*
+ * Binary serialization of Lua values.
+ *
+ * Supports nil, booleans, numbers, strings, tables, uint64 and int64 values
+ * and game objects, which are written as their GUID and read back as uint64 GUIDs.
+ * Tables that appear more than once, including cycles, are written once and referenced after that.
+ * Integral numbers are written as variable length integers, strings and tables carry their length.
+ *
+ * The blob starts with a magic and a version byte. Numbers are stored little endian.
+ * Errors are reported through the return value and never raise Lua errors,
+ * so the caller can free its buffers before raising one.
+ */
+class ElunaSerializer
+{
+public:
+    // Appends the value at index to out
+    static bool Serialize(lua_State* L, int index, std::string& out, std::string& error);
+    // Pushes the value stored in data, pushes nothing on failure
+    static bool Deserialize(lua_State* L, const char* data, size_t size, std::string& error);
+
+private:
+    enum Tag
+    {
+        TAG_NIL,
+        TAG_FALSE,
+        TAG_TRUE,
+        TAG_DOUBLE,         // 8 bytes
+        TAG_INTEGER,        // zigzag varint
+        TAG_STRING,         // varint length, bytes
+        TAG_TABLE,          // varint array length, array values, key value pairs, TAG_NIL
+        TAG_REFERENCE,      // varint index of a table written before
+        TAG_UINT64,         // 8 bytes
+        TAG_INT64,          // 8 bytes
+        TAG_GUID            // 8 bytes
+    };
+
+    typedef UNORDERED_MAP<const void*, uint32> TableMap;
+
+    ElunaSerializer(lua_State* L, std::string& error);
+
+    // Writing
+    bool WriteValue(int index, uint32 depth);
+    bool WriteTable(int index, uint32 depth);
+    void WriteByte(uint8 value) { out->push_back(char(value)); }
+    void WriteVarInt(uint64 value);
+    void WriteFixed(uint64 value);
+
+    // Reading
+    bool ReadValue(int refs, uint32 depth);
+    bool ReadTable(int refs, uint32 depth);
+    bool ReadByte(uint8& value);
+    bool ReadVarInt(uint64& value);
+    bool ReadFixed(uint64& value);
+    bool Fail(const char* message);
+
+    lua_State* L;
+    std::string& error;
+
+    std::string* out;
+    TableMap tables;
+
+    const char* pos;
+    const char* end;
+    uint32 tableCount;
+};
+
+#endif
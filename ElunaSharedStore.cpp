@@ -0,0 +1,106 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#include "ElunaSharedStore.h"
+
+bool ElunaSharedStore::Value::operator==(Value const& other) const
+{
+    if (type != other.type)
+        return false;
+    switch (type)
+    {
+        case VALUE_NUMBER:
+            return number == other.number;
+        case VALUE_STRING:
+            return str == other.str || *str == *other.str;
+        default:
+            return true;
+    }
+}
+
+ElunaSharedStore& ElunaSharedStore::Instance()
+{
+    static ElunaSharedStore instance;
+    return instance;
+}
+
+ElunaSharedStore::Shard& ElunaSharedStore::GetShard(std::string const& key)
+{
+    return shards[std::hash<std::string>()(key) & (SHARED_STORE_SHARDS - 1)];
+}
+
+ElunaSharedStore::Value ElunaSharedStore::Get(std::string const& key)
+{
+    Shard& shard = GetShard(key);
+    ElunaUtil::RWLockable::ReadGuard guard(shard.GetLock());
+
+    ValueMap::const_iterator it = shard.values.find(key);
+    if (it == shard.values.end())
+        return Value();
+    return it->second;
+}
+
+void ElunaSharedStore::Set(std::string const& key, Value const& value)
+{
+    Shard& shard = GetShard(key);
+    ElunaUtil::RWLockable::WriteGuard guard(shard.GetLock());
+
+    if (value.type == Value::VALUE_NIL)
+        shard.values.erase(key);
+    else
+        shard.values[key] = value;
+}
+
+bool ElunaSharedStore::CompareAndSwap(std::string const& key, Value const& expected, Value const& desired)
+{
+    Shard& shard = GetShard(key);
+    ElunaUtil::RWLockable::WriteGuard guard(shard.GetLock());
+
+    ValueMap::iterator it = shard.values.find(key);
+    if (it == shard.values.end())
+    {
+        if (expected.type != Value::VALUE_NIL)
+            return false;
+        if (desired.type != Value::VALUE_NIL)
+            shard.values[key] = desired;
+        return true;
+    }
+
+    if (!(it->second == expected))
+        return false;
+
+    if (desired.type == Value::VALUE_NIL)
+        shard.values.erase(it);
+    else
+        it->second = desired;
+    return true;
+}
+
+bool ElunaSharedStore::Increment(std::string const& key, double delta, double& result)
+{
+    Shard& shard = GetShard(key);
+    ElunaUtil::RWLockable::WriteGuard guard(shard.GetLock());
+
+    Value& value = shard.values[key];
+    if (value.type == Value::VALUE_STRING)
+        return false;
+
+    value.type = Value::VALUE_NUMBER;
+    value.number += delta;
+    result = value.number;
+    return true;
+}
+
+uint32 ElunaSharedStore::GetSize()
+{
+    uint32 size = 0;
+    for (uint32 i = 0; i < SHARED_STORE_SHARDS; ++i)
+    {
+        ElunaUtil::RWLockable::ReadGuard guard(shards[i].GetLock());
+        size += shards[i].values.size();
+    }
+    return size;
+}
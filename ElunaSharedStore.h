@@ -0,0 +1,77 @@
+/*
+* Copyright (C) 2010 - 2015 Eluna Lua Engine <http://emudevs.com/>
+* This program is free software licensed under GPL version 3
+* Please see the included DOCS/LICENSE.md for more information
+*/
+
+#ifndef _ELUNA_SHARED_STORE_H
+#define _ELUNA_SHARED_STORE_H
+
+#include "Common.h"
+#include "ElunaUtility.h"
+#include <memory>
+
+// Amount of independently locked shards, must be a power of two
+#define SHARED_STORE_SHARDS 16
+
+/*
+ * Process wide key value store shared by all Eluna states.
+ *
+ * Values are numbers or immutable strings, which can also hold binary blobs.
+ * Keys are spread over shards that each have their own lock, so states
+ * working on different keys rarely wait for each other.
+ * The store is not tied to a Lua state and keeps its values over reloads.
+ */
+class ElunaSharedStore
+{
+public:
+    struct Value
+    {
+        enum Type
+        {
+            VALUE_NIL,
+            VALUE_NUMBER,
+            VALUE_STRING
+        };
+
+        Value() : type(VALUE_NIL), number(0.0) { }
+        explicit Value(double number) : type(VALUE_NUMBER), number(number) { }
+        explicit Value(std::string const& str) : type(VALUE_STRING), number(0.0), str(new std::string(str)) { }
+
+        bool operator==(Value const& other) const;
+
+        Type type;
+        double number;
+        std::shared_ptr<const std::string> str;
+    };
+
+    static ElunaSharedStore& Instance();
+
+    // Returns a nil value if the key isn't set
+    Value Get(std::string const& key);
+    // Setting a nil value removes the key
+    void Set(std::string const& key, Value const& value);
+    // Sets the key to desired if its current value equals expected, a nil expected value requires the key to be unset
+    bool CompareAndSwap(std::string const& key, Value const& expected, Value const& desired);
+    // Adds delta to a number, an unset key counts as 0. Returns false if the key holds a string
+    bool Increment(std::string const& key, double delta, double& result);
+    uint32 GetSize();
+
+private:
+    typedef UNORDERED_MAP<std::string, Value> ValueMap;
+
+    struct Shard : public ElunaUtil::RWLockable
+    {
+        ValueMap values;
+    };
+
+    ElunaSharedStore() { }
+    ElunaSharedStore(ElunaSharedStore const&);
+    ElunaSharedStore& operator=(ElunaSharedStore const&);
+
+    Shard& GetShard(std::string const& key);
+
+    Shard shards[SHARED_STORE_SHARDS];
+};
+
+#endif
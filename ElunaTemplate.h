@@ -66,7 +66,7 @@ public:
 class ElunaObject
 {
 public:
-    ElunaObject(void* obj, bool manageMemory) : _isvalid(false), _invalidate(!manageMemory), object(obj)
+    ElunaObject(void* obj, bool manageMemory) : _isvalid(false), _invalidate(!manageMemory), _borrowed(false), object(obj)
     {
         SetValid(true);
     }
@@ -81,6 +81,8 @@ public:
     bool IsValid() const { return _isvalid; }
     // Returns whether the object can be invalidated or not
     bool CanInvalidate() const { return _invalidate; }
+    // Returns whether the object is only borrowed from the core and must not be deleted by lua
+    bool IsBorrowed() const { return _borrowed; }
 
     // Sets the object pointer that is wrapped
     void SetObj(void* obj)
@@ -100,6 +102,11 @@ public:
     {
         _invalidate = invalidate;
     }
+    // Sets whether the object is only borrowed from the core
+    void SetBorrowed(bool borrowed)
+    {
+        _borrowed = borrowed;
+    }
     // Invalidates the pointer if it should be invalidated
     void Invalidate()
     {
@@ -110,6 +117,7 @@ public:
 private:
     bool _isvalid;
     bool _invalidate;
+    bool _borrowed;
     void* object;
 };
 
@@ -166,8 +174,9 @@ public:
         lua_pushcfunction(E->L, ToString);
         lua_setfield(E->L, metatable, "__tostring");
 
-        // garbage collecting
-        lua_pushcfunction(E->L, CollectGarbage);
+        // garbage collecting, the Eluna owning the state is the upvalue
+        lua_pushlightuserdata(E->L, E);
+        lua_pushcclosure(E->L, CollectGarbage, 1);
         lua_setfield(E->L, metatable, "__gc");
 
         // make methods accessible through metatable
@@ -420,7 +429,7 @@ public:
     {
         // Get object pointer (and check type, no error)
         ElunaObject* obj = Eluna::CHECKOBJ<ElunaObject>(L, 1, false);
-        if (obj && manageMemory)
+        if (obj && manageMemory && !obj->IsBorrowed())
             delete static_cast<T*>(obj->GetObj());
         delete obj;
         return 0;
@@ -8,6 +8,9 @@
 #include "World.h"
 #include "Object.h"
 #include "Unit.h"
+#include "Player.h"
+#include "WorldPacket.h"
+#include <algorithm>
 
 uint32 ElunaUtil::GetCurrTime()
 {
@@ -44,9 +47,72 @@ bool ElunaUtil::ObjectDistanceOrderPred::operator()(WorldObject const* pLeft, Wo
     return m_ascending ? m_refObj->GetDistanceOrder(pLeft, pRight) : !m_refObj->GetDistanceOrder(pLeft, pRight);
 }
 
+ElunaUtil::WorldObjectFilter::WorldObjectFilter() :
+    inCombat(-1), gameMaster(-1), minHealthPct(0.0f), maxHealthPct(100.0f), minLevel(0), maxLevel(0),
+    faction(0), aura(0), notAura(0), los(false)
+{
+}
+bool ElunaUtil::WorldObjectFilter::HasUnitConditions() const
+{
+    return inCombat >= 0 || gameMaster > 0 || minHealthPct > 0.0f || maxHealthPct < 100.0f ||
+        minLevel || maxLevel || faction || aura;
+}
+bool ElunaUtil::WorldObjectFilter::operator()(WorldObject const* searcher, WorldObject* u) const
+{
+    if (Unit* unit = u->ToUnit())
+    {
+        if (inCombat >= 0)
+        {
+#ifdef CMANGOS
+            if (unit->isInCombat() != (inCombat == 1))
+                return false;
+#else
+            if (unit->IsInCombat() != (inCombat == 1))
+                return false;
+#endif
+        }
+        if (gameMaster >= 0)
+        {
+            Player* player = unit->ToPlayer();
+#ifndef TRINITY
+            bool isGM = player && player->isGameMaster();
+#else
+            bool isGM = player && player->IsGameMaster();
+#endif
+            if (isGM != (gameMaster == 1))
+                return false;
+        }
+        if (faction && unit->getFaction() != faction)
+            return false;
+        uint32 level = unit->getLevel();
+        if (level < minLevel || (maxLevel && level > maxLevel))
+            return false;
+        if (minHealthPct > 0.0f || maxHealthPct < 100.0f)
+        {
+#ifndef TRINITY
+            float pct = unit->GetHealthPercent();
+#else
+            float pct = unit->GetHealthPct();
+#endif
+            if (pct < minHealthPct || pct > maxHealthPct)
+                return false;
+        }
+        if (aura && !unit->HasAura(aura))
+            return false;
+        if (notAura && unit->HasAura(notAura))
+            return false;
+    }
+    else if (HasUnitConditions())
+        return false;
+
+    if (los && !searcher->IsWithinLOSInMap(u))
+        return false;
+    return true;
+}
+
 ElunaUtil::WorldObjectInRangeCheck::WorldObjectInRangeCheck(bool nearest, WorldObject const* obj, float range,
-    uint16 typeMask, uint32 entry, uint32 hostile) :
-    i_obj(obj), i_hostile(hostile), i_entry(entry), i_range(range), i_typeMask(typeMask), i_nearest(nearest)
+    uint16 typeMask, uint32 entry, uint32 hostile, WorldObjectFilter const* filter) :
+    i_obj(obj), i_filter(filter), i_hostile(hostile), i_entry(entry), i_range(range), i_typeMask(typeMask), i_nearest(nearest)
 {
 }
 WorldObject const& ElunaUtil::WorldObjectInRangeCheck::GetFocusObject() const
@@ -81,7 +147,175 @@ bool ElunaUtil::WorldObjectInRangeCheck::operator()(WorldObject* u)
             }
         }
     }
+    if (i_filter && !(*i_filter)(i_obj, u))
+        return false;
     if (i_nearest)
         i_range = i_obj->GetDistance(u);
     return true;
 }
+
+ElunaUtil::WorldObjectInRangeCollector::WorldObjectInRangeCollector(WorldObjectInRangeCheck& check, std::vector<WorldObject*>* objects) :
+    i_check(check), i_objects(objects), i_count(0)
+{
+}
+WorldObject const& ElunaUtil::WorldObjectInRangeCollector::GetFocusObject() const
+{
+    return i_check.GetFocusObject();
+}
+bool ElunaUtil::WorldObjectInRangeCollector::operator()(WorldObject* u)
+{
+    if (!i_check(u))
+        return false;
+
+    ++i_count;
+    if (i_objects)
+        i_objects->push_back(u);
+    return false;
+}
+
+ElunaUtil::WorldObjectNearestCollector::WorldObjectNearestCollector(WorldObjectInRangeCheck& check, uint32 limit) :
+    i_check(check), i_limit(limit)
+{
+    i_heap.reserve(limit);
+}
+WorldObject const& ElunaUtil::WorldObjectNearestCollector::GetFocusObject() const
+{
+    return i_check.GetFocusObject();
+}
+bool ElunaUtil::WorldObjectNearestCollector::operator()(WorldObject* u)
+{
+    if (!i_limit || !i_check(u))
+        return false;
+
+    WorldObject const* focus = i_check.i_obj;
+    float dx = u->GetPositionX() - focus->GetPositionX();
+    float dy = u->GetPositionY() - focus->GetPositionY();
+    float dz = u->GetPositionZ() - focus->GetPositionZ();
+    float dist = dx * dx + dy * dy + dz * dz;
+
+    if (i_heap.size() < i_limit)
+    {
+        i_heap.push_back(DistanceEntry(dist, u));
+        std::push_heap(i_heap.begin(), i_heap.end());
+    }
+    else if (dist < i_heap.front().first)
+    {
+        std::pop_heap(i_heap.begin(), i_heap.end());
+        i_heap.back() = DistanceEntry(dist, u);
+        std::push_heap(i_heap.begin(), i_heap.end());
+    }
+    return false;
+}
+void ElunaUtil::WorldObjectNearestCollector::GetSorted(std::vector<WorldObject*>& objects)
+{
+    std::sort_heap(i_heap.begin(), i_heap.end());
+    objects.reserve(objects.size() + i_heap.size());
+    for (std::vector<DistanceEntry>::const_iterator it = i_heap.begin(); it != i_heap.end(); ++it)
+        objects.push_back(it->second);
+    i_heap.clear();
+}
+
+ElunaUtil::PlayerFilter::PlayerFilter() :
+    team(TEAM_NEUTRAL), minLevel(0), maxLevel(0), onlyGM(false)
+{
+}
+bool ElunaUtil::PlayerFilter::operator()(Player const* player) const
+{
+    if (!player->GetSession())
+        return false;
+    if (team < TEAM_NEUTRAL && player->GetTeamId() != team)
+        return false;
+#ifndef TRINITY
+    if (onlyGM && !player->isGameMaster())
+        return false;
+#else
+    if (onlyGM && !player->IsGameMaster())
+        return false;
+#endif
+    uint32 level = player->getLevel();
+    if (minLevel && level < minLevel)
+        return false;
+    if (maxLevel && level > maxLevel)
+        return false;
+    return true;
+}
+
+ElunaUtil::PacketFilter::PacketFilter() : minSize(0), security(0)
+{
+}
+bool ElunaUtil::PacketFilter::operator()(WorldPacket const& packet, Player const* player) const
+{
+    if (packet.size() < minSize)
+        return false;
+    if (security && (!player || !player->GetSession() || uint32(player->GetSession()->GetSecurity()) < security))
+        return false;
+
+    for (std::vector<Field>::const_iterator it = fields.begin(); it != fields.end(); ++it)
+    {
+        if (packet.size() < size_t(it->offset) + it->size)
+            return false;
+
+        uint64 value = 0;
+        for (uint32 i = 0; i < it->size; ++i)
+            value |= uint64(packet.contents()[it->offset + i]) << (i * 8);
+        if ((value & it->mask) != it->value)
+            return false;
+    }
+    return true;
+}
+
+ElunaUtil::MoveInLOSFilter::MoveInLOSFilter() :
+    typeMask(0), hostile(0), distance(0.0f), cooldown(0), hasFilter(false)
+{
+}
+bool ElunaUtil::MoveInLOSFilter::operator()(Unit const* me, Unit* who) const
+{
+    if (typeMask && !who->isType(TypeMask(typeMask)))
+        return false;
+    if (hostile && (hostile == 1) != me->IsHostileTo(who))
+        return false;
+    if (distance > 0.0f && !me->IsWithinDistInMap(who, distance))
+        return false;
+    if (hasFilter && !filter(me, who))
+        return false;
+    return true;
+}
+
+ElunaUtil::CooldownCache::CooldownCache(uint32 maxEntries) : maxEntries(maxEntries ? maxEntries : 1)
+{
+}
+size_t ElunaUtil::CooldownCache::KeyHash::operator()(Key const& key) const
+{
+    uint64 hash = key.first * 0x9E3779B97F4A7C15ULL;
+    hash ^= key.second + (hash << 6) + (hash >> 2);
+    return size_t(hash ^ (hash >> 32));
+}
+bool ElunaUtil::CooldownCache::Check(uint64 first, uint64 second, uint32 cooldown)
+{
+    if (!cooldown)
+        return true;
+
+    Key key(first, second);
+    WriteGuard guard(GetLock());
+
+    LRUMap::iterator itr = index.find(key);
+    if (itr != index.end())
+    {
+        // Pairs that keep hitting their cooldown are kept as recently used too
+        lru.splice(lru.begin(), lru, itr->second);
+        if (GetTimeDiff(itr->second->second) < cooldown)
+            return false;
+
+        itr->second->second = GetCurrTime();
+        return true;
+    }
+
+    if (index.size() >= maxEntries)
+    {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+    lru.push_front(std::make_pair(key, GetCurrTime()));
+    index[key] = lru.begin();
+    return true;
+}
@@ -70,8 +70,10 @@ typedef QueryNamedResult ElunaQuery;
 #define GUID_HIPART(guid)       ObjectGuid(guid).GetHigh()
 #endif
 
+class Player;
 class Unit;
 class WorldObject;
+class WorldPacket;
 
 namespace ElunaUtil
 {
@@ -99,16 +101,38 @@ namespace ElunaUtil
         const bool m_ascending;
     };
 
+    // Optional conditions for WorldObjectInRangeCheck, applied inside the grid visit.
+    // Unit conditions reject objects that aren't units. Checks are ordered from cheapest to most expensive
+    class WorldObjectFilter
+    {
+    public:
+        WorldObjectFilter();
+        bool operator()(WorldObject const* searcher, WorldObject* u) const;
+        bool HasUnitConditions() const;
+
+        int8 inCombat;          // -1 either, 0 out of combat, 1 in combat
+        int8 gameMaster;        // -1 either, 0 not a GM, 1 GM. Non players are never GMs
+        float minHealthPct;
+        float maxHealthPct;
+        uint32 minLevel;
+        uint32 maxLevel;        // 0 for no limit
+        uint32 faction;
+        uint32 aura;            // must have this aura
+        uint32 notAura;         // must not have this aura
+        bool los;               // must be in line of sight of the searcher
+    };
+
     // Doesn't get self
     class WorldObjectInRangeCheck
     {
     public:
         WorldObjectInRangeCheck(bool nearest, WorldObject const* obj, float range,
-            uint16 typeMask = 0, uint32 entry = 0, uint32 hostile = 0);
+            uint16 typeMask = 0, uint32 entry = 0, uint32 hostile = 0, WorldObjectFilter const* filter = NULL);
         WorldObject const& GetFocusObject() const;
         bool operator()(WorldObject* u);
 
         WorldObject const* i_obj;
+        WorldObjectFilter const* i_filter;
         uint32 i_hostile;
         uint32 i_entry;
         float i_range;
@@ -116,6 +140,88 @@ namespace ElunaUtil
         bool i_nearest;
     };
 
+    // Counts and optionally collects the objects accepted by a WorldObjectInRangeCheck.
+    // Always returns false, so the searcher it is used with never stores anything itself
+    class WorldObjectInRangeCollector
+    {
+    public:
+        WorldObjectInRangeCollector(WorldObjectInRangeCheck& check, std::vector<WorldObject*>* objects = NULL);
+        WorldObject const& GetFocusObject() const;
+        bool operator()(WorldObject* u);
+
+        WorldObjectInRangeCheck& i_check;
+        std::vector<WorldObject*>* i_objects;
+        uint32 i_count;
+    };
+
+    // Keeps the limit objects accepted by a WorldObjectInRangeCheck that are closest to its focus object,
+    // using a bounded max heap on the squared distance. Always returns false like WorldObjectInRangeCollector
+    class WorldObjectNearestCollector
+    {
+    public:
+        WorldObjectNearestCollector(WorldObjectInRangeCheck& check, uint32 limit);
+        WorldObject const& GetFocusObject() const;
+        bool operator()(WorldObject* u);
+        // Moves the kept objects to objects, nearest first
+        void GetSorted(std::vector<WorldObject*>& objects);
+
+        typedef std::pair<float, WorldObject*> DistanceEntry;
+
+        WorldObjectInRangeCheck& i_check;
+        std::vector<DistanceEntry> i_heap;
+        uint32 i_limit;
+    };
+
+    // Optional conditions a Player must meet to receive a broadcast packet
+    class PlayerFilter
+    {
+    public:
+        PlayerFilter();
+        bool operator()(Player const* player) const;
+
+        uint32 team;
+        uint32 minLevel;
+        uint32 maxLevel;
+        bool onlyGM;
+    };
+
+    // Optional conditions a packet must meet before its Lua handler is called
+    class PacketFilter
+    {
+    public:
+        // Little endian value of size bytes at offset, masked, must equal value
+        struct Field
+        {
+            uint32 offset;
+            uint32 size;
+            uint64 mask;
+            uint64 value;
+        };
+
+        PacketFilter();
+        bool operator()(WorldPacket const& packet, Player const* player) const;
+
+        std::vector<Field> fields;
+        uint32 minSize;
+        uint32 security;    // minimum account security, requires a player when not 0
+    };
+
+    // Optional conditions a unit must meet before CREATURE_EVENT_ON_MOVE_IN_LOS handlers are called.
+    // Checked without the Eluna lock, the cooldown is checked separately with a CooldownCache
+    class MoveInLOSFilter
+    {
+    public:
+        MoveInLOSFilter();
+        bool operator()(Unit const* me, Unit* who) const;
+
+        uint16 typeMask;        // 0 for any unit
+        uint32 hostile;         // 0 either, 1 hostile, 2 friendly
+        float distance;         // 0 for no limit besides the core's sight range
+        uint32 cooldown;        // minimum time between calls for the same creature and unit
+        bool hasFilter;
+        WorldObjectFilter filter;
+    };
+
     /*
      * Usage:
      * Inherit this class, then when needing lock, use
@@ -144,6 +250,29 @@ namespace ElunaUtil
     private:
         LockType _lock;
     };
+
+    // Cooldowns of object pairs kept in a bounded LRU. When full the least recently used pair is forgotten
+    class CooldownCache : public RWLockable
+    {
+    public:
+        CooldownCache(uint32 maxEntries);
+
+        // Returns false if the pair is on cooldown, otherwise starts its cooldown and returns true
+        bool Check(uint64 first, uint64 second, uint32 cooldown);
+
+    private:
+        typedef std::pair<uint64, uint64> Key;
+        struct KeyHash
+        {
+            size_t operator()(Key const& key) const;
+        };
+        typedef std::list<std::pair<Key, uint32> > LRUList;    // most recent first, with the time the cooldown started
+        typedef UNORDERED_MAP<Key, LRUList::iterator, KeyHash> LRUMap;
+
+        LRUList lru;
+        LRUMap index;
+        uint32 maxEntries;
+    };
 };
 
 #endif
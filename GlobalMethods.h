@@ -9,6 +9,12 @@
 
 #include "ElunaBinding.h"
 
+namespace LuaWorldObject
+{
+    // Defined in WorldObjectMethods.h
+    static ElunaUtil::WorldObjectFilter const* CheckObjectFilter(lua_State* L, int narg, ElunaUtil::WorldObjectFilter& filter);
+}
+
 /***
  * These functions can be used anywhere at any time, including at start-up.
  */
@@ -140,32 +146,24 @@ namespace LuaGlobalFunctions
      * @param bool onlyGM = false : optional check if GM only
      * @return table worldPlayers
      */
-    int GetPlayersInWorld(Eluna* /*E*/, lua_State* L)
+    int GetPlayersInWorld(Eluna* E, lua_State* L)
     {
         uint32 team = Eluna::CHECKVAL<uint32>(L, 1, TEAM_NEUTRAL);
         bool onlyGM = Eluna::CHECKVAL<bool>(L, 2, false);
 
-        lua_newtable(L);
+        std::vector<Player*> players;
+        E->playerIndex->GetPlayers(players, team, onlyGM);
+
+        lua_createtable(L, players.size(), 0);
         int tbl = lua_gettop(L);
         uint32 i = 0;
 
-        SessionMap const& sessions = eWorld->GetAllSessions();
-        for (SessionMap::const_iterator it = sessions.begin(); it != sessions.end(); ++it)
+        for (std::vector<Player*>::const_iterator it = players.begin(); it != players.end(); ++it)
         {
-            if (Player* player = it->second->GetPlayer())
-            {
-#ifndef TRINITY
-                if ((team == TEAM_NEUTRAL || player->GetTeamId() == team) && (!onlyGM || player->isGameMaster()))
-#else
-                if ((team == TEAM_NEUTRAL || player->GetTeamId() == team) && (!onlyGM || player->IsGameMaster()))
-#endif
-                {
-                    ++i;
-                    Eluna::Push(L, i);
-                    Eluna::Push(L, player);
-                    lua_settable(L, tbl);
-                }
-            }
+            ++i;
+            Eluna::Push(L, i);
+            Eluna::Push(L, *it);
+            lua_settable(L, tbl);
         }
 
         lua_settop(L, tbl); // push table to top of stack
@@ -224,6 +222,138 @@ namespace LuaGlobalFunctions
         return 1;
     }
 
+    static uint32 CallForEachPlayer(Eluna* E, lua_State* L, int funcIndex, std::vector<Player*> const& players)
+    {
+        uint32 count = 0;
+        for (std::vector<Player*>::const_iterator it = players.begin(); it != players.end(); ++it)
+        {
+            lua_pushvalue(L, funcIndex);
+            Eluna::Push(L, *it);
+            ++count;
+            if (!E->CallForEach(L, 1))
+                break;
+        }
+        return count;
+    }
+
+    /**
+     * Returns the amount of [Player]s in a [Map] instance, without building a table.
+     *
+     * @param uint32 mapId : the [Map] entry ID
+     * @param uint32 instanceId = 0 : the instance ID of the map
+     * @param [TeamId] team = TEAM_NEUTRAL : optional check team of the [Player], Alliance, Horde or Neutral (All)
+     * @return uint32 count
+     */
+    int GetPlayerCountInMap(Eluna* E, lua_State* L)
+    {
+        uint32 mapId = Eluna::CHECKVAL<uint32>(L, 1);
+        uint32 instanceId = Eluna::CHECKVAL<uint32>(L, 2, 0);
+        uint32 team = Eluna::CHECKVAL<uint32>(L, 3, TEAM_NEUTRAL);
+
+        Eluna::Push(L, E->playerIndex->CountInMap(mapId, instanceId, team));
+        return 1;
+    }
+
+    /**
+     * Returns the amount of [Player]s in a zone, without building a table.
+     *
+     * @param uint32 zoneId : the zone ID
+     * @param [TeamId] team = TEAM_NEUTRAL : optional check team of the [Player], Alliance, Horde or Neutral (All)
+     * @return uint32 count
+     */
+    int GetPlayerCountInZone(Eluna* E, lua_State* L)
+    {
+        uint32 zoneId = Eluna::CHECKVAL<uint32>(L, 1);
+        uint32 team = Eluna::CHECKVAL<uint32>(L, 2, TEAM_NEUTRAL);
+
+        Eluna::Push(L, E->playerIndex->CountInZone(zoneId, team));
+        return 1;
+    }
+
+    /**
+     * Calls a function for each online [Player], without building a table.
+     *
+     * The function is called with the [Player] as its only argument. Returning `false` from it stops the iteration.
+     * Returns the amount of [Player]s the function was called for.
+     *
+     *     ForEachPlayer(function(player)
+     *         player:SendBroadcastMessage("Server restart in 5 minutes")
+     *     end, TEAM_HORDE)
+     *
+     * @param function func : function called for each [Player]
+     * @param [TeamId] team = TEAM_NEUTRAL : optional check team of the [Player], Alliance, Horde or Neutral (All)
+     * @param bool onlyGM = false : optional check if GM only
+     * @return uint32 count
+     */
+    int ForEachPlayer(Eluna* E, lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TFUNCTION);
+        uint32 team = Eluna::CHECKVAL<uint32>(L, 2, TEAM_NEUTRAL);
+        bool onlyGM = Eluna::CHECKVAL<bool>(L, 3, false);
+
+        std::vector<Player*> players;
+        E->playerIndex->GetPlayers(players, team, onlyGM);
+
+        Eluna::Push(L, CallForEachPlayer(E, L, 1, players));
+        return 1;
+    }
+
+    /**
+     * Calls a function for each [Player] in a [Map] instance, without building a table.
+     *
+     * See [Global:ForEachPlayer] for how the function is called.
+     *
+     * The instance ID can be left out like in [Global:GetPlayerCountInMap], `ForEachPlayerInMap(mapId, func)` is the same as `ForEachPlayerInMap(mapId, 0, func)`.
+     *
+     * @param uint32 mapId : the [Map] entry ID
+     * @param uint32 instanceId = 0 : the instance ID of the map
+     * @param function func : function called for each [Player]
+     * @param [TeamId] team = TEAM_NEUTRAL : optional check team of the [Player], Alliance, Horde or Neutral (All)
+     * @return uint32 count
+     */
+    int ForEachPlayerInMap(Eluna* E, lua_State* L)
+    {
+        uint32 mapId = Eluna::CHECKVAL<uint32>(L, 1);
+        uint32 instanceId = 0;
+        int func = 2;
+        if (!lua_isfunction(L, 2))
+        {
+            instanceId = Eluna::CHECKVAL<uint32>(L, 2, 0);
+            func = 3;
+        }
+        luaL_checktype(L, func, LUA_TFUNCTION);
+        uint32 team = Eluna::CHECKVAL<uint32>(L, func + 1, TEAM_NEUTRAL);
+
+        std::vector<Player*> players;
+        E->playerIndex->GetPlayersInMap(players, mapId, instanceId, team);
+
+        Eluna::Push(L, CallForEachPlayer(E, L, func, players));
+        return 1;
+    }
+
+    /**
+     * Calls a function for each [Player] in a zone, without building a table.
+     *
+     * See [Global:ForEachPlayer] for how the function is called.
+     *
+     * @param uint32 zoneId : the zone ID
+     * @param function func : function called for each [Player]
+     * @param [TeamId] team = TEAM_NEUTRAL : optional check team of the [Player], Alliance, Horde or Neutral (All)
+     * @return uint32 count
+     */
+    int ForEachPlayerInZone(Eluna* E, lua_State* L)
+    {
+        uint32 zoneId = Eluna::CHECKVAL<uint32>(L, 1);
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        uint32 team = Eluna::CHECKVAL<uint32>(L, 3, TEAM_NEUTRAL);
+
+        std::vector<Player*> players;
+        E->playerIndex->GetPlayersInZone(players, zoneId, team);
+
+        Eluna::Push(L, CallForEachPlayer(E, L, 2, players));
+        return 1;
+    }
+
     /**
      * Returns a [Guild] by name.
      *
@@ -270,11 +400,26 @@ namespace LuaGlobalFunctions
     /**
      * Returns the amount of [Player]s in the world.
      *
+     * Without arguments this is the amount of active sessions, as before, which includes
+     * sessions whose [Player] is still loading or not in the world.
+     * With a team or onlyGM, only [Player]s in the world are counted, without building a table.
+     *
+     * @param [TeamId] team = TEAM_NEUTRAL : optional check team of the [Player], Alliance, Horde or Neutral (All)
+     * @param bool onlyGM = false : optional check if GM only
      * @return uint32 count
      */
-    int GetPlayerCount(Eluna* /*E*/, lua_State* L)
+    int GetPlayerCount(Eluna* E, lua_State* L)
     {
-        Eluna::Push(L, eWorld->GetActiveSessionCount());
+        if (lua_isnoneornil(L, 1) && lua_isnoneornil(L, 2))
+        {
+            Eluna::Push(L, eWorld->GetActiveSessionCount());
+            return 1;
+        }
+
+        uint32 team = Eluna::CHECKVAL<uint32>(L, 1, TEAM_NEUTRAL);
+        bool onlyGM = Eluna::CHECKVAL<bool>(L, 2, false);
+
+        Eluna::Push(L, E->playerIndex->Count(team, onlyGM));
         return 1;
     }
 
@@ -499,6 +644,56 @@ namespace LuaGlobalFunctions
             luaL_argerror(L, 3, "unable to make a ref to function");
     }
 
+    /*
+     * Checks the filter table at narg and fills the filter if one is given.
+     * Lua errors are raised with longjmp, so call it without a filter first to check the table
+     * while no C++ objects are alive. Filling the filter then can't raise errors.
+     */
+    static void CheckPacketFilter(lua_State* L, int narg, ElunaUtil::PacketFilter* filter)
+    {
+        luaL_checktype(L, narg, LUA_TTABLE);
+
+        lua_getfield(L, narg, "minSize");
+        uint32 minSize = Eluna::CHECKVAL<uint32>(L, lua_gettop(L), 0);
+        lua_getfield(L, narg, "security");
+        uint32 security = Eluna::CHECKVAL<uint32>(L, lua_gettop(L), 0);
+        lua_pop(L, 2);
+        if (filter)
+        {
+            filter->minSize = minSize;
+            filter->security = security;
+        }
+
+        for (int i = 1;; ++i)
+        {
+            lua_rawgeti(L, narg, i);
+            if (lua_isnil(L, -1))
+            {
+                lua_pop(L, 1);
+                break;
+            }
+            if (!lua_istable(L, -1))
+                luaL_argerror(L, narg, "field conditions must be tables");
+
+            int tbl = lua_gettop(L);
+            ElunaUtil::PacketFilter::Field field;
+            lua_getfield(L, tbl, "offset");
+            field.offset = Eluna::CHECKVAL<uint32>(L, tbl + 1);
+            lua_getfield(L, tbl, "size");
+            field.size = Eluna::CHECKVAL<uint32>(L, tbl + 2, 1);
+            if (field.size != 1 && field.size != 2 && field.size != 4 && field.size != 8)
+                luaL_argerror(L, narg, "field size must be 1, 2, 4 or 8");
+            lua_getfield(L, tbl, "value");
+            field.value = Eluna::CHECKVAL<uint64>(L, tbl + 3);
+            lua_getfield(L, tbl, "mask");
+            field.mask = Eluna::CHECKVAL<uint64>(L, tbl + 4, field.size == 8 ? ~uint64(0) : (uint64(1) << (field.size * 8)) - 1);
+            lua_pop(L, 5);
+
+            if (filter)
+                filter->fields.push_back(field);
+        }
+    }
+
     static void RegisterEventHelper(Eluna* E, lua_State* L, int regtype)
     {
         uint32 ev = Eluna::CHECKVAL<uint32>(L, 1);
@@ -745,14 +940,56 @@ namespace LuaGlobalFunctions
      * };
      * </pre>
      *
+     * The optional filter is checked natively before the function is called,
+     * so packets that don't match it never enter Lua and don't use up shots.
+     * Field conditions read `size` bytes (1, 2, 4 or 8, little endian) at `offset`
+     * from the start of the packet and compare them, masked, against `value`.
+     * All conditions must match.
+     *
+     *     -- Only CMSG_MESSAGECHAT with chat type CHAT_MSG_SAY from players with at least moderator security
+     *     RegisterPacketEvent(0x095, 5, OnChat, 0, {
+     *         minSize = 8,     -- minimum packet size in bytes
+     *         security = 1,    -- minimum account security level, packets without a player never match
+     *         { offset = 0, size = 4, value = 1, mask = 0xFFFFFFFF }
+     *     })
+     *
      * @param uint32 entry : opcode
      * @param uint32 event : packet event Id, refer to PacketEvents above
      * @param function function : function to register
      * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     * @param table filter : optional filter table, see above
      */
     int RegisterPacketEvent(Eluna* E, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_PACKET);
+        if (lua_isnoneornil(L, 5))
+        {
+            RegisterEntryHelper(E, L, HookMgr::REGTYPE_PACKET);
+            return 0;
+        }
+
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 1);
+        uint32 ev = Eluna::CHECKVAL<uint32>(L, 2);
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+        uint32 shots = Eluna::CHECKVAL<uint32>(L, 4, 0);
+        CheckPacketFilter(L, 5, NULL);
+
+        // Register raises these errors too, they are checked before the filter exists
+        if (ev >= HookMgr::PACKET_EVENT_COUNT)
+            return luaL_error(L, "Unknown event type (regtype %d, id %d, event %d)", HookMgr::REGTYPE_PACKET, entry, ev);
+        if (entry >= NUM_MSG_TYPES)
+            return luaL_error(L, "Couldn't find an opcode with (ID: %d)!", entry);
+
+        lua_pushvalue(L, 3);
+        int functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        if (functionRef < 0)
+            return luaL_argerror(L, 3, "unable to make a ref to function");
+
+        // Nothing raises Lua errors while the filter is alive
+        {
+            ElunaUtil::PacketFilter filter;
+            CheckPacketFilter(L, 5, &filter);
+            E->Register(HookMgr::REGTYPE_PACKET, entry, ev, functionRef, shots, &filter);
+        }
         return 0;
     }
 
@@ -780,239 +1017,1289 @@ namespace LuaGlobalFunctions
     }
 
     /**
-     * Registers a [GameObject] gossip event handler.
+     * Registers a [GameObject] gossip event handler.
+     *
+     * <pre>
+     * enum GossipEvents
+     * {
+     *     GOSSIP_EVENT_ON_HELLO                           = 1,    // (event, player, object) - Object is the Creature/GameObject/Item. For item gossip can return false to stop spell *casting.
+     *     GOSSIP_EVENT_ON_SELECT                          = 2,    // (event, player, object, sender, intid, code, menu_id) - Object is the Creature/GameObject/Item/Player, menu_id is *only for player gossip
+     *     GOSSIP_EVENT_COUNT
+     * };
+     * </pre>
+     *
+     * @param uint32 menu_id : [GameObject] entry Id
+     * @param uint32 event : [GameObject] gossip event Id, refer to GossipEvents above
+     * @param function function : function to register
+     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     */
+    int RegisterGameObjectGossipEvent(Eluna* E, lua_State* L)
+    {
+        RegisterEntryHelper(E, L, HookMgr::REGTYPE_GAMEOBJECT_GOSSIP);
+        return 0;
+    }
+
+    /**
+     * Registers an [Item] event handler.
+     *
+     * <pre>
+     * enum ItemEvents
+     * {
+     *     ITEM_EVENT_ON_DUMMY_EFFECT                      = 1,    // (event, caster, spellid, effindex, item)
+     *     ITEM_EVENT_ON_USE                               = 2,    // (event, player, item, target) - Can return false to stop the spell casting
+     *     ITEM_EVENT_ON_QUEST_ACCEPT                      = 3,    // (event, player, item, quest)
+     *     ITEM_EVENT_ON_EXPIRE                            = 4,    // (event, player, itemid)
+     *     ITEM_EVENT_ON_REMOVE                            = 5,    // (event, player, item)
+     *     ITEM_EVENT_COUNT
+     * };
+     * </pre>
+     *
+     * @param uint32 entry : [Item] entry Id
+     * @param uint32 event : [Item] event Id, refer to ItemEvents above
+     * @param function function : function to register
+     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     */
+    int RegisterItemEvent(Eluna* E, lua_State* L)
+    {
+        RegisterEntryHelper(E, L, HookMgr::REGTYPE_ITEM);
+        return 0;
+    }
+
+    /**
+     * Registers an [Item] gossip event handler.
+     *
+     * <pre>
+     * enum GossipEvents
+     * {
+     *     GOSSIP_EVENT_ON_HELLO                           = 1,    // (event, player, object) - Object is the Creature/GameObject/Item. For item gossip can return false to stop spell *casting.
+     *     GOSSIP_EVENT_ON_SELECT                          = 2,    // (event, player, object, sender, intid, code, menu_id) - Object is the Creature/GameObject/Item/Player, menu_id is *only for player gossip
+     *     GOSSIP_EVENT_COUNT
+     * };
+     * </pre>
+     *
+     * @param uint32 entry : [Item] entry Id
+     * @param uint32 event : [Item] gossip event Id, refer to GossipEvents above
+     * @param function function : function to register
+     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     */
+    int RegisterItemGossipEvent(Eluna* E, lua_State* L)
+    {
+        RegisterEntryHelper(E, L, HookMgr::REGTYPE_ITEM_GOSSIP);
+        return 0;
+    }
+
+    /**
+     * Registers a [Player] gossip event handler.
+     *
+     * <pre>
+     * enum GossipEvents
+     * {
+     *     GOSSIP_EVENT_ON_HELLO                           = 1,    // (event, player, object) - Object is the Creature/GameObject/Item. For item gossip can return false to stop spell *casting.
+     *     GOSSIP_EVENT_ON_SELECT                          = 2,    // (event, player, object, sender, intid, code, menu_id) - Object is the Creature/GameObject/Item/Player, menu_id is *only for player gossip
+     *     GOSSIP_EVENT_COUNT
+     * };
+     * </pre>
+     *
+     * @param uint32 menu_id : [Player] gossip menu Id
+     * @param uint32 event : [Player] gossip event Id, refer to GossipEvents above
+     * @param function function : function to register
+     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     */
+    int RegisterPlayerGossipEvent(Eluna* E, lua_State* L)
+    {
+        RegisterEntryHelper(E, L, HookMgr::REGTYPE_PLAYER_GOSSIP);
+        return 0;
+    }
+
+    /**
+     * Registers a [Creature] event handler.
+     *
+     * <pre>
+     * enum CreatureEvents
+     * {
+     *     CREATURE_EVENT_ON_ENTER_COMBAT                    = 1,  // (event, creature, target)
+     *     CREATURE_EVENT_ON_LEAVE_COMBAT                    = 2,  // (event, creature)
+     *     CREATURE_EVENT_ON_TARGET_DIED                     = 3,  // (event, creature, victim)
+     *     CREATURE_EVENT_ON_DIED                            = 4,  // (event, creature, killer)
+     *     CREATURE_EVENT_ON_SPAWN                           = 5,  // (event, creature)
+     *     CREATURE_EVENT_ON_REACH_WP                        = 6,  // (event, creature, type, id)
+     *     CREATURE_EVENT_ON_AIUPDATE                        = 7,  // (event, creature, diff)
+     *     CREATURE_EVENT_ON_RECEIVE_EMOTE                   = 8,  // (event, creature, player, emoteid)
+     *     CREATURE_EVENT_ON_DAMAGE_TAKEN                    = 9,  // (event, creature, attacker, damage) - Can return new damage
+     *     CREATURE_EVENT_ON_PRE_COMBAT                      = 10, // (event, creature, target)
+     *     CREATURE_EVENT_ON_ATTACKED_AT                     = 11, // (event, creature, attacker)
+     *     CREATURE_EVENT_ON_OWNER_ATTACKED                  = 12, // (event, creature, target)    // Not on mangos
+     *     CREATURE_EVENT_ON_OWNER_ATTACKED_AT               = 13, // (event, creature, attacker)  // Not on mangos
+     *     CREATURE_EVENT_ON_HIT_BY_SPELL                    = 14, // (event, creature, caster, spellid)
+     *     CREATURE_EVENT_ON_SPELL_HIT_TARGET                = 15, // (event, creature, target, spellid)
+     *     CREATURE_EVENT_ON_AIUPDATE_BATCH                  = 16, // (event, creatures, diff, snapshot) - Called once per entry on each map update
+     *     // UNUSED                                         = 17, // (event, creature)
+     *     // UNUSED                                         = 18, // (event, creature)
+     *     CREATURE_EVENT_ON_JUST_SUMMONED_CREATURE          = 19, // (event, creature, summon)
+     *     CREATURE_EVENT_ON_SUMMONED_CREATURE_DESPAWN       = 20, // (event, creature, summon)
+     *     CREATURE_EVENT_ON_SUMMONED_CREATURE_DIED          = 21, // (event, creature, summon, killer)    // Not on mangos
+     *     CREATURE_EVENT_ON_SUMMONED                        = 22, // (event, creature, summoner)
+     *     CREATURE_EVENT_ON_RESET                           = 23, // (event, creature)
+     *     CREATURE_EVENT_ON_REACH_HOME                      = 24, // (event, creature)
+     *     // UNUSED                                         = 25, // (event, creature)
+     *     CREATURE_EVENT_ON_CORPSE_REMOVED                  = 26, // (event, creature, respawndelay) - Can return new respawndelay
+     *     CREATURE_EVENT_ON_MOVE_IN_LOS                     = 27, // (event, creature, unit) - Does not actually check LOS. Just uses the sight range
+     *     // UNUSED                                         = 28, // (event, creature)
+     *     // UNUSED                                         = 29, // (event, creature)
+     *     CREATURE_EVENT_ON_DUMMY_EFFECT                    = 30, // (event, caster, spellid, effindex, creature)
+     *     CREATURE_EVENT_ON_QUEST_ACCEPT                    = 31, // (event, player, creature, quest)
+     *     // UNUSED                                         = 32, // (event, creature)
+     *     // UNUSED                                         = 33, // (event, creature)
+     *     CREATURE_EVENT_ON_QUEST_REWARD                    = 34, // (event, player, creature, quest, opt)
+     *     CREATURE_EVENT_ON_DIALOG_STATUS                   = 35, // (event, player, creature)
+     *     CREATURE_EVENT_ON_ADD                             = 36, // (event, creature)
+     *     CREATURE_EVENT_ON_REMOVE                          = 37, // (event, creature)
+     *     CREATURE_EVENT_COUNT
+     * };
+     * </pre>
+     *
+     * CREATURE_EVENT_ON_AIUPDATE handlers can be throttled with an options table.
+     * The handlers of the entry are then called at most once per interval with the time passed since
+     * the previous call as the diff. All handlers of an entry share the smallest interval registered for it.
+     * The return value of the last call is kept for the updates in between.
+     *
+     *     RegisterCreatureEvent(entry, 7, OnAIUpdate, 0, { interval = 500 })
+     *
+     * CREATURE_EVENT_ON_AIUPDATE_BATCH is called once per map update for each map instance with all
+     * updated creatures of the entry in the creatures array, instead of once for each creature.
+     * The snapshot table has the `health` percent, `combat` state and `victim` (false if none) of the
+     * creatures in arrays at the same indexes. The C++ AI of the creatures keeps running.
+     * The same update interval option applies to it, separately from the interval of CREATURE_EVENT_ON_AIUPDATE.
+     *
+     * CREATURE_EVENT_ON_MOVE_IN_LOS handlers can be given native filters that are checked before entering Lua.
+     * The options apply to all handlers of the entry, so an entry can either have handlers without options
+     * or a single handler with options. Registering other handlers for it is an error until its handlers are cleared
+     * with [Global:ClearCreatureEvents].
+     *
+     *     RegisterCreatureEvent(entry, 27, OnMoveInLOS, 0, {
+     *         typeMask = 0x10,     -- TypeMask of the unit, 0x10 is players
+     *         hostile = 1,         -- 0 either, 1 hostile, 2 friendly
+     *         distance = 20,       -- maximum distance to the unit
+     *         cooldown = 5000,     -- minimum time in milliseconds between calls for the same creature and unit
+     *         filter = { inCombat = false },   -- optional filter, see [WorldObject:GetNearObjects]
+     *     })
+     *
+     * @param uint32 entry : [Creature] entry Id
+     * @param uint32 event : [Creature] event Id, refer to CreatureEvents above
+     * @param function function : function to register
+     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     * @param table options : optional options for the AIUpdate and MoveInLOS events, see above
+     */
+    int RegisterCreatureEvent(Eluna* E, lua_State* L)
+    {
+        uint32 ev = Eluna::CHECKVAL<uint32>(L, 2);
+        uint32 interval = 0;
+        ElunaUtil::MoveInLOSFilter losFilter;
+        bool hasLOSFilter = false;
+        if (!lua_isnoneornil(L, 5))
+        {
+            luaL_checktype(L, 5, LUA_TTABLE);
+            if (ev == HookMgr::CREATURE_EVENT_ON_AIUPDATE || ev == HookMgr::CREATURE_EVENT_ON_AIUPDATE_BATCH)
+            {
+                lua_getfield(L, 5, "interval");
+                interval = Eluna::CHECKVAL<uint32>(L, -1, 0);
+                lua_pop(L, 1);
+            }
+            else if (ev == HookMgr::CREATURE_EVENT_ON_MOVE_IN_LOS)
+            {
+                int top = lua_gettop(L);
+                lua_getfield(L, 5, "typeMask");
+                lua_getfield(L, 5, "hostile");
+                lua_getfield(L, 5, "distance");
+                lua_getfield(L, 5, "cooldown");
+                losFilter.typeMask = Eluna::CHECKVAL<uint16>(L, top + 1, 0);
+                losFilter.hostile = Eluna::CHECKVAL<uint32>(L, top + 2, 0);
+                losFilter.distance = Eluna::CHECKVAL<float>(L, top + 3, 0.0f);
+                losFilter.cooldown = Eluna::CHECKVAL<uint32>(L, top + 4, 0);
+                lua_settop(L, top);
+
+                lua_getfield(L, 5, "filter");
+                losFilter.hasFilter = LuaWorldObject::CheckObjectFilter(L, top + 1, losFilter.filter) != NULL;
+                lua_settop(L, top);
+                hasLOSFilter = true;
+            }
+            else
+                return luaL_argerror(L, 5, "options are not supported for the event");
+        }
+
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 1);
+        if (ev == HookMgr::CREATURE_EVENT_ON_MOVE_IN_LOS && E->CreatureEventBindings->HasEvents(HookMgr::CREATURE_EVENT_ON_MOVE_IN_LOS, entry) &&
+            (hasLOSFilter || E->HasMoveInLOSFilter(entry)))
+            return luaL_error(L, "entry %u already has MoveInLOS handlers, a handler with options must be the only one of the entry as the options apply to all of them", entry);
+
+        RegisterEntryHelper(E, L, HookMgr::REGTYPE_CREATURE);
+
+        if (interval)
+        {
+            uint32 current = E->GetAIUpdateInterval(ev, entry);
+            if (!current || interval < current)
+                E->SetAIUpdateInterval(ev, entry, interval);
+        }
+        if (ev == HookMgr::CREATURE_EVENT_ON_MOVE_IN_LOS)
+            E->SetMoveInLOSFilter(entry, hasLOSFilter ? &losFilter : NULL); // drops the options of expired handlers
+        return 0;
+    }
+
+    /**
+     * Registers a behavior tree that runs for all [Creature]s of the entry on each AI update.
+     *
+     * The tree is built once from the table. Selectors, sequences, decorators, conditions, target selection,
+     * spell casts and movement run natively. Only `lua` nodes call back into Lua, with the creature
+     * and the selected target, and return true to succeed, "running" to keep running or anything else to fail.
+     * Nodes with children list them in the array part of their table.
+     *
+     *     selector     -- runs children until one doesn't fail
+     *     sequence     -- runs children until one doesn't succeed
+     *     invert       -- swaps success and failure of its one child
+     *     cooldown     -- time : fails for time milliseconds after its one child succeeded
+     *     healthBelow  -- pct : succeeds if the health percent is below pct
+     *     inCombat     -- succeeds if in combat
+     *     selectTarget -- target, playerOnly, range : picks the target for the following nodes, target is
+     *                     "victim", "self", "random", "top", "bottom", "nearest" or "farthest" of the threat list
+     *     castSpell    -- spell, triggered, self : casts on the selected target or the victim, fails while casting
+     *     moveTo       -- x, y, z or target = true, distance = 1 : runs until within distance of the point or target
+     *     lua          -- fn : calls fn(creature, target)
+     *
+     *     RegisterCreatureBehaviorTree(entry, {
+     *         type = "selector", interval = 500,
+     *         { type = "sequence", { type = "healthBelow", pct = 30 }, { type = "cooldown", time = 20000, { type = "castSpell", spell = 17, self = true } } },
+     *         { type = "sequence", { type = "selectTarget", target = "random", playerOnly = true }, { type = "cooldown", time = 8000, { type = "castSpell", spell = 133 } } },
+     *         { type = "lua", fn = function(creature, target) return creature:IsInCombat() end },
+     *     })
+     *
+     * The optional `interval` of the root node is the minimum time in milliseconds between runs of the tree.
+     * The C++ AI and the [Creature] event handlers of the creature keep running alongside the tree.
+     * Registering another tree for the entry replaces the previous one. Raises an error if the tree is invalid.
+     *
+     * @param uint32 entry : [Creature] entry Id
+     * @param table tree : the root node of the tree
+     */
+    int RegisterCreatureBehaviorTree(Eluna* E, lua_State* L)
+    {
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 1);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        if (!eObjectMgr->GetCreatureTemplate(entry))
+            return luaL_argerror(L, 1, "valid CreatureEntry expected");
+
+        ElunaBehaviorTree* tree;
+        {
+            std::string error;
+            tree = ElunaBehaviorTree::Build(L, 2, error);
+            if (!tree)
+                lua_pushfstring(L, "RegisterCreatureBehaviorTree: %s", error.c_str());
+        }
+
+        if (!tree)
+            return lua_error(L);
+        E->SetBehaviorTree(entry, tree);
+        return 0;
+    }
+
+    /**
+     * Registers a [GameObject] event handler.
+     *
+     * <pre>
+     * enum GameObjectEvents
+     * {
+     *     GAMEOBJECT_EVENT_ON_AIUPDATE                    = 1,    // (event, go, diff)
+     *     GAMEOBJECT_EVENT_ON_SPAWN                       = 2,    // (event, go)
+     *     GAMEOBJECT_EVENT_ON_DUMMY_EFFECT                = 3,    // (event, caster, spellid, effindex, go)
+     *     GAMEOBJECT_EVENT_ON_QUEST_ACCEPT                = 4,    // (event, player, go, quest)
+     *     GAMEOBJECT_EVENT_ON_QUEST_REWARD                = 5,    // (event, player, go, quest, opt)
+     *     GAMEOBJECT_EVENT_ON_DIALOG_STATUS               = 6,    // (event, player, go)
+     *     GAMEOBJECT_EVENT_ON_DESTROYED                   = 7,    // (event, go, player)
+     *     GAMEOBJECT_EVENT_ON_DAMAGED                     = 8,    // (event, go, player)
+     *     GAMEOBJECT_EVENT_ON_LOOT_STATE_CHANGE           = 9,    // (event, go, state)
+     *     GAMEOBJECT_EVENT_ON_GO_STATE_CHANGED            = 10,   // (event, go, state)
+     *     // UNUSED                                       = 11,   // (event, gameobject)
+     *     GAMEOBJECT_EVENT_ON_ADD                         = 12,   // (event, gameobject)
+     *     GAMEOBJECT_EVENT_ON_REMOVE                      = 13,   // (event, gameobject)
+     *     GAMEOBJECT_EVENT_COUNT
+     * };
+     * </pre>
+     *
+     * @param uint32 entry : [GameObject] entry Id
+     * @param uint32 event : [GameObject] event Id, refer to GameObjectEvents above
+     * @param function function : function to register
+     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     */
+    int RegisterGameObjectEvent(Eluna* E, lua_State* L)
+    {
+        RegisterEntryHelper(E, L, HookMgr::REGTYPE_GAMEOBJECT);
+        return 0;
+    }
+
+    /**
+     * Reloads the Lua engine.
+     *
+     * Tables marked with [Global:SetPersistentTable] are kept. Timed events of [WorldObject]s are
+     * attached again when their function can still be found after the reload, for example
+     * when it is a global or an upvalue of a registered handler, and its script file is unchanged.
+     * Timed events of edited files are dropped. Their event IDs change.
+     */
+    int ReloadEluna(Eluna* /*E*/, lua_State* /*L*/)
+    {
+        Eluna::reload = true;
+        return 0;
+    }
+
+    /**
+     * Sends a message to all [Player]s online.
+     *
+     * @param string message : message to send
+     */
+    int SendWorldMessage(Eluna* /*E*/, lua_State* L)
+    {
+        const char* message = Eluna::CHECKVAL<const char*>(L, 1);
+        eWorld->SendServerMessage(SERVER_MSG_STRING, message);
+        return 0;
+    }
+
+    static ElunaUtil::PlayerFilter CheckPlayerFilter(lua_State* L, int narg)
+    {
+        ElunaUtil::PlayerFilter filter;
+        if (lua_isnoneornil(L, narg))
+            return filter;
+
+        luaL_checktype(L, narg, LUA_TTABLE);
+        lua_getfield(L, narg, "team");
+        filter.team = Eluna::CHECKVAL<uint32>(L, lua_gettop(L), TEAM_NEUTRAL);
+        lua_getfield(L, narg, "minLevel");
+        filter.minLevel = Eluna::CHECKVAL<uint32>(L, lua_gettop(L), 0);
+        lua_getfield(L, narg, "maxLevel");
+        filter.maxLevel = Eluna::CHECKVAL<uint32>(L, lua_gettop(L), 0);
+        lua_getfield(L, narg, "gm");
+        filter.onlyGM = Eluna::CHECKVAL<bool>(L, lua_gettop(L), false);
+        lua_pop(L, 4);
+        return filter;
+    }
+
+    static uint32 SendPacketToSessions(WorldPacket const* data, ElunaUtil::PlayerFilter const& filter, uint32 zoneId, uint32 areaId)
+    {
+        uint32 count = 0;
+        SessionMap const& sessions = eWorld->GetAllSessions();
+        for (SessionMap::const_iterator it = sessions.begin(); it != sessions.end(); ++it)
+        {
+            Player* player = it->second->GetPlayer();
+            if (!player || !player->IsInWorld() || !filter(player))
+                continue;
+            if (zoneId && player->GetZoneId() != zoneId)
+                continue;
+            if (areaId && player->GetAreaId() != areaId)
+                continue;
+
+            it->second->SendPacket(data);
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * Sends a [WorldPacket] to all [Player]s in a [Map] instance and returns the amount of [Player]s it was sent to.
+     *
+     * The packet is built once and the same buffer is handed to every session.
+     * The optional filter table can contain the following keys:
+     *
+     *     {
+     *         team = TEAM_NEUTRAL, -- only send to this [TeamId]
+     *         minLevel = 0,        -- only send to players of at least this level
+     *         maxLevel = 0,        -- only send to players of at most this level, 0 for no limit
+     *         gm = false           -- only send to game masters
+     *     }
+     *
+     * @param [WorldPacket] packet : the packet to send
+     * @param uint32 mapId : the [Map] entry ID
+     * @param uint32 instanceId = 0 : the instance ID of the map
+     * @param table filter : optional filter table
+     * @return uint32 count
+     */
+    int SendPacketToMap(Eluna* /*E*/, lua_State* L)
+    {
+        WorldPacket* data = Eluna::CHECKOBJ<WorldPacket>(L, 1);
+        uint32 mapID = Eluna::CHECKVAL<uint32>(L, 2);
+        uint32 instanceID = Eluna::CHECKVAL<uint32>(L, 3, 0);
+        ElunaUtil::PlayerFilter filter = CheckPlayerFilter(L, 4);
+
+        uint32 count = 0;
+        Map* map = eMapMgr->FindMap(mapID, instanceID);
+        if (!map)
+        {
+            Eluna::Push(L, count);
+            return 1;
+        }
+
+        Map::PlayerList const& players = map->GetPlayers();
+        for (Map::PlayerList::const_iterator itr = players.begin(); itr != players.end(); ++itr)
+        {
+#ifndef TRINITY
+            Player* player = itr->getSource();
+#else
+            Player* player = itr->GetSource();
+#endif
+            if (!player || !filter(player))
+                continue;
+
+            player->GetSession()->SendPacket(data);
+            ++count;
+        }
+
+        Eluna::Push(L, count);
+        return 1;
+    }
+
+    /**
+     * Sends a [WorldPacket] to all [Player]s in a zone and returns the amount of [Player]s it was sent to.
+     *
+     * See [Global:SendPacketToMap] for the filter table.
+     *
+     * @param [WorldPacket] packet : the packet to send
+     * @param uint32 zoneId : the zone ID
+     * @param table filter : optional filter table
+     * @return uint32 count
+     */
+    int SendPacketToZone(Eluna* E, lua_State* L)
+    {
+        WorldPacket* data = Eluna::CHECKOBJ<WorldPacket>(L, 1);
+        uint32 zoneId = Eluna::CHECKVAL<uint32>(L, 2);
+        ElunaUtil::PlayerFilter filter = CheckPlayerFilter(L, 3);
+        if (!zoneId)
+            return luaL_argerror(L, 2, "valid zone ID expected");
+
+        std::vector<Player*> players;
+        E->playerIndex->GetPlayersInZone(players, zoneId, filter.team);
+
+        uint32 count = 0;
+        for (std::vector<Player*>::const_iterator it = players.begin(); it != players.end(); ++it)
+        {
+            if (!(*it)->IsInWorld() || !filter(*it))
+                continue;
+
+            (*it)->GetSession()->SendPacket(data);
+            ++count;
+        }
+
+        Eluna::Push(L, count);
+        return 1;
+    }
+
+    /**
+     * Sends a [WorldPacket] to all [Player]s in an area and returns the amount of [Player]s it was sent to.
+     *
+     * See [Global:SendPacketToMap] for the filter table.
+     *
+     * @param [WorldPacket] packet : the packet to send
+     * @param uint32 areaId : the area ID
+     * @param table filter : optional filter table
+     * @return uint32 count
+     */
+    int SendPacketToArea(Eluna* /*E*/, lua_State* L)
+    {
+        WorldPacket* data = Eluna::CHECKOBJ<WorldPacket>(L, 1);
+        uint32 areaId = Eluna::CHECKVAL<uint32>(L, 2);
+        ElunaUtil::PlayerFilter filter = CheckPlayerFilter(L, 3);
+        if (!areaId)
+            return luaL_argerror(L, 2, "valid area ID expected");
+
+        Eluna::Push(L, SendPacketToSessions(data, filter, 0, areaId));
+        return 1;
+    }
+
+    /**
+     * Sends a [WorldPacket] to all online [Player]s of a team and returns the amount of [Player]s it was sent to.
+     *
+     * Passing `TEAM_NEUTRAL` sends the packet to everyone online.
+     * See [Global:SendPacketToMap] for the filter table, its team key is ignored.
+     *
+     * @param [WorldPacket] packet : the packet to send
+     * @param [TeamId] team : Alliance, Horde or Neutral (All)
+     * @param table filter : optional filter table
+     * @return uint32 count
+     */
+    int SendPacketToTeam(Eluna* /*E*/, lua_State* L)
+    {
+        WorldPacket* data = Eluna::CHECKOBJ<WorldPacket>(L, 1);
+        uint32 team = Eluna::CHECKVAL<uint32>(L, 2);
+        ElunaUtil::PlayerFilter filter = CheckPlayerFilter(L, 3);
+        filter.team = team;
+
+        Eluna::Push(L, SendPacketToSessions(data, filter, 0, 0));
+        return 1;
+    }
+
+    /**
+     * Sends a [WorldPacket] to all [Player]s within range of a [WorldObject] and returns the amount of [Player]s it was sent to.
+     *
+     * If the [WorldObject] is a [Player] it receives the packet as well.
+     * See [Global:SendPacketToMap] for the filter table.
+     *
+     * @param [WorldPacket] packet : the packet to send
+     * @param [WorldObject] obj : the center of the range
+     * @param float range = 533.33333 : the range to send the packet in
+     * @param table filter : optional filter table
+     * @return uint32 count
+     */
+    int SendPacketInRange(Eluna* /*E*/, lua_State* L)
+    {
+        WorldPacket* data = Eluna::CHECKOBJ<WorldPacket>(L, 1);
+        WorldObject* obj = Eluna::CHECKOBJ<WorldObject>(L, 2);
+        float range = Eluna::CHECKVAL<float>(L, 3, SIZE_OF_GRIDS);
+        ElunaUtil::PlayerFilter filter = CheckPlayerFilter(L, 4);
+
+        std::list<Player*> list;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_PLAYER);
+#ifndef TRINITY
+        MaNGOS::PlayerListSearcher<ElunaUtil::WorldObjectInRangeCheck> searcher(list, checker);
+        Cell::VisitWorldObjects(obj, searcher, range);
+#else
+        Trinity::PlayerListSearcher<ElunaUtil::WorldObjectInRangeCheck> searcher(obj, list, checker);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+        if (Player* self = obj->ToPlayer())
+            list.push_back(self);
+
+        uint32 count = 0;
+        for (std::list<Player*>::const_iterator it = list.begin(); it != list.end(); ++it)
+        {
+            if (!filter(*it))
+                continue;
+
+            (*it)->GetSession()->SendPacket(data);
+            ++count;
+        }
+
+        Eluna::Push(L, count);
+        return 1;
+    }
+
+    /**
+     * Sends a [WorldPacket] to the online [Player]s in a table of GUIDs and returns the amount of [Player]s it was sent to.
+     *
+     * Offline [Player]s are skipped. See [Global:SendPacketToMap] for the filter table.
+     *
+     *     SendPacketToGUIDs(packet, {player1:GetGUID(), player2:GetGUID()})
+     *
+     * @param [WorldPacket] packet : the packet to send
+     * @param table guids : table of [Player] GUIDs
+     * @param table filter : optional filter table
+     * @return uint32 count
+     */
+    int SendPacketToGUIDs(Eluna* /*E*/, lua_State* L)
+    {
+        WorldPacket* data = Eluna::CHECKOBJ<WorldPacket>(L, 1);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        ElunaUtil::PlayerFilter filter = CheckPlayerFilter(L, 3);
+
+        uint32 count = 0;
+        lua_pushnil(L);
+        while (lua_next(L, 2) != 0)
+        {
+            uint64 guid = Eluna::CHECKVAL<uint64>(L, lua_gettop(L));
+            lua_pop(L, 1);
+
+            Player* player = eObjectAccessor->FindPlayer(ObjectGuid(guid));
+            if (!player || !player->IsInWorld() || !filter(player))
+                continue;
+
+            player->GetSession()->SendPacket(data);
+            ++count;
+        }
+
+        Eluna::Push(L, count);
+        return 1;
+    }
+
+    /**
+     * Executes a SQL query on the world database and returns an [ElunaQuery].
+     *
+     * The query is always executed synchronously
+     *   (i.e. when this function returns the query has already been executed).
+     *
+     * @param string sql : query to execute
+     * @return [ElunaQuery] results
+     */
+    int WorldDBQuery(Eluna* /*E*/, lua_State* L)
+    {
+        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+
+#ifdef TRINITY
+        ElunaQuery result = WorldDatabase.Query(query);
+        if (result)
+            Eluna::Push(L, new ElunaQuery(result));
+        else
+            Eluna::Push(L);
+#else
+        ElunaQuery* result = WorldDatabase.QueryNamed(query);
+        if (result)
+            Eluna::Push(L, result);
+        else
+            Eluna::Push(L);
+#endif
+        return 1;
+    }
+
+    // Normalizes the query and replaces `?` placeholders outside of quotes with the escaped values of the params table
+    // Checks the query arguments, call before building the key so no strings are alive if they raise errors
+    static void CheckCachedQueryArgs(lua_State* L, int sqlIndex, int paramsIndex)
+    {
+        luaL_checkstring(L, sqlIndex);
+        if (!lua_isnoneornil(L, paramsIndex))
+            luaL_checktype(L, paramsIndex, LUA_TTABLE);
+    }
+
+    // Returns false if a param has an unsupported type, the caller raises the error after its strings are gone
+    static bool GetCachedQueryKey(lua_State* L, int sqlIndex, int paramsIndex, std::string& key)
+    {
+        std::string sql = ElunaQueryCache::Normalize(lua_tostring(L, sqlIndex));
+        if (lua_isnoneornil(L, paramsIndex))
+        {
+            key = sql;
+            return true;
+        }
+
+        key.reserve(sql.size());
+
+        int param = 0;
+        char quote = 0;
+        for (std::string::const_iterator it = sql.begin(); it != sql.end(); ++it)
+        {
+            if (quote)
+            {
+                key += *it;
+                if (*it == '\\' && it + 1 != sql.end())
+                    key += *++it;
+                else if (*it == quote)
+                    quote = 0;
+                continue;
+            }
+
+            if (*it != '?')
+            {
+                if (*it == '\'' || *it == '"' || *it == '`')
+                    quote = *it;
+                key += *it;
+                continue;
+            }
+
+            lua_rawgeti(L, paramsIndex, ++param);
+            switch (lua_type(L, -1))
+            {
+                case LUA_TNIL:
+                    key += "NULL";
+                    break;
+                case LUA_TBOOLEAN:
+                    key += lua_toboolean(L, -1) ? '1' : '0';
+                    break;
+                case LUA_TNUMBER:
+                {
+                    char buff[64];
+                    lua_Number number = lua_tonumber(L, -1);
+                    if (number == static_cast<lua_Number>(static_cast<long long>(number)))
+                        snprintf(buff, sizeof(buff), "%lld", static_cast<long long>(number));
+                    else
+                        snprintf(buff, sizeof(buff), "%.17g", number);
+                    key += buff;
+                    break;
+                }
+                case LUA_TSTRING:
+                {
+                    size_t len = 0;
+                    const char* str = lua_tolstring(L, -1, &len);
+                    std::string value(str, len);
+#ifdef TRINITY
+                    WorldDatabase.EscapeString(value);
+#else
+                    WorldDatabase.escape_string(value);
+#endif
+                    key += '\'';
+                    key += value;
+                    key += '\'';
+                    break;
+                }
+                default:
+                    lua_pop(L, 1);
+                    return false;
+            }
+            lua_pop(L, 1);
+        }
+        return true;
+    }
+
+    /**
+     * Executes a read-only SQL query on the world database and returns a cached, immutable [CachedQuery].
+     *
+     * The first call runs the query synchronously like [Global:WorldDBQuery], later calls with the same
+     * normalized query text and params are answered from the cache until the entry expires or is evicted.
+     * Only use this for data that does not change while the server runs, such as templates.
+     *
+     * `?` placeholders in the query are replaced in order by the escaped values of the `params` table.
+     *
+     * The cache can be tuned with the `Eluna.QueryCache.TTL` (milliseconds), `Eluna.QueryCache.MaxEntries`
+     * and `Eluna.QueryCache.MaxMemory` (kilobytes) config options.
+     *
+     *     local Q = WorldDBQueryCached("SELECT name FROM creature_template WHERE entry = ?", {entry})
+     *
+     * @param string sql : query to execute
+     * @param table params = nil : values for the `?` placeholders
+     * @param uint32 ttl = 0 : milliseconds to keep the result cached, 0 uses the configured default
+     * @return [CachedQuery] results : `nil` if the query returned no rows
+     */
+    int WorldDBQueryCached(Eluna* E, lua_State* L)
+    {
+        CheckCachedQueryArgs(L, 1, 2);
+        uint32 ttl = Eluna::CHECKVAL<uint32>(L, 3, 0);
+
+        bool valid = false;
+        {
+            std::string key;
+            valid = GetCachedQueryKey(L, 1, 2, key);
+            if (valid)
+            {
+                ElunaCachedResultPtr result = E->queryCache->Get(key);
+                if (!result)
+                {
+#ifdef TRINITY
+                    ElunaQuery query = WorldDatabase.Query(key.c_str());
+                    result = ElunaQueryCache::Snapshot(&query);
+#else
+                    ElunaQuery* query = WorldDatabase.QueryNamed(key.c_str());
+                    result = ElunaQueryCache::Snapshot(query);
+                    delete query;
+#endif
+                    E->queryCache->Store(key, result, ttl);
+                }
+
+                if (result->rows)
+                    Eluna::Push(L, new ElunaCachedQuery(result));
+                else
+                    Eluna::Push(L);
+            }
+        }
+        if (!valid)
+            return luaL_argerror(L, 2, "params can only contain nil, booleans, numbers and strings");
+        return 1;
+    }
+
+    /**
+     * Removes a single query from the [Global:WorldDBQueryCached] cache.
+     *
+     * The query text and params must be the same as the ones used to cache it.
+     *
+     * @param string sql : cached query
+     * @param table params = nil : values for the `?` placeholders
+     * @return bool removed : `true` if the query was cached
+     */
+    int InvalidateCachedQuery(Eluna* E, lua_State* L)
+    {
+        CheckCachedQueryArgs(L, 1, 2);
+
+        bool valid = false;
+        {
+            std::string key;
+            valid = GetCachedQueryKey(L, 1, 2, key);
+            if (valid)
+                Eluna::Push(L, E->queryCache->Invalidate(key));
+        }
+        if (!valid)
+            return luaL_argerror(L, 2, "params can only contain nil, booleans, numbers and strings");
+        return 1;
+    }
+
+    /**
+     * Removes all queries from the [Global:WorldDBQueryCached] cache.
+     *
+     * [CachedQuery] objects that are still in use stay valid.
+     */
+    int ClearQueryCache(Eluna* E, lua_State* /*L*/)
+    {
+        E->queryCache->Clear();
+        return 0;
+    }
+
+    /**
+     * Returns the counters of the [Global:WorldDBQueryCached] cache.
+     *
+     * @return number hits
+     * @return number misses
+     * @return uint32 entries : amount of currently cached queries
+     * @return number memory : approximated memory used by the cached results, in bytes
+     * @return number evictions : amount of entries removed to respect the entry and memory limits
+     */
+    int GetQueryCacheStats(Eluna* E, lua_State* L)
+    {
+        Eluna::Push(L, static_cast<double>(E->queryCache->GetHits()));
+        Eluna::Push(L, static_cast<double>(E->queryCache->GetMisses()));
+        Eluna::Push(L, E->queryCache->GetEntryCount());
+        Eluna::Push(L, static_cast<double>(E->queryCache->GetMemory()));
+        Eluna::Push(L, static_cast<double>(E->queryCache->GetEvictions()));
+        return 5;
+    }
+
+    /**
+     * Returns the per opcode packet hook counters, sorted by total handler time.
+     *
+     * Only opcodes seen since the counters were enabled or reset are included.
+     * The counters are enabled with the `Eluna.PacketStats` config option,
+     * [Global:SetPacketStatsEnabled] or the `packetstats on` command.
+     * Each entry of the returned table has the following keys:
+     *
+     *     {
+     *         opcode = 0,    -- opcode of the packet
+     *         send = true,   -- true for sent packets, false for received packets
+     *         seen = 0,      -- amount of packets passing the hook
+     *         hooked = 0,    -- amount of packets handlers were called for
+     *         bytes = 0,     -- size of all seen packets
+     *         time = 0,      -- total handler time in microseconds
+     *         p50 = 0,       -- median handler time in microseconds
+     *         p99 = 0,       -- 99th percentile handler time in microseconds
+     *         dropped = 0,   -- amount of packets a handler returned false for
+     *         replaced = 0   -- amount of packets a handler returned a new packet for
+     *     }
+     *
+     * @param uint32 limit = 0 : maximum amount of entries to return, 0 for all
+     * @return table packetStats
+     */
+    int GetPacketStats(Eluna* E, lua_State* L)
+    {
+        uint32 limit = Eluna::CHECKVAL<uint32>(L, 1, 0);
+
+        std::vector<ElunaPacketStats::Snapshot> snapshots;
+        E->packetStats->GetSnapshots(snapshots);
+        if (limit && snapshots.size() > limit)
+            snapshots.resize(limit);
+
+        lua_createtable(L, snapshots.size(), 0);
+        int tbl = lua_gettop(L);
+
+        for (uint32 i = 0; i < snapshots.size(); ++i)
+        {
+            ElunaPacketStats::Snapshot const& snapshot = snapshots[i];
+
+            lua_createtable(L, 0, 10);
+            Eluna::Push(L, snapshot.opcode);
+            lua_setfield(L, -2, "opcode");
+            Eluna::Push(L, snapshot.direction == ElunaPacketStats::PACKET_STATS_SEND);
+            lua_setfield(L, -2, "send");
+            Eluna::Push(L, static_cast<double>(snapshot.seen));
+            lua_setfield(L, -2, "seen");
+            Eluna::Push(L, static_cast<double>(snapshot.hooked));
+            lua_setfield(L, -2, "hooked");
+            Eluna::Push(L, static_cast<double>(snapshot.bytes));
+            lua_setfield(L, -2, "bytes");
+            Eluna::Push(L, static_cast<double>(snapshot.time));
+            lua_setfield(L, -2, "time");
+            Eluna::Push(L, snapshot.p50);
+            lua_setfield(L, -2, "p50");
+            Eluna::Push(L, snapshot.p99);
+            lua_setfield(L, -2, "p99");
+            Eluna::Push(L, static_cast<double>(snapshot.dropped));
+            lua_setfield(L, -2, "dropped");
+            Eluna::Push(L, static_cast<double>(snapshot.replaced));
+            lua_setfield(L, -2, "replaced");
+
+            lua_rawseti(L, tbl, i + 1);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+
+    /**
+     * Resets all packet hook counters returned by [Global:GetPacketStats].
+     */
+    int ResetPacketStats(Eluna* E, lua_State* /*L*/)
+    {
+        E->packetStats->Reset();
+        return 0;
+    }
+
+    /**
+     * Enables or disables collecting the packet hook counters returned by [Global:GetPacketStats].
+     *
+     * @param bool enable = true
+     */
+    int SetPacketStatsEnabled(Eluna* E, lua_State* L)
+    {
+        bool enable = Eluna::CHECKVAL<bool>(L, 1, true);
+        E->packetStats->SetEnabled(enable);
+        return 0;
+    }
+
+    /**
+     * Returns the counters of the [WorldPacket] pool used by [Global:CreatePacket].
+     *
+     * @return uint32 hits : packets reused from the pool
+     * @return uint32 misses : packets that had to be allocated
+     * @return uint32 releases : packets returned to the pool
+     * @return uint32 discards : released packets deleted because they were too big or the pool was full
+     * @return uint32 pooled : packets currently waiting in the pool
+     */
+    int GetPacketPoolStats(Eluna* E, lua_State* L)
+    {
+        Eluna::Push(L, static_cast<double>(E->packetPool->GetHits()));
+        Eluna::Push(L, static_cast<double>(E->packetPool->GetMisses()));
+        Eluna::Push(L, static_cast<double>(E->packetPool->GetReleases()));
+        Eluna::Push(L, static_cast<double>(E->packetPool->GetDiscards()));
+        Eluna::Push(L, E->packetPool->GetPooledCount());
+        return 5;
+    }
+
+    static void CheckSharedValue(lua_State* L, int narg)
+    {
+        int type = lua_type(L, narg);
+        if (type != LUA_TNONE && type != LUA_TNIL && type != LUA_TNUMBER && type != LUA_TSTRING)
+            luaL_argerror(L, narg, "number, string or nil expected");
+    }
+
+    // Arguments must be checked with CheckSharedValue first, the conversion can't raise errors
+    static ElunaSharedStore::Value ToSharedValue(lua_State* L, int narg)
+    {
+        switch (lua_type(L, narg))
+        {
+            case LUA_TNUMBER:
+                return ElunaSharedStore::Value(static_cast<double>(lua_tonumber(L, narg)));
+            case LUA_TSTRING:
+            {
+                size_t len = 0;
+                const char* str = lua_tolstring(L, narg, &len);
+                return ElunaSharedStore::Value(std::string(str, len));
+            }
+            default:
+                return ElunaSharedStore::Value();
+        }
+    }
+
+    static void PushSharedValue(lua_State* L, ElunaSharedStore::Value const& value)
+    {
+        switch (value.type)
+        {
+            case ElunaSharedStore::Value::VALUE_NUMBER:
+                Eluna::Push(L, value.number);
+                break;
+            case ElunaSharedStore::Value::VALUE_STRING:
+                lua_pushlstring(L, value.str->data(), value.str->size());
+                break;
+            default:
+                Eluna::Push(L);
+                break;
+        }
+    }
+
+    /**
+     * Returns a value from the key value store shared by all Eluna states.
+     *
+     * The shared store keeps its values over reloads.
+     *
+     * @param string key
+     * @return value : the number or string stored, `nil` if the key isn't set
+     */
+    int GetSharedValue(Eluna* /*E*/, lua_State* L)
+    {
+        size_t keyLen = 0;
+        const char* key = luaL_checklstring(L, 1, &keyLen);
+
+        PushSharedValue(L, ElunaSharedStore::Instance().Get(std::string(key, keyLen)));
+        return 1;
+    }
+
+    /**
+     * Sets a value in the key value store shared by all Eluna states.
+     *
+     * Numbers and strings can be stored, strings can contain binary data. Setting `nil` removes the key.
+     *
+     * @param string key
+     * @param value : number, string or `nil`
+     */
+    int SetSharedValue(Eluna* /*E*/, lua_State* L)
+    {
+        size_t keyLen = 0;
+        const char* key = luaL_checklstring(L, 1, &keyLen);
+        CheckSharedValue(L, 2);
+
+        ElunaSharedStore::Instance().Set(std::string(key, keyLen), ToSharedValue(L, 2));
+        return 0;
+    }
+
+    /**
+     * Atomically replaces a value in the shared key value store if it still holds the expected value.
+     *
+     * An expected value of `nil` only succeeds if the key isn't set. Returns true if the value was replaced.
+     *
+     *     -- only the first state to get here starts the event
+     *     if CompareAndSwapSharedValue("worldevent.started", nil, 1) then
+     *         StartWorldEvent()
+     *     end
+     *
+     * @param string key
+     * @param expected : number, string or `nil` the key must currently hold
+     * @param desired : number, string or `nil` to set
+     * @return bool swapped
+     */
+    int CompareAndSwapSharedValue(Eluna* /*E*/, lua_State* L)
+    {
+        size_t keyLen = 0;
+        const char* key = luaL_checklstring(L, 1, &keyLen);
+        CheckSharedValue(L, 2);
+        CheckSharedValue(L, 3);
+
+        Eluna::Push(L, ElunaSharedStore::Instance().CompareAndSwap(std::string(key, keyLen), ToSharedValue(L, 2), ToSharedValue(L, 3)));
+        return 1;
+    }
+
+    /**
+     * Atomically adds to a number in the shared key value store and returns the new value.
+     *
+     * A key that isn't set counts as 0. Returns `nil` and leaves the value unchanged if the key holds a string.
+     *
+     * @param string key
+     * @param double delta = 1
+     * @return double value
+     */
+    int IncrementSharedValue(Eluna* /*E*/, lua_State* L)
+    {
+        const char* key = Eluna::CHECKVAL<const char*>(L, 1);
+        double delta = Eluna::CHECKVAL<double>(L, 2, 1.0);
+
+        double result = 0.0;
+        if (ElunaSharedStore::Instance().Increment(key, delta, result))
+            Eluna::Push(L, result);
+        else
+            Eluna::Push(L);
+        return 1;
+    }
+
+    /**
+     * Serializes a value into a compact binary string and returns it.
      *
-     * <pre>
-     * enum GossipEvents
-     * {
-     *     GOSSIP_EVENT_ON_HELLO                           = 1,    // (event, player, object) - Object is the Creature/GameObject/Item. For item gossip can return false to stop spell *casting.
-     *     GOSSIP_EVENT_ON_SELECT                          = 2,    // (event, player, object, sender, intid, code, menu_id) - Object is the Creature/GameObject/Item/Player, menu_id is *only for player gossip
-     *     GOSSIP_EVENT_COUNT
-     * };
-     * </pre>
+     * Supports nil, booleans, numbers, strings, tables, uint64 and int64 values and game objects.
+     * Game objects are stored by GUID and are deserialized as their uint64 GUID.
+     * Tables referenced more than once, including cycles, keep their shared references.
+     * Functions and other userdata can't be serialized and raise an error.
      *
-     * @param uint32 menu_id : [GameObject] entry Id
-     * @param uint32 event : [GameObject] gossip event Id, refer to GossipEvents above
-     * @param function function : function to register
-     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     *     local blob = Serialize({ kills = 10, killers = { player:GetGUID() } })
+     *     SetSharedValue("worldboss.state", blob)
+     *     local state = Deserialize(GetSharedValue("worldboss.state"))
+     *
+     * @param value : the value to serialize
+     * @return string blob
      */
-    int RegisterGameObjectGossipEvent(Eluna* E, lua_State* L)
+    int Serialize(Eluna* /*E*/, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_GAMEOBJECT_GOSSIP);
-        return 0;
+        lua_settop(L, 1);
+
+        bool ok;
+        {
+            std::string blob;
+            std::string error;
+            ok = ElunaSerializer::Serialize(L, 1, blob, error);
+            if (ok)
+                lua_pushlstring(L, blob.data(), blob.size());
+            else
+                lua_pushfstring(L, "Serialize: %s", error.c_str());
+        }
+
+        if (!ok)
+            return lua_error(L);
+        return 1;
     }
 
     /**
-     * Registers an [Item] event handler.
+     * Returns the value stored in a string created with [Global:Serialize].
      *
-     * <pre>
-     * enum ItemEvents
-     * {
-     *     ITEM_EVENT_ON_DUMMY_EFFECT                      = 1,    // (event, caster, spellid, effindex, item)
-     *     ITEM_EVENT_ON_USE                               = 2,    // (event, player, item, target) - Can return false to stop the spell casting
-     *     ITEM_EVENT_ON_QUEST_ACCEPT                      = 3,    // (event, player, item, quest)
-     *     ITEM_EVENT_ON_EXPIRE                            = 4,    // (event, player, itemid)
-     *     ITEM_EVENT_ON_REMOVE                            = 5,    // (event, player, item)
-     *     ITEM_EVENT_COUNT
-     * };
-     * </pre>
+     * Raises an error if the string isn't a valid serialized value.
      *
-     * @param uint32 entry : [Item] entry Id
-     * @param uint32 event : [Item] event Id, refer to ItemEvents above
-     * @param function function : function to register
-     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     * @param string blob
+     * @return value
      */
-    int RegisterItemEvent(Eluna* E, lua_State* L)
+    int Deserialize(Eluna* /*E*/, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_ITEM);
-        return 0;
+        size_t size = 0;
+        const char* data = luaL_checklstring(L, 1, &size);
+
+        bool ok;
+        {
+            std::string error;
+            ok = ElunaSerializer::Deserialize(L, data, size, error);
+            if (!ok)
+                lua_pushfstring(L, "Deserialize: %s", error.c_str());
+        }
+
+        if (!ok)
+            return lua_error(L);
+        return 1;
     }
 
     /**
-     * Registers an [Item] gossip event handler.
+     * Returns a value from the persistent store.
      *
-     * <pre>
-     * enum GossipEvents
-     * {
-     *     GOSSIP_EVENT_ON_HELLO                           = 1,    // (event, player, object) - Object is the Creature/GameObject/Item. For item gossip can return false to stop spell *casting.
-     *     GOSSIP_EVENT_ON_SELECT                          = 2,    // (event, player, object, sender, intid, code, menu_id) - Object is the Creature/GameObject/Item/Player, menu_id is *only for player gossip
-     *     GOSSIP_EVENT_COUNT
-     * };
-     * </pre>
+     * The persistent store is a local file kept by the server, configured with `Eluna.Store.File`.
+     * Its values survive reloads and restarts.
      *
-     * @param uint32 entry : [Item] entry Id
-     * @param uint32 event : [Item] gossip event Id, refer to GossipEvents above
-     * @param function function : function to register
-     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     * @param string key
+     * @return string value : the stored value, `nil` if the key isn't set
      */
-    int RegisterItemGossipEvent(Eluna* E, lua_State* L)
+    int GetStoreValue(Eluna* /*E*/, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_ITEM_GOSSIP);
-        return 0;
+        size_t keyLen = 0;
+        const char* key = luaL_checklstring(L, 1, &keyLen);
+
+        bool found;
+        {
+            std::string value;
+            found = ElunaPersistentStore::Instance().Get(std::string(key, keyLen), value);
+            if (found)
+                lua_pushlstring(L, value.data(), value.size());
+        }
+
+        if (!found)
+            Eluna::Push(L);
+        return 1;
     }
 
     /**
-     * Registers a [Player] gossip event handler.
+     * Stores a value in the persistent store.
      *
-     * <pre>
-     * enum GossipEvents
-     * {
-     *     GOSSIP_EVENT_ON_HELLO                           = 1,    // (event, player, object) - Object is the Creature/GameObject/Item. For item gossip can return false to stop spell *casting.
-     *     GOSSIP_EVENT_ON_SELECT                          = 2,    // (event, player, object, sender, intid, code, menu_id) - Object is the Creature/GameObject/Item/Player, menu_id is *only for player gossip
-     *     GOSSIP_EVENT_COUNT
-     * };
-     * </pre>
+     * Writes are batched and synced to disk every `Eluna.Store.SyncInterval` milliseconds, or when [Global:SyncStore] is called.
+     * A value is only guaranteed to survive a crash after it was synced.
+     * Tables can be stored with [Global:Serialize].
      *
-     * @param uint32 menu_id : [Player] gossip menu Id
-     * @param uint32 event : [Player] gossip event Id, refer to GossipEvents above
-     * @param function function : function to register
-     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     *     PutStoreValue("worldboss.kills", tostring(kills))
+     *     PutStoreValue("worldboss.state", Serialize(state))
+     *
+     * @param string key
+     * @param string value
      */
-    int RegisterPlayerGossipEvent(Eluna* E, lua_State* L)
+    int PutStoreValue(Eluna* /*E*/, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_PLAYER_GOSSIP);
+        size_t keyLen = 0;
+        size_t valueLen = 0;
+        const char* key = luaL_checklstring(L, 1, &keyLen);
+        const char* value = luaL_checklstring(L, 2, &valueLen);
+        if (!ElunaPersistentStore::Instance().IsOpen())
+            return luaL_error(L, "persistent store is not open");
+
+        ElunaPersistentStore::Instance().Put(std::string(key, keyLen), std::string(value, valueLen));
         return 0;
     }
 
     /**
-     * Registers a [Creature] event handler.
-     *
-     * <pre>
-     * enum CreatureEvents
-     * {
-     *     CREATURE_EVENT_ON_ENTER_COMBAT                    = 1,  // (event, creature, target)
-     *     CREATURE_EVENT_ON_LEAVE_COMBAT                    = 2,  // (event, creature)
-     *     CREATURE_EVENT_ON_TARGET_DIED                     = 3,  // (event, creature, victim)
-     *     CREATURE_EVENT_ON_DIED                            = 4,  // (event, creature, killer)
-     *     CREATURE_EVENT_ON_SPAWN                           = 5,  // (event, creature)
-     *     CREATURE_EVENT_ON_REACH_WP                        = 6,  // (event, creature, type, id)
-     *     CREATURE_EVENT_ON_AIUPDATE                        = 7,  // (event, creature, diff)
-     *     CREATURE_EVENT_ON_RECEIVE_EMOTE                   = 8,  // (event, creature, player, emoteid)
-     *     CREATURE_EVENT_ON_DAMAGE_TAKEN                    = 9,  // (event, creature, attacker, damage) - Can return new damage
-     *     CREATURE_EVENT_ON_PRE_COMBAT                      = 10, // (event, creature, target)
-     *     CREATURE_EVENT_ON_ATTACKED_AT                     = 11, // (event, creature, attacker)
-     *     CREATURE_EVENT_ON_OWNER_ATTACKED                  = 12, // (event, creature, target)    // Not on mangos
-     *     CREATURE_EVENT_ON_OWNER_ATTACKED_AT               = 13, // (event, creature, attacker)  // Not on mangos
-     *     CREATURE_EVENT_ON_HIT_BY_SPELL                    = 14, // (event, creature, caster, spellid)
-     *     CREATURE_EVENT_ON_SPELL_HIT_TARGET                = 15, // (event, creature, target, spellid)
-     *     // UNUSED                                         = 16, // (event, creature)
-     *     // UNUSED                                         = 17, // (event, creature)
-     *     // UNUSED                                         = 18, // (event, creature)
-     *     CREATURE_EVENT_ON_JUST_SUMMONED_CREATURE          = 19, // (event, creature, summon)
-     *     CREATURE_EVENT_ON_SUMMONED_CREATURE_DESPAWN       = 20, // (event, creature, summon)
-     *     CREATURE_EVENT_ON_SUMMONED_CREATURE_DIED          = 21, // (event, creature, summon, killer)    // Not on mangos
-     *     CREATURE_EVENT_ON_SUMMONED                        = 22, // (event, creature, summoner)
-     *     CREATURE_EVENT_ON_RESET                           = 23, // (event, creature)
-     *     CREATURE_EVENT_ON_REACH_HOME                      = 24, // (event, creature)
-     *     // UNUSED                                         = 25, // (event, creature)
-     *     CREATURE_EVENT_ON_CORPSE_REMOVED                  = 26, // (event, creature, respawndelay) - Can return new respawndelay
-     *     CREATURE_EVENT_ON_MOVE_IN_LOS                     = 27, // (event, creature, unit) - Does not actually check LOS. Just uses the sight range
-     *     // UNUSED                                         = 28, // (event, creature)
-     *     // UNUSED                                         = 29, // (event, creature)
-     *     CREATURE_EVENT_ON_DUMMY_EFFECT                    = 30, // (event, caster, spellid, effindex, creature)
-     *     CREATURE_EVENT_ON_QUEST_ACCEPT                    = 31, // (event, player, creature, quest)
-     *     // UNUSED                                         = 32, // (event, creature)
-     *     // UNUSED                                         = 33, // (event, creature)
-     *     CREATURE_EVENT_ON_QUEST_REWARD                    = 34, // (event, player, creature, quest, opt)
-     *     CREATURE_EVENT_ON_DIALOG_STATUS                   = 35, // (event, player, creature)
-     *     CREATURE_EVENT_ON_ADD                             = 36, // (event, creature)
-     *     CREATURE_EVENT_ON_REMOVE                          = 37, // (event, creature)
-     *     CREATURE_EVENT_COUNT
-     * };
-     * </pre>
+     * Removes a value from the persistent store. Returns true if the key was set.
      *
-     * @param uint32 entry : [Creature] entry Id
-     * @param uint32 event : [Creature] event Id, refer to CreatureEvents above
-     * @param function function : function to register
-     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     * @param string key
+     * @return bool deleted
      */
-    int RegisterCreatureEvent(Eluna* E, lua_State* L)
+    int DeleteStoreValue(Eluna* /*E*/, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_CREATURE);
-        return 0;
+        size_t keyLen = 0;
+        const char* key = luaL_checklstring(L, 1, &keyLen);
+
+        Eluna::Push(L, ElunaPersistentStore::Instance().Delete(std::string(key, keyLen)));
+        return 1;
     }
 
     /**
-     * Registers a [GameObject] event handler.
+     * Calls a function for each value in the persistent store whose key starts with the prefix, in key order.
      *
-     * <pre>
-     * enum GameObjectEvents
-     * {
-     *     GAMEOBJECT_EVENT_ON_AIUPDATE                    = 1,    // (event, go, diff)
-     *     GAMEOBJECT_EVENT_ON_SPAWN                       = 2,    // (event, go)
-     *     GAMEOBJECT_EVENT_ON_DUMMY_EFFECT                = 3,    // (event, caster, spellid, effindex, go)
-     *     GAMEOBJECT_EVENT_ON_QUEST_ACCEPT                = 4,    // (event, player, go, quest)
-     *     GAMEOBJECT_EVENT_ON_QUEST_REWARD                = 5,    // (event, player, go, quest, opt)
-     *     GAMEOBJECT_EVENT_ON_DIALOG_STATUS               = 6,    // (event, player, go)
-     *     GAMEOBJECT_EVENT_ON_DESTROYED                   = 7,    // (event, go, player)
-     *     GAMEOBJECT_EVENT_ON_DAMAGED                     = 8,    // (event, go, player)
-     *     GAMEOBJECT_EVENT_ON_LOOT_STATE_CHANGE           = 9,    // (event, go, state)
-     *     GAMEOBJECT_EVENT_ON_GO_STATE_CHANGED            = 10,   // (event, go, state)
-     *     // UNUSED                                       = 11,   // (event, gameobject)
-     *     GAMEOBJECT_EVENT_ON_ADD                         = 12,   // (event, gameobject)
-     *     GAMEOBJECT_EVENT_ON_REMOVE                      = 13,   // (event, gameobject)
-     *     GAMEOBJECT_EVENT_COUNT
-     * };
-     * </pre>
+     * The function is called with the key and the value. Returning `false` from it stops the iteration.
+     * Changes made from the function don't affect the values it is called for.
+     * Returns the amount of values the function was called for.
      *
-     * @param uint32 entry : [GameObject] entry Id
-     * @param uint32 event : [GameObject] event Id, refer to GameObjectEvents above
-     * @param function function : function to register
-     * @param uint32 shots = 0 : the number of times the function will be called, 0 means "always call this function"
+     *     ForEachStoreValue("quest.", function(key, value)
+     *         print(key, value)
+     *     end)
+     *
+     * @param string prefix
+     * @param function func
+     * @return uint32 count
      */
-    int RegisterGameObjectEvent(Eluna* E, lua_State* L)
+    int ForEachStoreValue(Eluna* E, lua_State* L)
     {
-        RegisterEntryHelper(E, L, HookMgr::REGTYPE_GAMEOBJECT);
-        return 0;
+        size_t prefixLen = 0;
+        const char* prefix = luaL_checklstring(L, 1, &prefixLen);
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+
+        // Pushed into a table first so no C++ objects are alive while Lua code runs
+        lua_newtable(L);
+        int tbl = lua_gettop(L);
+        uint32 entries = 0;
+        {
+            ElunaPersistentStore::EntryList list;
+            ElunaPersistentStore::Instance().GetRange(std::string(prefix, prefixLen), list);
+            for (ElunaPersistentStore::EntryList::const_iterator it = list.begin(); it != list.end(); ++it)
+            {
+                lua_pushlstring(L, it->first.data(), it->first.size());
+                lua_rawseti(L, tbl, ++entries);
+                lua_pushlstring(L, it->second.data(), it->second.size());
+                lua_rawseti(L, tbl, ++entries);
+            }
+        }
+
+        uint32 count = 0;
+        for (uint32 i = 1; i < entries; i += 2)
+        {
+            lua_pushvalue(L, 2);
+            lua_rawgeti(L, tbl, i);
+            lua_rawgeti(L, tbl, i + 1);
+            ++count;
+            if (!E->CallForEach(L, 2))
+                break;
+        }
+
+        Eluna::Push(L, count);
+        return 1;
     }
 
     /**
-     * Reloads the Lua engine.
+     * Writes all batched changes of the persistent store to disk and syncs them.
      */
-    int ReloadEluna(Eluna* /*E*/, lua_State* /*L*/)
+    int SyncStore(Eluna* /*E*/, lua_State* /*L*/)
     {
-        Eluna::reload = true;
+        ElunaPersistentStore::Instance().Sync();
         return 0;
     }
 
     /**
-     * Sends a message to all [Player]s online.
+     * Marks a table to be kept over [Global:ReloadEluna], or unmarks it when the table is `nil`.
      *
-     * @param string message : message to send
+     * Marked tables are serialized with [Global:Serialize] before the reload and can be
+     * fetched with [Global:GetPersistentTable] once the scripts load again.
+     * Tables holding values that can't be serialized, like functions, are not kept.
+     *
+     *     local cache = GetPersistentTable("myscript.cache") or LoadCacheFromDB()
+     *     SetPersistentTable("myscript.cache", cache)
+     *
+     * @param string name
+     * @param table tbl
      */
-    int SendWorldMessage(Eluna* /*E*/, lua_State* L)
+    int SetPersistentTable(Eluna* /*E*/, lua_State* L)
     {
-        const char* message = Eluna::CHECKVAL<const char*>(L, 1);
-        eWorld->SendServerMessage(SERVER_MSG_STRING, message);
+        const char* name = Eluna::CHECKVAL<const char*>(L, 1);
+        if (!lua_isnoneornil(L, 2))
+            luaL_checktype(L, 2, LUA_TTABLE);
+        lua_settop(L, 2);
+
+        lua_getglobal(L, ELUNA_PERSISTENT_TABLES);
+        lua_pushvalue(L, 2);
+        lua_setfield(L, -2, name);
         return 0;
     }
 
     /**
-     * Executes a SQL query on the world database and returns an [ElunaQuery].
-     *
-     * The query is always executed synchronously
-     *   (i.e. when this function returns the query has already been executed).
+     * Returns a table marked with [Global:SetPersistentTable], including the ones restored after a reload.
      *
-     * @param string sql : query to execute
-     * @return [ElunaQuery] results
+     * @param string name
+     * @return table tbl : the table, or `nil` if there is none with the name
      */
-    int WorldDBQuery(Eluna* /*E*/, lua_State* L)
+    int GetPersistentTable(Eluna* /*E*/, lua_State* L)
     {
-        const char* query = Eluna::CHECKVAL<const char*>(L, 1);
+        const char* name = Eluna::CHECKVAL<const char*>(L, 1);
 
-#ifdef TRINITY
-        ElunaQuery result = WorldDatabase.Query(query);
-        if (result)
-            Eluna::Push(L, new ElunaQuery(result));
-        else
-            Eluna::Push(L);
-#else
-        ElunaQuery* result = WorldDatabase.QueryNamed(query);
-        if (result)
-            Eluna::Push(L, result);
-        else
-            Eluna::Push(L);
-#endif
+        lua_getglobal(L, ELUNA_PERSISTENT_TABLES);
+        lua_getfield(L, -1, name);
         return 1;
     }
 
@@ -1128,6 +2415,62 @@ namespace LuaGlobalFunctions
         return 0;
     }
 
+    /**
+     * Creates a gossip menu that can be sent with [Player:GossipSendCachedMenu].
+     *
+     * The menu is built once, sending it fills and sends the [Player]'s menu in one call.
+     * Items are listed in the array part of the table. Their conditions are checked natively for
+     * each [Player] the menu is sent to and items whose conditions aren't met are left out.
+     *
+     *     local menu = CreateGossipMenu({
+     *         text = 100,          -- npc_text id
+     *         menuId = 0,          -- menu id, needed when a player sends the menu
+     *         quests = true,       -- adds the quests of the sender
+     *         { icon = 2, text = "Take me to Stormwind", sender = 1, intid = 1, raceMask = 0x44D },
+     *         { icon = 2, text = "Take me to Orgrimmar", sender = 1, intid = 2, raceMask = 0x2B2 },
+     *         { icon = 0, text = "Enter code", intid = 3, code = true, popup = "Code?", money = 0 },
+     *         { icon = 0, text = "GM menu", intid = 4, gm = true },
+     *     })
+     *
+     * Item conditions are `minLevel`, `maxLevel`, `raceMask`, `classMask`, `quest` (rewarded), `item` (in bags),
+     * `spell` (known) and `gm` (true for game masters only, false for others only).
+     *
+     * Raises an error if the menu is invalid.
+     *
+     * @param table menu : the menu definition
+     * @return uint32 menuId : ID of the created menu, valid until Eluna is reloaded
+     */
+    int CreateGossipMenu(Eluna* E, lua_State* L)
+    {
+        bool ok;
+        {
+            ElunaGossipMenus::Menu menu;
+            std::string error;
+            ok = ElunaGossipMenus::Build(L, 1, menu, error);
+            if (ok)
+                Eluna::Push(L, E->gossipMenus->Add(menu));
+            else
+                lua_pushfstring(L, "CreateGossipMenu: %s", error.c_str());
+        }
+
+        if (!ok)
+            return lua_error(L);
+        return 1;
+    }
+
+    /**
+     * Removes a gossip menu created with [Global:CreateGossipMenu].
+     *
+     * @param uint32 menuId : ID of the menu
+     * @return bool removed : true if the menu existed
+     */
+    int RemoveGossipMenu(Eluna* E, lua_State* L)
+    {
+        uint32 menuId = Eluna::CHECKVAL<uint32>(L, 1);
+        Eluna::Push(L, E->gossipMenus->Remove(menuId));
+        return 1;
+    }
+
     /**
      * Registers a global timed event.
      *
@@ -1525,18 +2868,21 @@ namespace LuaGlobalFunctions
     /**
      * Creates a [WorldPacket].
      *
+     * Packets are taken from a pool and return to it when garbage collected
+     * or when released with [WorldPacket:Release].
+     *
      * @param uint32 opcode : the opcode of the packet
      * @param uint32 size : the size of the packet
      * @return [WorldPacket] packet
      */
-    int CreatePacket(Eluna* /*E*/, lua_State* L)
+    int CreatePacket(Eluna* E, lua_State* L)
     {
         uint32 opcode = Eluna::CHECKVAL<uint32>(L, 1);
         size_t size = Eluna::CHECKVAL<size_t>(L, 2);
         if (opcode >= NUM_MSG_TYPES)
             return luaL_argerror(L, 1, "valid opcode expected");
 
-        Eluna::Push(L, new WorldPacket((OpcodesList)opcode, size));
+        Eluna::Push(L, E->packetPool->Acquire(opcode, size));
         return 1;
     }
 
@@ -2363,6 +3709,22 @@ namespace LuaGlobalFunctions
         uint32 entry = Eluna::CHECKVAL<uint32>(L, 1);
         uint32 event_type = Eluna::CHECKVAL<uint32>(L, 2);
         E->CreatureEventBindings->Clear(entry, event_type);
+        if (event_type == HookMgr::CREATURE_EVENT_ON_AIUPDATE || event_type == HookMgr::CREATURE_EVENT_ON_AIUPDATE_BATCH)
+            E->SetAIUpdateInterval(event_type, entry, 0);
+        else if (event_type == HookMgr::CREATURE_EVENT_ON_MOVE_IN_LOS)
+            E->SetMoveInLOSFilter(entry, NULL);
+        return 0;
+    }
+
+    /**
+     * Removes the behavior tree of a [Creature] entry, see [Global:RegisterCreatureBehaviorTree].
+     *
+     * @param uint32 entry : the ID of a [Creature] whose tree will be removed
+     */
+    int ClearCreatureBehaviorTree(Eluna* E, lua_State* L)
+    {
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 1);
+        E->SetBehaviorTree(entry, NULL);
         return 0;
     }
 
@@ -7,9 +7,16 @@
 #include "HookMgr.h"
 #include "LuaEngine.h"
 #include "ElunaBinding.h"
+#include "ElunaAIBatch.h"
+#include "ElunaBehaviorTree.h"
 #include "ElunaEventMgr.h"
+#include "ElunaObjectData.h"
+#include "ElunaPacketStats.h"
+#include "ElunaPersistentStore.h"
+#include "ElunaPlayerIndex.h"
 #include "ElunaIncludes.h"
 #include "ElunaTemplate.h"
+#include <new>
 
 extern "C"
 {
@@ -326,23 +333,112 @@ void Eluna::OnExpire(AuctionHouseObject* ah)
 }
 
 // Packet
+
+/*
+ * Pushes the core's packet to Lua without copying it.
+ *
+ * Each hook call gets its own userdata, so a packet kept from an earlier call stays invalid.
+ * Methods that modify the packet copy it first, so handlers can only change the core's packet by returning a packet.
+ * The ElunaObject is placed in the userdata after the usual pointer to it, so a call is a single Lua allocation.
+ * The __gc of WorldPacket destroys it in place.
+ */
+ElunaObject* Eluna::PushBorrowed(WorldPacket* packet)
+{
+    ElunaObject** ptrHold = static_cast<ElunaObject**>(lua_newuserdata(L, sizeof(ElunaObject*) + sizeof(ElunaObject)));
+    ElunaObject* obj = *ptrHold = new (ptrHold + 1) ElunaObject(packet, false);
+    obj->SetBorrowed(true);
+    luaL_getmetatable(L, ElunaTemplate<WorldPacket>::tname);
+    lua_setmetatable(L, -2);
+
+    ++push_counter;
+    return obj;
+}
+
+/*
+ * Ends the borrow of a packet pushed with PushBorrowed. Must be called before CleanUpStack.
+ *
+ * A packet kept with SetInvalidation(false) is detached from the core's packet by copying it,
+ * otherwise the userdata is invalidated.
+ */
+void Eluna::ReleaseBorrowed(ElunaObject* obj)
+{
+    if (!obj->IsBorrowed())
+        return;
+
+    if (obj->CanInvalidate())
+        obj->SetValid(false);
+    else
+    {
+        obj->SetObj(new WorldPacket(*static_cast<WorldPacket*>(obj->GetObj())));
+        obj->SetBorrowed(false);
+    }
+}
+
+/*
+ * Same as SetupStack for packet bindings, but skips handlers whose native filter doesn't match the packet.
+ */
+int Eluna::SetupPacketStack(HookMgr::PacketEvents event_id, WorldPacket const& packet, Player* player, ElunaPacketMatch const& match, int number_of_arguments)
+{
+    ASSERT(number_of_arguments == this->push_counter);
+    // Stack: [arguments]
+
+    Push(event_id);
+    this->push_counter = 0;
+    ++number_of_arguments;
+    // Stack: [arguments], event_id
+
+    int arguments_top = lua_gettop(L);
+    int first_argument_index = arguments_top - number_of_arguments + 1;
+    ASSERT(arguments_top >= number_of_arguments);
+
+    lua_insert(L, first_argument_index);
+    // Stack: event_id, [arguments]
+
+    PacketEventBindings->PushFuncRefs(L, (int)event_id, packet.GetOpcode(), &packet, player, &match);
+    // Stack: event_id, [arguments], [functions]
+
+    int number_of_functions = lua_gettop(L) - arguments_top;
+    return number_of_functions;
+}
+
 bool Eluna::OnPacketSend(WorldSession* session, WorldPacket& packet)
 {
     bool result = true;
     Player* player = NULL;
     if (session)
         player = session->GetPlayer();
-    OnPacketSendAny(player, packet, result);
-    OnPacketSendOne(player, packet, result);
+
+    uint32 opcode = packet.GetOpcode();
+    bool stats = packetStats->IsEnabled();
+    if (stats)
+        packetStats->RecordSeen(ElunaPacketStats::PACKET_STATS_SEND, opcode, packet.size());
+
+    // The filters are checked once here, the results are used when pushing the handlers
+    ElunaPacketMatch match;
+    bool matching = PacketEventBindings->MatchEvents(PACKET_EVENT_ON_PACKET_SEND, opcode, packet, player, match);
+    if (!ServerEventBindings->HasEvents(SERVER_EVENT_ON_PACKET_SEND) && !matching)
+        return result;
+
+    uint64 start = stats ? ElunaPacketStats::GetMicroTime() : 0;
+    bool replaced = OnPacketSendAny(player, packet, result);
+    // A replaced packet is checked again as the filters apply to the packet the handlers get
+    if (replaced)
+        matching = PacketEventBindings->MatchEvents(PACKET_EVENT_ON_PACKET_SEND, packet.GetOpcode(), packet, player, match);
+    if (matching)
+        replaced = OnPacketSendOne(player, packet, result, match) || replaced;
+    if (stats)
+        packetStats->RecordHooked(ElunaPacketStats::PACKET_STATS_SEND, opcode, ElunaPacketStats::GetMicroTime() - start, !result, replaced);
     return result;
 }
-void Eluna::OnPacketSendAny(Player* player, WorldPacket& packet, bool& result)
+bool Eluna::OnPacketSendAny(Player* player, WorldPacket& packet, bool& result)
 {
     if (!ServerEventBindings->HasEvents(SERVER_EVENT_ON_PACKET_SEND))
-        return;
+        return false;
 
     LOCK_ELUNA;
-    Push(new WorldPacket(packet));
+    size_t rpos = packet.rpos();
+    bool replaced = false;
+    ElunaObject* borrowed = PushBorrowed(&packet);
     Push(player);
     int n = SetupStack(ServerEventBindings, SERVER_EVENT_ON_PACKET_SEND, 2);
 
@@ -354,23 +450,32 @@ void Eluna::OnPacketSendAny(Player* player, WorldPacket& packet, bool& result)
             result = false;
 
         if (lua_isuserdata(L, r + 1))
-            if (WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true))
+        {
+            WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true);
+            if (data && data != &packet)
+            {
                 packet = *data;
+                replaced = true;
+            }
+        }
 
         lua_pop(L, 2);
     }
 
+    ReleaseBorrowed(borrowed);
+    if (!replaced)
+        packet.rpos(rpos);
     CleanUpStack(2);
+    return replaced;
 }
-void Eluna::OnPacketSendOne(Player* player, WorldPacket& packet, bool& result)
+bool Eluna::OnPacketSendOne(Player* player, WorldPacket& packet, bool& result, ElunaPacketMatch const& match)
 {
-    if (!PacketEventBindings->HasEvents(PACKET_EVENT_ON_PACKET_SEND, packet.GetOpcode()))
-        return;
-
     LOCK_ELUNA;
-    Push(new WorldPacket(packet));
+    size_t rpos = packet.rpos();
+    bool replaced = false;
+    ElunaObject* borrowed = PushBorrowed(&packet);
     Push(player);
-    int n = SetupStack(PacketEventBindings, PACKET_EVENT_ON_PACKET_SEND, OpcodesList(packet.GetOpcode()), 2);
+    int n = SetupPacketStack(PACKET_EVENT_ON_PACKET_SEND, packet, player, match, 2);
 
     while (n > 0)
     {
@@ -380,13 +485,23 @@ void Eluna::OnPacketSendOne(Player* player, WorldPacket& packet, bool& result)
             result = false;
 
         if (lua_isuserdata(L, r + 1))
-            if (WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true))
+        {
+            WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true);
+            if (data && data != &packet)
+            {
                 packet = *data;
+                replaced = true;
+            }
+        }
 
         lua_pop(L, 2);
     }
 
+    ReleaseBorrowed(borrowed);
+    if (!replaced)
+        packet.rpos(rpos);
     CleanUpStack(2);
+    return replaced;
 }
 
 bool Eluna::OnPacketReceive(WorldSession* session, WorldPacket& packet)
@@ -395,17 +510,38 @@ bool Eluna::OnPacketReceive(WorldSession* session, WorldPacket& packet)
     Player* player = NULL;
     if (session)
         player = session->GetPlayer();
-    OnPacketReceiveAny(player, packet, result);
-    OnPacketReceiveOne(player, packet, result);
+
+    uint32 opcode = packet.GetOpcode();
+    bool stats = packetStats->IsEnabled();
+    if (stats)
+        packetStats->RecordSeen(ElunaPacketStats::PACKET_STATS_RECEIVE, opcode, packet.size());
+
+    // The filters are checked once here, the results are used when pushing the handlers
+    ElunaPacketMatch match;
+    bool matching = PacketEventBindings->MatchEvents(PACKET_EVENT_ON_PACKET_RECEIVE, opcode, packet, player, match);
+    if (!ServerEventBindings->HasEvents(SERVER_EVENT_ON_PACKET_RECEIVE) && !matching)
+        return result;
+
+    uint64 start = stats ? ElunaPacketStats::GetMicroTime() : 0;
+    bool replaced = OnPacketReceiveAny(player, packet, result);
+    // A replaced packet is checked again as the filters apply to the packet the handlers get
+    if (replaced)
+        matching = PacketEventBindings->MatchEvents(PACKET_EVENT_ON_PACKET_RECEIVE, packet.GetOpcode(), packet, player, match);
+    if (matching)
+        replaced = OnPacketReceiveOne(player, packet, result, match) || replaced;
+    if (stats)
+        packetStats->RecordHooked(ElunaPacketStats::PACKET_STATS_RECEIVE, opcode, ElunaPacketStats::GetMicroTime() - start, !result, replaced);
     return result;
 }
-void Eluna::OnPacketReceiveAny(Player* player, WorldPacket& packet, bool& result)
+bool Eluna::OnPacketReceiveAny(Player* player, WorldPacket& packet, bool& result)
 {
     if (!ServerEventBindings->HasEvents(SERVER_EVENT_ON_PACKET_RECEIVE))
-        return;
+        return false;
 
     LOCK_ELUNA;
-    Push(new WorldPacket(packet));
+    size_t rpos = packet.rpos();
+    bool replaced = false;
+    ElunaObject* borrowed = PushBorrowed(&packet);
     Push(player);
     int n = SetupStack(ServerEventBindings, SERVER_EVENT_ON_PACKET_RECEIVE, 2);
 
@@ -417,23 +553,32 @@ void Eluna::OnPacketReceiveAny(Player* player, WorldPacket& packet, bool& result
             result = false;
 
         if (lua_isuserdata(L, r + 1))
-            if (WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true))
+        {
+            WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true);
+            if (data && data != &packet)
+            {
                 packet = *data;
+                replaced = true;
+            }
+        }
 
         lua_pop(L, 2);
     }
 
+    ReleaseBorrowed(borrowed);
+    if (!replaced)
+        packet.rpos(rpos);
     CleanUpStack(2);
+    return replaced;
 }
-void Eluna::OnPacketReceiveOne(Player* player, WorldPacket& packet, bool& result)
+bool Eluna::OnPacketReceiveOne(Player* player, WorldPacket& packet, bool& result, ElunaPacketMatch const& match)
 {
-    if (!PacketEventBindings->HasEvents(PACKET_EVENT_ON_PACKET_RECEIVE, packet.GetOpcode()))
-        return;
-
     LOCK_ELUNA;
-    Push(new WorldPacket(packet));
+    size_t rpos = packet.rpos();
+    bool replaced = false;
+    ElunaObject* borrowed = PushBorrowed(&packet);
     Push(player);
-    int n = SetupStack(PacketEventBindings, PACKET_EVENT_ON_PACKET_RECEIVE, OpcodesList(), 2);
+    int n = SetupPacketStack(PACKET_EVENT_ON_PACKET_RECEIVE, packet, player, match, 2);
 
     while (n > 0)
     {
@@ -443,13 +588,23 @@ void Eluna::OnPacketReceiveOne(Player* player, WorldPacket& packet, bool& result
             result = false;
 
         if (lua_isuserdata(L, r + 1))
-            if (WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true))
+        {
+            WorldPacket* data = CHECKOBJ<WorldPacket>(L, r + 1, true);
+            if (data && data != &packet)
+            {
                 packet = *data;
+                replaced = true;
+            }
+        }
 
         lua_pop(L, 2);
     }
 
+    ReleaseBorrowed(borrowed);
+    if (!replaced)
+        packet.rpos(rpos);
     CleanUpStack(2);
+    return replaced;
 }
 
 // AddOns
@@ -529,6 +684,7 @@ void Eluna::OnWorldUpdate(uint32 diff)
     }
 
     eventMgr->globalProcessor->Update(diff);
+    ElunaPersistentStore::Instance().Update(diff);
 
     if (!ServerEventBindings->HasEvents(WORLD_EVENT_ON_UPDATE))
         return;
@@ -723,12 +879,71 @@ bool Eluna::OnRemove(Player* pPlayer, Item* item)
 }
 
 // Player
+static void SendCommandMessage(Player* player, const char* message)
+{
+    if (player)
+        ChatHandler(player->GetSession()).SendSysMessage(message);
+    else
+        ELUNA_LOG_INFO("%s", message);
+}
+
+/*
+ * packetstats [on|off|reset|count]
+ * Prints the opcodes with the most Lua handler time, 10 by default.
+ */
+static void HandlePacketStatsCommand(Player* player, ElunaPacketStats* stats, std::string const& arg)
+{
+    if (arg == "on" || arg == "off")
+    {
+        stats->SetEnabled(arg == "on");
+        SendCommandMessage(player, arg == "on" ? "[Eluna]: Packet stats enabled" : "[Eluna]: Packet stats disabled");
+        return;
+    }
+    if (arg == "reset")
+    {
+        stats->Reset();
+        SendCommandMessage(player, "[Eluna]: Packet stats reset");
+        return;
+    }
+
+    uint32 count = arg.empty() ? 10 : uint32(atoi(arg.c_str()));
+    std::vector<ElunaPacketStats::Snapshot> snapshots;
+    stats->GetSnapshots(snapshots);
+
+    char buff[256];
+    snprintf(buff, sizeof(buff), "[Eluna]: Packet stats (%s), %u opcodes seen", stats->IsEnabled() ? "enabled" : "disabled", uint32(snapshots.size()));
+    SendCommandMessage(player, buff);
+    for (uint32 i = 0; i < snapshots.size() && i < count; ++i)
+    {
+        ElunaPacketStats::Snapshot const& s = snapshots[i];
+        snprintf(buff, sizeof(buff), "%s 0x%04X: seen %llu hooked %llu bytes %llu time %lluus p50 %uus p99 %uus dropped %llu replaced %llu",
+            s.direction == ElunaPacketStats::PACKET_STATS_SEND ? "send" : "recv", s.opcode,
+            (unsigned long long)s.seen, (unsigned long long)s.hooked, (unsigned long long)s.bytes, (unsigned long long)s.time,
+            s.p50, s.p99, (unsigned long long)s.dropped, (unsigned long long)s.replaced);
+        SendCommandMessage(player, buff);
+    }
+}
+
 bool Eluna::OnCommand(Player* player, const char* text)
 {
     // If from console, player is NULL
     std::string fullcmd(text);
     if (!player || player->GetSession()->GetSecurity() >= SEC_ADMINISTRATOR)
     {
+        std::string::size_type split = fullcmd.find(' ');
+        std::string command = fullcmd.substr(0, split);
+        std::string::size_type argStart = fullcmd.find_first_not_of(' ', split);
+        std::string arg;
+        if (argStart != std::string::npos)
+            arg = fullcmd.substr(argStart, fullcmd.find(' ', argStart) - argStart);
+        std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+        std::transform(arg.begin(), arg.end(), arg.begin(), ::tolower);
+        if (command == "packetstats")
+        {
+            HandlePacketStatsCommand(player, packetStats, arg);
+            return false;
+        }
+
         char* creload = strtok((char*)text, " ");
         char* celuna = strtok(NULL, "");
         if (creload && celuna)
@@ -1105,6 +1320,8 @@ void Eluna::OnSpellCast(Player* pPlayer, Spell* pSpell, bool skipCheck)
 
 void Eluna::OnLogin(Player* pPlayer)
 {
+    playerIndex->Add(pPlayer);
+
     if (!PlayerEventBindings->HasEvents(PLAYER_EVENT_ON_LOGIN))
         return;
 
@@ -1115,6 +1332,9 @@ void Eluna::OnLogin(Player* pPlayer)
 
 void Eluna::OnLogout(Player* pPlayer)
 {
+    playerIndex->Remove(pPlayer);
+    objectData->Erase(ElunaObjectData::STORE_OBJECT, pPlayer->GET_GUID());
+
     if (!PlayerEventBindings->HasEvents(PLAYER_EVENT_ON_LOGOUT))
         return;
 
@@ -1168,6 +1388,8 @@ void Eluna::OnBindToInstance(Player* pPlayer, Difficulty difficulty, uint32 mapi
 
 void Eluna::OnUpdateZone(Player* pPlayer, uint32 newZone, uint32 newArea)
 {
+    playerIndex->UpdateZone(pPlayer, newZone);
+
     if (!PlayerEventBindings->HasEvents(PLAYER_EVENT_ON_UPDATE_ZONE))
         return;
 
@@ -1180,6 +1402,8 @@ void Eluna::OnUpdateZone(Player* pPlayer, uint32 newZone, uint32 newArea)
 
 void Eluna::OnMapChanged(Player* player)
 {
+    playerIndex->UpdateMap(player, player->GetMapId(), player->GetInstanceId());
+
     if (!PlayerEventBindings->HasEvents(PLAYER_EVENT_ON_MAP_CHANGE))
         return;
 
@@ -1672,6 +1896,9 @@ void Eluna::OnCreate(Map* map)
 }
 void Eluna::OnDestroy(Map* map)
 {
+    objectData->Erase(ElunaObjectData::STORE_MAP, ElunaObjectData::MakeMapKey(map->GetId(), map->GetInstanceId()));
+    aiBatch->Erase(ElunaObjectData::MakeMapKey(map->GetId(), map->GetInstanceId()));
+
     if (!ServerEventBindings->HasEvents(MAP_EVENT_ON_DESTROY))
         return;
 
@@ -1681,6 +1908,8 @@ void Eluna::OnDestroy(Map* map)
 }
 void Eluna::OnPlayerEnter(Map* map, Player* player)
 {
+    playerIndex->UpdateMap(player, map->GetId(), map->GetInstanceId());
+
     if (!ServerEventBindings->HasEvents(MAP_EVENT_ON_PLAYER_ENTER))
         return;
 
@@ -1699,8 +1928,96 @@ void Eluna::OnPlayerLeave(Map* map, Player* player)
     Push(player);
     CallAllFunctions(ServerEventBindings, MAP_EVENT_ON_PLAYER_LEAVE);
 }
+/*
+ * Runs the CREATURE_EVENT_ON_AIUPDATE_BATCH handlers of the map instance, once per entry.
+ * Handlers get (event, creatures, diff, snapshot) where snapshot holds arrays with the health
+ * percent, combat state and victim of each creature at the same index as in creatures.
+ * The victim is false when the creature has none.
+ */
+void Eluna::RunAIBatches(Map* map, uint32 diff)
+{
+    std::vector<ElunaAIBatch::Batch> due;
+    aiBatch->Take(ElunaObjectData::MakeMapKey(map->GetId(), map->GetInstanceId()), diff, due);
+    if (due.empty())
+        return;
+
+    LOCK_ELUNA;
+    for (std::vector<ElunaAIBatch::Batch>::const_iterator it = due.begin(); it != due.end(); ++it)
+    {
+        if (!CreatureEventBindings->HasEvents(CREATURE_EVENT_ON_AIUPDATE_BATCH, it->entry))
+            continue;
+
+        lua_createtable(L, int(it->guids.size()), 0);
+        int creatures = lua_gettop(L);
+        lua_createtable(L, 0, 3);
+        int snapshot = lua_gettop(L);
+        lua_createtable(L, int(it->guids.size()), 0);
+        lua_createtable(L, int(it->guids.size()), 0);
+        lua_createtable(L, int(it->guids.size()), 0);
+        // Stack: creatures, snapshot, health, combat, victim
+
+        int count = 0;
+        for (std::vector<uint64>::const_iterator guid = it->guids.begin(); guid != it->guids.end(); ++guid)
+        {
+#ifndef TRINITY
+            WorldObject* obj = map->GetWorldObject(ObjectGuid(*guid));
+            Creature* creature = obj ? obj->ToCreature() : NULL;
+#else
+            Creature* creature = sObjectAccessor->GetObjectInMap(ObjectGuid(*guid), map, (Creature*)NULL);
+#endif
+            if (!creature || !creature->IsInWorld())
+                continue;
+
+            ++count;
+            Push(L, creature);
+            lua_rawseti(L, creatures, count);
+#ifndef TRINITY
+            Push(L, creature->GetHealthPercent());
+#else
+            Push(L, creature->GetHealthPct());
+#endif
+            lua_rawseti(L, snapshot + 1, count);
+#ifdef CMANGOS
+            Push(L, creature->isInCombat());
+#else
+            Push(L, creature->IsInCombat());
+#endif
+            lua_rawseti(L, snapshot + 2, count);
+#ifndef TRINITY
+            Unit* victim = creature->getVictim();
+#else
+            Unit* victim = creature->GetVictim();
+#endif
+            if (victim)
+                Push(L, victim);
+            else
+                Push(L, false);
+            lua_rawseti(L, snapshot + 3, count);
+        }
+
+        lua_setfield(L, snapshot, "victim");
+        lua_setfield(L, snapshot, "combat");
+        lua_setfield(L, snapshot, "health");
+        // Stack: creatures, snapshot
+
+        if (!count)
+        {
+            lua_pop(L, 2);
+            continue;
+        }
+
+        Push(L, it->elapsed);
+        lua_insert(L, snapshot);
+        // Stack: creatures, diff, snapshot
+        push_counter += 3;
+        CallAllFunctions(CreatureEventBindings, CREATURE_EVENT_ON_AIUPDATE_BATCH, it->entry);
+    }
+}
+
 void Eluna::OnUpdate(Map* map, uint32 diff)
 {
+    RunAIBatches(map, diff);
+
     if (!ServerEventBindings->HasEvents(MAP_EVENT_ON_UPDATE))
         return;
 
@@ -1713,6 +2030,8 @@ void Eluna::OnUpdate(Map* map, uint32 diff)
 }
 void Eluna::OnRemove(GameObject* gameobject)
 {
+    objectData->Erase(ElunaObjectData::STORE_OBJECT, gameobject->GET_GUID());
+
     if (!ServerEventBindings->HasEvents(WORLD_EVENT_ON_DELETE_GAMEOBJECT))
         return;
 
@@ -1722,6 +2041,9 @@ void Eluna::OnRemove(GameObject* gameobject)
 }
 void Eluna::OnRemove(Creature* creature)
 {
+    // Pets, vehicles and summons can leave the world and come back, the data is kept until the object is deleted
+    objectData->Erase(ElunaObjectData::STORE_OBJECT, creature->GET_GUID());
+
     if (!ServerEventBindings->HasEvents(WORLD_EVENT_ON_DELETE_CREATURE))
         return;
 
@@ -1853,15 +2175,51 @@ bool Eluna::OnSummoned(Creature* pCreature, Unit* pSummoner)
     return CallAllFunctionsBool(CreatureEventBindings, CREATURE_EVENT_ON_SUMMONED, pCreature->GetEntry());
 }
 
-bool Eluna::UpdateAI(Creature* me, const uint32 diff)
+void Eluna::UpdateBehaviorTree(Creature* me, const uint32 diff, ElunaBehaviorState& state)
 {
+    // Held for the run so the tree can be replaced or cleared meanwhile
+    std::shared_ptr<ElunaBehaviorTree> tree = GetBehaviorTree(me->GetEntry());
+    if (tree)
+        tree->Update(me, diff, state);
+}
+
+// With an update interval set for the entry the handlers are called at most once per interval
+// with the time accumulated since the previous call. The first call is staggered by guid so
+// creatures spawned together don't all update on the same tick. Skipped updates reuse the last result.
+bool Eluna::UpdateAI(Creature* me, const uint32 diff, ElunaAIUpdateState& state)
+{
+    if (CreatureEventBindings->HasEvents(CREATURE_EVENT_ON_AIUPDATE_BATCH, me->GetEntry()))
+        aiBatch->Add(ElunaObjectData::MakeMapKey(me->GetMapId(), me->GetInstanceId()), me->GetEntry(), me->GET_GUID(), GetAIUpdateInterval(CREATURE_EVENT_ON_AIUPDATE_BATCH, me->GetEntry()));
+
     if (!CreatureEventBindings->HasEvents(CREATURE_EVENT_ON_AIUPDATE, me->GetEntry()))
+    {
+        state.elapsed = 0;
+        state.result = false;
         return false;
+    }
+
+    state.elapsed += diff;
+    if (uint32 interval = GetAIUpdateInterval(CREATURE_EVENT_ON_AIUPDATE, me->GetEntry()))
+    {
+        if (!state.timer)
+            state.timer = 1 + me->GetGUIDLow() % interval;
+
+        if (state.timer > diff)
+        {
+            state.timer -= diff;
+            return state.result;
+        }
+        state.timer = interval;
+    }
+
+    uint32 elapsed = state.elapsed;
+    state.elapsed = 0;
 
     LOCK_ELUNA;
     Push(me);
-    Push(diff);
-    return CallAllFunctionsBool(CreatureEventBindings, CREATURE_EVENT_ON_AIUPDATE, me->GetEntry());
+    Push(elapsed);
+    state.result = CallAllFunctionsBool(CreatureEventBindings, CREATURE_EVENT_ON_AIUPDATE, me->GetEntry());
+    return state.result;
 }
 
 //Called for reaction at enter to combat if not in combat yet (enemy can be NULL)
@@ -2088,6 +2446,21 @@ bool Eluna::MoveInLineOfSight(Creature* me, Unit* who)
     if (!CreatureEventBindings->HasEvents(CREATURE_EVENT_ON_MOVE_IN_LOS, me->GetEntry()))
         return false;
 
+    // The filter set when registering rejects most calls before taking the Eluna lock
+    uint32 cooldown = 0;
+    {
+        ElunaBind::ReadGuard guard(CreatureEventBindings->GetLock());
+        std::map<uint32, ElunaUtil::MoveInLOSFilter*>::const_iterator itr = moveInLOSFilters.find(me->GetEntry());
+        if (itr != moveInLOSFilters.end())
+        {
+            if (!(*itr->second)(me, who))
+                return false;
+            cooldown = itr->second->cooldown;
+        }
+    }
+    if (cooldown && !moveInLOSCooldowns->Check(me->GET_GUID(), who->GET_GUID(), cooldown))
+        return false;
+
     LOCK_ELUNA;
     Push(me);
     Push(who);
@@ -2097,6 +2470,9 @@ bool Eluna::MoveInLineOfSight(Creature* me, Unit* who)
 // Called on creature initial spawn, respawn, death, evade (leave combat)
 void Eluna::On_Reset(Creature* me) // Not an override, custom
 {
+    me->elunaEvents->ResetWatchers();
+    me->elunaEvents->ClearAbilities();
+
     if (!CreatureEventBindings->HasEvents(CREATURE_EVENT_ON_RESET, me->GetEntry()))
         return;
 
@@ -2182,6 +2558,9 @@ struct ElunaCreatureAI : ScriptedAI
     }
     ~ElunaCreatureAI() { }
 
+    ElunaAIUpdateState aiUpdateState;
+    ElunaBehaviorState behaviorState;
+
     //Called at World update tick
 #ifndef TRINITY
     void UpdateAI(const uint32 diff) override
@@ -2189,7 +2568,8 @@ struct ElunaCreatureAI : ScriptedAI
     void UpdateAI(uint32 diff) override
 #endif
     {
-        if (!sEluna->UpdateAI(me, diff))
+        sEluna->UpdateBehaviorTree(me, diff, behaviorState);
+        if (!sEluna->UpdateAI(me, diff, aiUpdateState))
         {
 #ifdef TRINITY
             if (!me->HasFlag(UNIT_FIELD_FLAGS, UNIT_FLAG_IMMUNE_TO_NPC))
@@ -2261,6 +2641,7 @@ struct ElunaCreatureAI : ScriptedAI
     // Called for reaction at stopping attack at no attackers or targets
     void EnterEvadeMode() override
     {
+        behaviorState = ElunaBehaviorState();
         if (!sEluna->EnterEvadeMode(me))
             ScriptedAI::EnterEvadeMode();
     }
@@ -2275,6 +2656,7 @@ struct ElunaCreatureAI : ScriptedAI
     // Called when creature is spawned or respawned (for reseting variables)
     void JustRespawned() override
     {
+        behaviorState = ElunaBehaviorState();
         if (!sEluna->JustRespawned(me))
             ScriptedAI::JustRespawned();
     }
@@ -2547,7 +2929,7 @@ void Eluna::OnRemoveFromWorld(GameObject* gameobject)
 
 CreatureAI* Eluna::GetAI(Creature* creature)
 {
-    if (!CreatureEventBindings->HasEvents(creature->GetEntry()))
+    if (!CreatureEventBindings->HasEvents(creature->GetEntry()) && !GetBehaviorTree(creature->GetEntry()))
         return NULL;
     return new ElunaCreatureAI(creature);
 }
@@ -209,7 +209,7 @@ namespace HookMgr
         CREATURE_EVENT_ON_OWNER_ATTACKED_AT               = 13, // (event, creature, attacker)  // Not on mangos
         CREATURE_EVENT_ON_HIT_BY_SPELL                    = 14, // (event, creature, caster, spellid)
         CREATURE_EVENT_ON_SPELL_HIT_TARGET                = 15, // (event, creature, target, spellid)
-        // UNUSED                                         = 16, // (event, creature)
+        CREATURE_EVENT_ON_AIUPDATE_BATCH                  = 16, // (event, creatures, diff, snapshot)
         // UNUSED                                         = 17, // (event, creature)
         // UNUSED                                         = 18, // (event, creature)
         CREATURE_EVENT_ON_JUST_SUMMONED_CREATURE          = 19, // (event, creature, summon)
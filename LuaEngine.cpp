@@ -7,7 +7,17 @@
 #include "HookMgr.h"
 #include "LuaEngine.h"
 #include "ElunaBinding.h"
+#include "ElunaAIBatch.h"
+#include "ElunaBehaviorTree.h"
 #include "ElunaEventMgr.h"
+#include "ElunaGossipMenu.h"
+#include "ElunaPacketPool.h"
+#include "ElunaObjectData.h"
+#include "ElunaPacketStats.h"
+#include "ElunaPersistentStore.h"
+#include "ElunaPlayerIndex.h"
+#include "ElunaQueryCache.h"
+#include "ElunaSerializer.h"
 #include "ElunaIncludes.h"
 #include "ElunaTemplate.h"
 #include "ElunaUtility.h"
@@ -28,6 +38,7 @@ extern "C"
 
 // Additional lua libraries
 };
+#include "zlib.h"
 
 Eluna::ScriptList Eluna::lua_scripts;
 Eluna::ScriptList Eluna::lua_extensions;
@@ -64,6 +75,11 @@ void Eluna::Initialize()
 
     ELUNA_LOG_DEBUG("[Eluna]: Loaded %u scripts in %u ms", uint32(lua_scripts.size() + lua_extensions.size()), ElunaUtil::GetTimeDiff(oldMSTime));
 
+    // Loaded before the scripts run, stays open over reloads
+    std::string storeFile = eConfigMgr->GetStringDefault("Eluna.Store.File", "eluna_store.log");
+    if (!storeFile.empty())
+        ElunaPersistentStore::Instance().Open(storeFile, eConfigMgr->GetIntDefault("Eluna.Store.SyncInterval", 1000));
+
     initialized = true;
 
     // Create global eluna
@@ -74,6 +90,9 @@ void Eluna::Uninitialize()
 {
     ASSERT(initialized);
 
+    // Writes the pending records before shutdown instead of leaving them to static destruction
+    ElunaPersistentStore::Instance().Close();
+
     delete GEluna;
     GEluna = NULL;
 
@@ -87,6 +106,17 @@ void Eluna::ReloadEluna()
 {
     eWorld->SendServerMessage(SERVER_MSG_STRING, "Reloading Eluna...");
 
+    std::map<std::string, std::string> persistentTables;
+    std::vector<ElunaSavedTimer> timers;
+    sEluna->SavePersistentTables(persistentTables);
+    sEluna->eventMgr->SaveTimers(sEluna->L, timers);
+    for (std::vector<ElunaSavedTimer>::iterator it = timers.begin(); it != timers.end(); ++it)
+    {
+        std::map<std::string, uint32>::const_iterator hash = sEluna->scriptHashes.find(it->source);
+        if (hash != sEluna->scriptHashes.end())
+            it->sourceHash = hash->second;
+    }
+
     EventMgr::ProcessorSet oldProcessors;
     {
         EventMgr::ReadGuard guard(sEluna->eventMgr->GetLock());
@@ -99,9 +129,14 @@ void Eluna::ReloadEluna()
         sEluna->eventMgr->processors.insert(oldProcessors.begin(), oldProcessors.end());
     }
 
+    // Restored before the scripts run so they can pick up their tables
+    sEluna->RestorePersistentTables(persistentTables);
+
     // in multithread foreach: run scripts
     sEluna->RunScripts();
 
+    sEluna->ReattachTimers(timers);
+
 #ifdef TRINITY
     // Re initialize creature AI restoring C++ AI or applying lua AI
     {
@@ -116,12 +151,24 @@ void Eluna::ReloadEluna()
 }
 
 Eluna::Eluna() :
+
 L(luaL_newstate()),
 
 event_level(0),
 push_counter(0),
 
 eventMgr(NULL),
+queryCache(new ElunaQueryCache(
+    eConfigMgr->GetIntDefault("Eluna.QueryCache.TTL", 60000),
+    eConfigMgr->GetIntDefault("Eluna.QueryCache.MaxEntries", 1024),
+    size_t(eConfigMgr->GetIntDefault("Eluna.QueryCache.MaxMemory", 16384)) * 1024)),
+packetStats(new ElunaPacketStats(NUM_MSG_TYPES, eConfigMgr->GetIntDefault("Eluna.PacketStats", 0) != 0)),
+packetPool(new ElunaPacketPool(eConfigMgr->GetIntDefault("Eluna.PacketPool.MaxPerClass", 64))),
+playerIndex(new ElunaPlayerIndex()),
+objectData(new ElunaObjectData()),
+aiBatch(new ElunaAIBatch()),
+gossipMenus(new ElunaGossipMenus()),
+moveInLOSCooldowns(new ElunaUtil::CooldownCache(eConfigMgr->GetIntDefault("Eluna.MoveInLOS.CooldownEntries", 4096))),
 
 ServerEventBindings(new EventBind<HookMgr::ServerEvents>("ServerEvents", *this)),
 PlayerEventBindings(new EventBind<HookMgr::PlayerEvents>("PlayerEvents", *this)),
@@ -130,7 +177,7 @@ GroupEventBindings(new EventBind<HookMgr::GroupEvents>("GroupEvents", *this)),
 VehicleEventBindings(new EventBind<HookMgr::VehicleEvents>("VehicleEvents", *this)),
 BGEventBindings(new EventBind<HookMgr::BGEvents>("BGEvents", *this)),
 
-PacketEventBindings(new EntryBind<HookMgr::PacketEvents>("PacketEvents", *this)),
+PacketEventBindings(new EntryBind<HookMgr::PacketEvents>("PacketEvents", *this, NUM_MSG_TYPES)),
 CreatureEventBindings(new EntryBind<HookMgr::CreatureEvents>("CreatureEvents", *this)),
 CreatureGossipBindings(new EntryBind<HookMgr::GossipEvents>("GossipEvents (creature)", *this)),
 GameObjectEventBindings(new EntryBind<HookMgr::GameObjectEvents>("GameObjectEvents", *this)),
@@ -155,6 +202,10 @@ playerGossipBindings(new EntryBind<HookMgr::GossipEvents>("GossipEvents (player)
     lua_setmetatable(L, -2);
     lua_setglobal(L, ELUNA_OBJECT_STORE);
 
+    // Create hidden table for tables kept over reloads
+    lua_newtable(L);
+    lua_setglobal(L, ELUNA_PERSISTENT_TABLES);
+
     // Set lua require folder paths (scripts folder structure)
     lua_getglobal(L, "package");
     lua_pushstring(L, lua_requirepath.c_str());
@@ -163,6 +214,9 @@ playerGossipBindings(new EntryBind<HookMgr::GossipEvents>("GossipEvents (player)
     lua_setfield(L, -2, "cpath");
     lua_pop(L, 1);
 
+    // Players are already online when reloading
+    playerIndex->Rebuild();
+
     // Replace this with map insert if making multithread version
     //
 
@@ -178,6 +232,34 @@ Eluna::~Eluna()
     delete eventMgr;
     eventMgr = NULL;
 
+    delete queryCache;
+    queryCache = NULL;
+
+    delete packetStats;
+    packetStats = NULL;
+
+    delete playerIndex;
+    playerIndex = NULL;
+
+    delete objectData;
+    objectData = NULL;
+
+    delete aiBatch;
+    aiBatch = NULL;
+
+    delete gossipMenus;
+    gossipMenus = NULL;
+
+    delete moveInLOSCooldowns;
+    moveInLOSCooldowns = NULL;
+
+    for (std::map<uint32, ElunaUtil::MoveInLOSFilter*>::const_iterator itr = moveInLOSFilters.begin(); itr != moveInLOSFilters.end(); ++itr)
+        delete itr->second;
+    moveInLOSFilters.clear();
+
+    // The trees hold Lua references and must go before the state is closed
+    behaviorTrees.clear();
+
     // Replace this with map remove if making multithread version
     //
 
@@ -215,6 +297,10 @@ Eluna::~Eluna()
 
     // Must close lua state after deleting stores and mgr
     lua_close(L);
+
+    // Collected packets are returned to the pool while closing the state
+    delete packetPool;
+    packetPool = NULL;
 }
 
 void Eluna::AddScriptPath(std::string filename, const std::string& fullpath)
@@ -345,6 +431,69 @@ void Eluna::GetScripts(std::string path)
 #endif
 }
 
+static std::string GetFunctionKey(std::string const& source, int line, int lastLine)
+{
+    char lines[32];
+    snprintf(lines, sizeof(lines), ":%d-%d", line, lastLine);
+    return source + lines;
+}
+
+// Returns 0 if the file can't be read
+static uint32 GetFileHash(std::string const& path)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return 0;
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(buffer), uInt(read));
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok ? uint32(crc) : 0;
+}
+
+// Indexes the Lua function at fn and the functions in its upvalues by where they are defined
+static void IndexFunction(lua_State* L, int index, int fn, int depth)
+{
+    if (!lua_isfunction(L, fn) || lua_iscfunction(L, fn))
+        return;
+
+    lua_Debug ar;
+    lua_pushvalue(L, fn);
+    lua_getinfo(L, ">S", &ar);
+    std::string key = GetFunctionKey(ar.source, ar.linedefined, ar.lastlinedefined);
+
+    lua_getfield(L, index, key.c_str());
+    bool known = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (known)
+        return;
+
+    lua_pushvalue(L, fn);
+    lua_setfield(L, index, key.c_str());
+
+    if (depth <= 0)
+        return;
+    for (int i = 1; lua_getupvalue(L, fn, i); ++i)
+    {
+        IndexFunction(L, index, lua_gettop(L), depth - 1);
+        lua_pop(L, 1);
+    }
+}
+
+static void IndexTableFunctions(lua_State* L, int index, int tbl, int depth)
+{
+    lua_pushnil(L);
+    while (lua_next(L, tbl))
+    {
+        IndexFunction(L, index, lua_gettop(L), depth);
+        lua_pop(L, 1);
+    }
+}
+
 static bool ScriptPathComparator(const LuaScript& first, const LuaScript& second)
 {
     return first.filepath.compare(second.filepath) < 0;
@@ -384,6 +533,8 @@ void Eluna::RunScripts()
             continue;
         }
         lua_pop(L, 1);
+        if (uint32 hash = GetFileHash(it->filepath))
+            scriptHashes["@" + it->filepath] = hash;
         if (!luaL_loadfile(L, it->filepath.c_str()) && !lua_pcall(L, 0, 1, 0))
         {
             if (lua_isnoneornil(L, -1) || (lua_isboolean(L, -1) && !lua_toboolean(L, -1)))
@@ -408,6 +559,100 @@ void Eluna::RunScripts()
     OnLuaStateOpen();
 }
 
+void Eluna::SavePersistentTables(std::map<std::string, std::string>& tables)
+{
+    lua_getglobal(L, ELUNA_PERSISTENT_TABLES);
+    int tbl = lua_gettop(L);
+
+    lua_pushnil(L);
+    while (lua_next(L, tbl))
+    {
+        if (lua_type(L, -2) != LUA_TSTRING)
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        std::string name = lua_tostring(L, -2);
+        std::string error;
+        if (!ElunaSerializer::Serialize(L, -1, tables[name], error))
+        {
+            ELUNA_LOG_ERROR("[Eluna]: Persistent table `%s` is not kept over the reload: %s", name.c_str(), error.c_str());
+            tables.erase(name);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+void Eluna::RestorePersistentTables(std::map<std::string, std::string> const& tables)
+{
+    lua_getglobal(L, ELUNA_PERSISTENT_TABLES);
+    int tbl = lua_gettop(L);
+
+    for (std::map<std::string, std::string>::const_iterator it = tables.begin(); it != tables.end(); ++it)
+    {
+        std::string error;
+        if (ElunaSerializer::Deserialize(L, it->second.data(), it->second.size(), error))
+            lua_setfield(L, tbl, it->first.c_str());
+        else
+            ELUNA_LOG_ERROR("[Eluna]: Could not restore persistent table `%s`: %s", it->first.c_str(), error.c_str());
+    }
+    lua_pop(L, 1);
+}
+
+void Eluna::ReattachTimers(std::vector<ElunaSavedTimer> const& timers)
+{
+    if (timers.empty())
+        return;
+
+    // The reloaded functions are found through the registered handlers, the globals and the modules
+    lua_newtable(L);
+    int index = lua_gettop(L);
+    IndexTableFunctions(L, index, LUA_REGISTRYINDEX, 2);
+    lua_pushglobaltable(L);
+    IndexTableFunctions(L, index, lua_gettop(L), 2);
+    lua_getglobal(L, "package");
+    luaL_getsubtable(L, -1, "loaded");
+    int modules = lua_gettop(L);
+    lua_pushnil(L);
+    while (lua_next(L, modules))
+    {
+        if (lua_istable(L, -1))
+            IndexTableFunctions(L, index, lua_gettop(L), 2);
+        lua_pop(L, 1);
+    }
+
+    uint32 count = 0;
+    {
+        EventMgr::ReadGuard guard(eventMgr->GetLock());
+        for (std::vector<ElunaSavedTimer>::const_iterator it = timers.begin(); it != timers.end(); ++it)
+        {
+            if (eventMgr->processors.find(it->processor) == eventMgr->processors.end())
+                continue;
+
+            // A function at the same lines of an edited file can be a different one
+            std::map<std::string, uint32>::const_iterator hash = scriptHashes.find(it->source);
+            if (!it->sourceHash || hash == scriptHashes.end() || hash->second != it->sourceHash)
+                continue;
+
+            lua_getfield(L, index, GetFunctionKey(it->source, it->line, it->lastLine).c_str());
+            if (!lua_isfunction(L, -1))
+            {
+                lua_pop(L, 1);
+                continue;
+            }
+
+            int functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            it->processor->AddEvent(functionRef, it->delay, it->calls, it->remaining);
+            ++count;
+        }
+    }
+    lua_settop(L, index - 1);
+
+    ELUNA_LOG_INFO("[Eluna]: Reattached %u of %u WorldObject timed events", count, uint32(timers.size()));
+}
+
 void Eluna::InvalidateObjects()
 {
     lua_getglobal(L, ELUNA_OBJECT_STORE);
@@ -423,6 +668,63 @@ void Eluna::InvalidateObjects()
     lua_pop(L, 1);
 }
 
+void Eluna::SetAIUpdateInterval(uint32 event_id, uint32 entry, uint32 interval)
+{
+    ElunaBind::WriteGuard guard(CreatureEventBindings->GetLock());
+
+    if (interval)
+        aiUpdateIntervals[std::make_pair(event_id, entry)] = interval;
+    else
+        aiUpdateIntervals.erase(std::make_pair(event_id, entry));
+}
+
+uint32 Eluna::GetAIUpdateInterval(uint32 event_id, uint32 entry)
+{
+    ElunaBind::ReadGuard guard(CreatureEventBindings->GetLock());
+
+    std::map<std::pair<uint32, uint32>, uint32>::const_iterator itr = aiUpdateIntervals.find(std::make_pair(event_id, entry));
+    return itr != aiUpdateIntervals.end() ? itr->second : 0;
+}
+
+void Eluna::SetMoveInLOSFilter(uint32 entry, ElunaUtil::MoveInLOSFilter const* filter)
+{
+    ElunaBind::WriteGuard guard(CreatureEventBindings->GetLock());
+
+    std::map<uint32, ElunaUtil::MoveInLOSFilter*>::iterator itr = moveInLOSFilters.find(entry);
+    if (itr != moveInLOSFilters.end())
+    {
+        delete itr->second;
+        moveInLOSFilters.erase(itr);
+    }
+    if (filter)
+        moveInLOSFilters[entry] = new ElunaUtil::MoveInLOSFilter(*filter);
+}
+
+bool Eluna::HasMoveInLOSFilter(uint32 entry)
+{
+    ElunaBind::ReadGuard guard(CreatureEventBindings->GetLock());
+
+    return moveInLOSFilters.find(entry) != moveInLOSFilters.end();
+}
+
+void Eluna::SetBehaviorTree(uint32 entry, ElunaBehaviorTree* tree)
+{
+    ElunaBind::WriteGuard guard(CreatureEventBindings->GetLock());
+
+    if (tree)
+        behaviorTrees[entry].reset(tree);
+    else
+        behaviorTrees.erase(entry);
+}
+
+std::shared_ptr<ElunaBehaviorTree> Eluna::GetBehaviorTree(uint32 entry)
+{
+    ElunaBind::ReadGuard guard(CreatureEventBindings->GetLock());
+
+    std::map<uint32, std::shared_ptr<ElunaBehaviorTree> >::const_iterator itr = behaviorTrees.find(entry);
+    return itr != behaviorTrees.end() ? itr->second : std::shared_ptr<ElunaBehaviorTree>();
+}
+
 void Eluna::report(lua_State* luastate)
 {
     const char* msg = lua_tostring(luastate, -1);
@@ -430,36 +732,45 @@ void Eluna::report(lua_State* luastate)
     lua_pop(luastate, 1);
 }
 
-void Eluna::ExecuteCall(int params, int res)
+void Eluna::ExecuteCall(lua_State* luastate, int params, int res)
 {
-    int top = lua_gettop(L);
+    int top = lua_gettop(luastate);
 
     // Expected: function, [parameters]
     ASSERT(top > params);
 
     // Check function type
-    int type = lua_type(L, top - params);
+    int type = lua_type(luastate, top - params);
     if (type != LUA_TFUNCTION)
     {
-        ELUNA_LOG_ERROR("[Eluna]: Cannot execute call: registered value is %s, not a function.", lua_typename(L, type));
+        ELUNA_LOG_ERROR("[Eluna]: Cannot execute call: registered value is %s, not a function.", lua_typename(luastate, type));
         ASSERT(false);
     }
 
     // Objects are invalidated when event level hits 0
     ++event_level;
-    int result = lua_pcall(L, params, res, 0);
+    int result = lua_pcall(luastate, params, res, 0);
     --event_level;
 
     // lua_pcall returns 0 on success.
     // On error we report errors and push nils for expected amount of returned values
     if (result)
     {
-        report(L);
+        report(luastate);
         for (int i = 0; i < res; ++i)
-            lua_pushnil(L);
+            lua_pushnil(luastate);
     }
 }
 
+bool Eluna::CallForEach(lua_State* luastate, int params)
+{
+    ExecuteCall(luastate, params, 1);
+
+    bool stop = lua_isboolean(luastate, -1) && !lua_toboolean(luastate, -1);
+    lua_pop(luastate, 1);
+    return !stop;
+}
+
 void Eluna::Push(lua_State* luastate)
 {
     lua_pushnil(luastate);
@@ -761,7 +1072,7 @@ ElunaObject* Eluna::CHECKTYPE(lua_State* luastate, int narg, const char* tname,
 }
 
 // Saves the function reference ID given to the register type's store for given entry under the given event
-void Eluna::Register(uint8 regtype, uint32 id, uint32 evt, int functionRef, uint32 shots)
+void Eluna::Register(uint8 regtype, uint32 id, uint32 evt, int functionRef, uint32 shots, ElunaUtil::PacketFilter const* packetFilter)
 {
     switch (regtype)
     {
@@ -819,11 +1130,11 @@ void Eluna::Register(uint8 regtype, uint32 id, uint32 evt, int functionRef, uint
                 if (id >= NUM_MSG_TYPES)
                 {
                     luaL_unref(L, LUA_REGISTRYINDEX, functionRef);
-                    luaL_error(L, "Couldn't find a creature with (ID: %d)!", id);
+                    luaL_error(L, "Couldn't find an opcode with (ID: %d)!", id);
                     return;
                 }
 
-                PacketEventBindings->Insert(id, evt, functionRef, shots);
+                PacketEventBindings->Insert(id, evt, functionRef, shots, packetFilter);
                 return;
             }
             break;
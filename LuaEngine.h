@@ -19,6 +19,7 @@
 #include "Weather.h"
 #include "World.h"
 #include "HookMgr.h"
+#include <memory>
 
 extern "C"
 {
@@ -84,13 +85,29 @@ typedef VehicleInfo Vehicle;
 
 struct lua_State;
 class EventMgr;
+struct ElunaSavedTimer;
 class ElunaObject;
+class ElunaQueryCache;
+class ElunaPacketPool;
+class ElunaPacketStats;
+class ElunaPlayerIndex;
+class ElunaObjectData;
+class ElunaAIBatch;
+class ElunaGossipMenus;
+class ElunaBehaviorTree;
+struct ElunaBehaviorState;
 template<typename T>
 class ElunaTemplate;
 template<typename T>
 class EventBind;
 template<typename T>
 class EntryBind;
+namespace ElunaUtil
+{
+    class PacketFilter;
+    class MoveInLOSFilter;
+    class CooldownCache;
+}
 
 struct LuaScript
 {
@@ -100,7 +117,27 @@ struct LuaScript
     std::string modulepath;
 };
 
+// State a creature AI keeps for throttled CREATURE_EVENT_ON_AIUPDATE calls
+struct ElunaAIUpdateState
+{
+    ElunaAIUpdateState() : elapsed(0), timer(0), result(false) { }
+
+    uint32 elapsed; // time since the handlers were last called
+    uint32 timer;   // time left until the next call, 0 until the first call has been staggered
+    bool result;    // result of the last call, reused for the skipped updates
+};
+
+// Filter results of the packet bindings of an opcode and event for one packet, see EntryBind::MatchEvents
+struct ElunaPacketMatch
+{
+    ElunaPacketMatch() : mask(0), generation(0) { }
+
+    uint64 mask;        // bit i is set if binding i matched, bindings past 64 are checked again when pushed
+    uint32 generation;  // generation of the bindings when matched, all are checked again if it changed
+};
+
 #define ELUNA_OBJECT_STORE  "Eluna Object Store"
+#define ELUNA_PERSISTENT_TABLES "Eluna Persistent Tables"
 
 class Eluna
 {
@@ -117,6 +154,30 @@ private:
     template<typename T> void CallAllFunctions(EventBind<T>* event_bindings, EntryBind<T>* entry_bindings, T event_id, uint32 entry);
     template<typename T> bool CallAllFunctionsBool(EventBind<T>* event_bindings, EntryBind<T>* entry_bindings, T event_id, uint32 entry, bool default_value);
 
+    // Helpers for ReloadEluna to keep persistent tables and WorldObject timers.
+    void SavePersistentTables(std::map<std::string, std::string>& tables);
+    void RestorePersistentTables(std::map<std::string, std::string> const& tables);
+    void ReattachTimers(std::vector<ElunaSavedTimer> const& timers);
+    // crc32 of the script files by chunk name, timers are only reattached to unchanged files
+    std::map<std::string, uint32> scriptHashes;
+
+    // Helpers for packet hooks to pass the core's packet to handlers without copying it.
+    ElunaObject* PushBorrowed(WorldPacket* packet);
+    void ReleaseBorrowed(ElunaObject* obj);
+    // SetupStack for packet bindings, only pushes the handlers that matched the packet
+    int SetupPacketStack(HookMgr::PacketEvents event_id, WorldPacket const& packet, Player* player, ElunaPacketMatch const& match, int number_of_arguments);
+
+    // Runs the batched AI updates of the map, called from the map update hook
+    void RunAIBatches(Map* map, uint32 diff);
+
+    // Minimum time between CREATURE_EVENT_ON_AIUPDATE and CREATURE_EVENT_ON_AIUPDATE_BATCH calls by event and creature entry,
+    // guarded by the CreatureEventBindings lock
+    std::map<std::pair<uint32, uint32>, uint32> aiUpdateIntervals;
+    // CREATURE_EVENT_ON_MOVE_IN_LOS filters by creature entry, guarded by the CreatureEventBindings lock
+    std::map<uint32, ElunaUtil::MoveInLOSFilter*> moveInLOSFilters;
+    // Behavior trees by creature entry, guarded by the CreatureEventBindings lock. Shared so a replaced tree can finish its run
+    std::map<uint32, std::shared_ptr<ElunaBehaviorTree> > behaviorTrees;
+
     // Convenient overloads for Setup. Use these in hooks instead of original.
     template<typename T> int SetupStack(EventBind<T>* event_bindings, T event_id, int number_of_arguments)
     {
@@ -168,6 +229,14 @@ public:
     uint32 event_level;
 
     EventMgr* eventMgr;
+    ElunaQueryCache* queryCache;
+    ElunaPacketStats* packetStats;
+    ElunaPacketPool* packetPool;
+    ElunaPlayerIndex* playerIndex;
+    ElunaObjectData* objectData;
+    ElunaAIBatch* aiBatch;
+    ElunaGossipMenus* gossipMenus;
+    ElunaUtil::CooldownCache* moveInLOSCooldowns;
 
     EventBind<HookMgr::ServerEvents>*       ServerEventBindings;
     EventBind<HookMgr::PlayerEvents>*       PlayerEventBindings;
@@ -201,11 +270,25 @@ public:
     static void AddScriptPath(std::string filename, const std::string& fullpath);
 
     static void report(lua_State* luastate);
-    void ExecuteCall(int params, int res);
-    void Register(uint8 reg, uint32 id, uint32 evt, int func, uint32 shots);
+    void ExecuteCall(int params, int res) { ExecuteCall(L, params, res); }
+    // The state can be a coroutine of this Eluna's state, like the one passed to methods
+    void ExecuteCall(lua_State* luastate, int params, int res);
+    // Calls the function and parameters pushed on the state, returns false if the function returned false to stop a ForEach
+    bool CallForEach(lua_State* luastate, int params);
+    void Register(uint8 reg, uint32 id, uint32 evt, int func, uint32 shots, ElunaUtil::PacketFilter const* packetFilter = NULL);
     void RunScripts();
     void InvalidateObjects();
 
+    // Interval of 0 removes the interval of the entry's event
+    void SetAIUpdateInterval(uint32 event_id, uint32 entry, uint32 interval);
+    uint32 GetAIUpdateInterval(uint32 event_id, uint32 entry);
+    // The filter is copied, NULL removes the entry's filter
+    void SetMoveInLOSFilter(uint32 entry, ElunaUtil::MoveInLOSFilter const* filter);
+    bool HasMoveInLOSFilter(uint32 entry);
+    // Takes ownership of the tree, NULL removes the entry's tree
+    void SetBehaviorTree(uint32 entry, ElunaBehaviorTree* tree);
+    std::shared_ptr<ElunaBehaviorTree> GetBehaviorTree(uint32 entry);
+
     // Static pushes, can be used by anything, including methods.
     static void Push(lua_State* luastate); // nil
     static void Push(lua_State* luastate, const long long);
@@ -298,7 +381,8 @@ public:
     uint32 GetDialogStatus(Player* pPlayer, Creature* pCreature);
 
     bool OnSummoned(Creature* creature, Unit* summoner);
-    bool UpdateAI(Creature* me, const uint32 diff);
+    bool UpdateAI(Creature* me, const uint32 diff, ElunaAIUpdateState& state);
+    void UpdateBehaviorTree(Creature* me, const uint32 diff, ElunaBehaviorState& state);
     bool EnterCombat(Creature* me, Unit* target);
     bool DamageTaken(Creature* me, Unit* attacker, uint32& damage);
     bool JustDied(Creature* me, Unit* killer);
@@ -342,11 +426,11 @@ public:
 
     /* Packet */
     bool OnPacketSend(WorldSession* session, WorldPacket& packet);
-    void OnPacketSendAny(Player* player, WorldPacket& packet, bool& result);
-    void OnPacketSendOne(Player* player, WorldPacket& packet, bool& result);
+    bool OnPacketSendAny(Player* player, WorldPacket& packet, bool& result);
+    bool OnPacketSendOne(Player* player, WorldPacket& packet, bool& result, ElunaPacketMatch const& match);
     bool OnPacketReceive(WorldSession* session, WorldPacket& packet);
-    void OnPacketReceiveAny(Player* player, WorldPacket& packet, bool& result);
-    void OnPacketReceiveOne(Player* player, WorldPacket& packet, bool& result);
+    bool OnPacketReceiveAny(Player* player, WorldPacket& packet, bool& result);
+    bool OnPacketReceiveOne(Player* player, WorldPacket& packet, bool& result, ElunaPacketMatch const& match);
 
     /* Player */
     void OnPlayerEnterCombat(Player* pPlayer, Unit* pEnemy);
@@ -11,7 +11,17 @@ extern "C"
 
 // Eluna
 #include "LuaEngine.h"
+#include "ElunaBehaviorTree.h"
 #include "ElunaEventMgr.h"
+#include "ElunaGossipMenu.h"
+#include "ElunaPacketPool.h"
+#include "ElunaObjectData.h"
+#include "ElunaPacketStats.h"
+#include "ElunaPersistentStore.h"
+#include "ElunaPlayerIndex.h"
+#include "ElunaQueryCache.h"
+#include "ElunaSerializer.h"
+#include "ElunaSharedStore.h"
 #include "ElunaIncludes.h"
 #include "ElunaTemplate.h"
 #include "ElunaUtility.h"
@@ -27,6 +37,7 @@ extern "C"
 #include "GuildMethods.h"
 #include "GameObjectMethods.h"
 #include "ElunaQueryMethods.h"
+#include "CachedQueryMethods.h"
 #include "AuraMethods.h"
 #include "ItemMethods.h"
 #include "WorldPacketMethods.h"
@@ -54,9 +65,11 @@ ElunaGlobal::ElunaRegister GlobalMethods[] =
     { "RegisterItemGossipEvent", &LuaGlobalFunctions::RegisterItemGossipEvent },               // RegisterItemGossipEvent(entry, event, function)
     { "RegisterPlayerGossipEvent", &LuaGlobalFunctions::RegisterPlayerGossipEvent },           // RegisterPlayerGossipEvent(menu_id, event, function)
     { "RegisterBGEvent", &LuaGlobalFunctions::RegisterBGEvent },                               // RegisterBGEvent(event, function)
+    { "RegisterCreatureBehaviorTree", &LuaGlobalFunctions::RegisterCreatureBehaviorTree },     // RegisterCreatureBehaviorTree(entry, tree)
 
     { "ClearBattleGroundEvents", &LuaGlobalFunctions::ClearBattleGroundEvents },
     { "ClearCreatureEvents", &LuaGlobalFunctions::ClearCreatureEvents },
+    { "ClearCreatureBehaviorTree", &LuaGlobalFunctions::ClearCreatureBehaviorTree },
     { "ClearCreatureGossipEvents", &LuaGlobalFunctions::ClearCreatureGossipEvents },
     { "ClearGameObjectEvents", &LuaGlobalFunctions::ClearGameObjectEvents },
     { "ClearGameObjectGossipEvents", &LuaGlobalFunctions::ClearGameObjectGossipEvents },
@@ -80,6 +93,8 @@ ElunaGlobal::ElunaRegister GlobalMethods[] =
     { "GetGameTime", &LuaGlobalFunctions::GetGameTime },
     { "GetPlayersInWorld", &LuaGlobalFunctions::GetPlayersInWorld },
     { "GetPlayersInMap", &LuaGlobalFunctions::GetPlayersInMap },
+    { "GetPlayerCountInMap", &LuaGlobalFunctions::GetPlayerCountInMap },
+    { "GetPlayerCountInZone", &LuaGlobalFunctions::GetPlayerCountInZone },
     { "GetGuildByName", &LuaGlobalFunctions::GetGuildByName },
     { "GetGuildByLeaderGUID", &LuaGlobalFunctions::GetGuildByLeaderGUID },
     { "GetPlayerCount", &LuaGlobalFunctions::GetPlayerCount },
@@ -114,7 +129,37 @@ ElunaGlobal::ElunaRegister GlobalMethods[] =
     // Other
     { "ReloadEluna", &LuaGlobalFunctions::ReloadEluna },
     { "SendWorldMessage", &LuaGlobalFunctions::SendWorldMessage },
+    { "SendPacketToMap", &LuaGlobalFunctions::SendPacketToMap },
+    { "SendPacketToZone", &LuaGlobalFunctions::SendPacketToZone },
+    { "SendPacketToArea", &LuaGlobalFunctions::SendPacketToArea },
+    { "SendPacketToTeam", &LuaGlobalFunctions::SendPacketToTeam },
+    { "SendPacketInRange", &LuaGlobalFunctions::SendPacketInRange },
+    { "SendPacketToGUIDs", &LuaGlobalFunctions::SendPacketToGUIDs },
+    { "ForEachPlayer", &LuaGlobalFunctions::ForEachPlayer },
+    { "ForEachPlayerInMap", &LuaGlobalFunctions::ForEachPlayerInMap },
+    { "ForEachPlayerInZone", &LuaGlobalFunctions::ForEachPlayerInZone },
     { "WorldDBQuery", &LuaGlobalFunctions::WorldDBQuery },
+    { "WorldDBQueryCached", &LuaGlobalFunctions::WorldDBQueryCached },
+    { "InvalidateCachedQuery", &LuaGlobalFunctions::InvalidateCachedQuery },
+    { "ClearQueryCache", &LuaGlobalFunctions::ClearQueryCache },
+    { "GetQueryCacheStats", &LuaGlobalFunctions::GetQueryCacheStats },
+    { "GetPacketStats", &LuaGlobalFunctions::GetPacketStats },
+    { "ResetPacketStats", &LuaGlobalFunctions::ResetPacketStats },
+    { "SetPacketStatsEnabled", &LuaGlobalFunctions::SetPacketStatsEnabled },
+    { "GetPacketPoolStats", &LuaGlobalFunctions::GetPacketPoolStats },
+    { "GetSharedValue", &LuaGlobalFunctions::GetSharedValue },
+    { "SetSharedValue", &LuaGlobalFunctions::SetSharedValue },
+    { "CompareAndSwapSharedValue", &LuaGlobalFunctions::CompareAndSwapSharedValue },
+    { "IncrementSharedValue", &LuaGlobalFunctions::IncrementSharedValue },
+    { "Serialize", &LuaGlobalFunctions::Serialize },
+    { "Deserialize", &LuaGlobalFunctions::Deserialize },
+    { "GetStoreValue", &LuaGlobalFunctions::GetStoreValue },
+    { "PutStoreValue", &LuaGlobalFunctions::PutStoreValue },
+    { "DeleteStoreValue", &LuaGlobalFunctions::DeleteStoreValue },
+    { "ForEachStoreValue", &LuaGlobalFunctions::ForEachStoreValue },
+    { "SyncStore", &LuaGlobalFunctions::SyncStore },
+    { "SetPersistentTable", &LuaGlobalFunctions::SetPersistentTable },
+    { "GetPersistentTable", &LuaGlobalFunctions::GetPersistentTable },
     { "WorldDBExecute", &LuaGlobalFunctions::WorldDBExecute },
     { "CharDBQuery", &LuaGlobalFunctions::CharDBQuery },
     { "CharDBExecute", &LuaGlobalFunctions::CharDBExecute },
@@ -123,6 +168,8 @@ ElunaGlobal::ElunaRegister GlobalMethods[] =
     { "CreateLuaEvent", &LuaGlobalFunctions::CreateLuaEvent },
     { "RemoveEventById", &LuaGlobalFunctions::RemoveEventById },
     { "RemoveEvents", &LuaGlobalFunctions::RemoveEvents },
+    { "CreateGossipMenu", &LuaGlobalFunctions::CreateGossipMenu },
+    { "RemoveGossipMenu", &LuaGlobalFunctions::RemoveGossipMenu },
     { "PerformIngameSpawn", &LuaGlobalFunctions::PerformIngameSpawn },
     { "CreatePacket", &LuaGlobalFunctions::CreatePacket },
     { "AddVendorItem", &LuaGlobalFunctions::AddVendorItem },
@@ -213,20 +260,32 @@ ElunaRegister<WorldObject> WorldObjectMethods[] =
     { "GetNearestCreature", &LuaWorldObject::GetNearestCreature },        // :GetNearestCreature([range, entry]) - Returns nearest creature with given entry in sight or given range entry can be 0 or nil for any.
     { "GetNearObject", &LuaWorldObject::GetNearObject },
     { "GetNearObjects", &LuaWorldObject::GetNearObjects },
+    { "GetNearestN", &LuaWorldObject::GetNearestN },
+    { "GetObjectsSortedByDistance", &LuaWorldObject::GetObjectsSortedByDistance },
+    { "CountPlayersInRange", &LuaWorldObject::CountPlayersInRange },
+    { "CountCreaturesInRange", &LuaWorldObject::CountCreaturesInRange },
+    { "CountGameObjectsInRange", &LuaWorldObject::CountGameObjectsInRange },
     { "GetDistance", &LuaWorldObject::GetDistance },                      // :GetDistance(WorldObject or x, y, z) - Returns the distance between 2 objects or location
     { "GetRelativePoint", &LuaWorldObject::GetRelativePoint },            // :GetRelativePoint(dist, rad) - Returns the x, y and z of a point dist away from worldobject.
     { "GetAngle", &LuaWorldObject::GetAngle },                            // :GetAngle(WorldObject or x, y) - Returns angle between world object and target or x and y coords.
+    { "GetData", &LuaWorldObject::GetData },                              // :GetData([field]) - Returns a variable set with SetData or the table of all of them
+
+    // Setters
+    { "SetData", &LuaWorldObject::SetData },                              // :SetData(field, value) - Sets a variable on the object
 
     // Boolean
     { "IsWithinLoS", &LuaWorldObject::IsWithinLoS },
 
     // Other
+    { "ForEachInRange", &LuaWorldObject::ForEachInRange },
     { "SummonGameObject", &LuaWorldObject::SummonGameObject },            // :SummonGameObject(entry, x, y, z, o[, respawnDelay]) - Spawns an object to location. Returns the object or nil
     { "SpawnCreature", &LuaWorldObject::SpawnCreature },                  // :SpawnCreature(entry, x, y, z, o[, spawnType, despawnDelay]) - Spawns a creature to location that despawns after given time (0 for infinite). Returns the creature or nil
     { "SendPacket", &LuaWorldObject::SendPacket },                        // :SendPacket(packet) - Sends a specified packet to everyone around
     { "RegisterEvent", &LuaWorldObject::RegisterEvent },
     { "RemoveEventById", &LuaWorldObject::RemoveEventById },
     { "RemoveEvents", &LuaWorldObject::RemoveEvents },
+    { "RemoveWatcher", &LuaWorldObject::RemoveWatcher },
+    { "RemoveWatchers", &LuaWorldObject::RemoveWatchers },
 
     { NULL, NULL },
 };
@@ -369,6 +428,9 @@ ElunaRegister<Unit> UnitMethods[] =
 #endif
 
     // Other
+    { "WatchHealthPct", &LuaUnit::WatchHealthPct },
+    { "WatchPowerPct", &LuaUnit::WatchPowerPct },
+    { "WatchAuraStacks", &LuaUnit::WatchAuraStacks },
     { "AddAura", &LuaUnit::AddAura },                                 // :AddAura(spellId, target) - Adds an aura to the specified target
     { "RemoveAura", &LuaUnit::RemoveAura },                           // :RemoveAura(spellId[, casterGUID]) - Removes an aura from the unit by the spellId, casterGUID(Original caster) is optional
     { "RemoveAllAuras", &LuaUnit::RemoveAllAuras },                   // :RemoveAllAuras() - Removes all the unit's auras
@@ -638,6 +700,7 @@ ElunaRegister<Player> PlayerMethods[] =
     // Gossip
     { "GossipMenuAddItem", &LuaPlayer::GossipMenuAddItem },                               // :GossipMenuAddItem(icon, msg, sender, intid[, code, popup, money])
     { "GossipSendMenu", &LuaPlayer::GossipSendMenu },                                     // :GossipSendMenu(npc_text, unit[, menu_id]) - If unit is a player, you need to use a menu_id. menu_id is used to hook the gossip select function to the menu
+    { "GossipSendCachedMenu", &LuaPlayer::GossipSendCachedMenu },                         // :GossipSendCachedMenu(menuId, sender[, npc_text]) - Sends a menu created with CreateGossipMenu
     { "GossipComplete", &LuaPlayer::GossipComplete },                                     // :GossipComplete()
     { "GossipClearMenu", &LuaPlayer::GossipClearMenu },                                   // :GossipClearMenu() - Clears the gossip menu of options. Pretty much only useful with player gossip. Need to use before creating a new menu for the player
 
@@ -748,6 +811,7 @@ ElunaRegister<Creature> CreatureMethods[] =
     { "GetAITargets", &LuaCreature::GetAITargets },
     { "GetAITargetsCount", &LuaCreature::GetAITargetsCount },
     { "GetHomePosition", &LuaCreature::GetHomePosition },
+    { "GetAbilityPhase", &LuaCreature::GetAbilityPhase },
     { "GetCorpseDelay", &LuaCreature::GetCorpseDelay },
     { "GetCreatureSpellCooldownDelay", &LuaCreature::GetCreatureSpellCooldownDelay },
     { "GetScriptId", &LuaCreature::GetScriptId },
@@ -772,6 +836,7 @@ ElunaRegister<Creature> CreatureMethods[] =
 
     // Setters
     { "SetHover", &LuaCreature::SetHover },
+    { "SetAbilityPhase", &LuaCreature::SetAbilityPhase },
     { "SetDisableGravity", &LuaCreature::SetDisableGravity },
     { "SetAggroEnabled", &LuaCreature::SetAggroEnabled },
     { "SetNoCallAssistance", &LuaCreature::SetNoCallAssistance },
@@ -825,6 +890,10 @@ ElunaRegister<Creature> CreatureMethods[] =
     { "CanFly", &LuaCreature::CanFly },
 
     // Other
+    { "WatchDistanceFromHome", &LuaCreature::WatchDistanceFromHome },
+    { "ScheduleAbility", &LuaCreature::ScheduleAbility },
+    { "CancelAbility", &LuaCreature::CancelAbility },
+    { "DelayAbilities", &LuaCreature::DelayAbilities },
     { "FleeToGetAssistance", &LuaCreature::FleeToGetAssistance },
     { "CallForHelp", &LuaCreature::CallForHelp },
     { "CallAssistance", &LuaCreature::CallAssistance },
@@ -1141,6 +1210,30 @@ ElunaRegister<ElunaQuery> QueryMethods[] =
     { NULL, NULL },
 };
 
+ElunaRegister<ElunaCachedQuery> CachedQueryMethods[] =
+{
+    { "NextRow", &LuaCachedQuery::NextRow },
+    { "GetColumnCount", &LuaCachedQuery::GetColumnCount },
+    { "GetRowCount", &LuaCachedQuery::GetRowCount },
+    { "GetRow", &LuaCachedQuery::GetRow },
+
+    { "GetBool", &LuaCachedQuery::GetBool },
+    { "GetUInt8", &LuaCachedQuery::GetUInt8 },
+    { "GetUInt16", &LuaCachedQuery::GetUInt16 },
+    { "GetUInt32", &LuaCachedQuery::GetUInt32 },
+    { "GetUInt64", &LuaCachedQuery::GetUInt64 },
+    { "GetInt8", &LuaCachedQuery::GetInt8 },
+    { "GetInt16", &LuaCachedQuery::GetInt16 },
+    { "GetInt32", &LuaCachedQuery::GetInt32 },
+    { "GetInt64", &LuaCachedQuery::GetInt64 },
+    { "GetFloat", &LuaCachedQuery::GetFloat },
+    { "GetDouble", &LuaCachedQuery::GetDouble },
+    { "GetString", &LuaCachedQuery::GetString },
+    { "IsNull", &LuaCachedQuery::IsNull },
+
+    { NULL, NULL },
+};
+
 ElunaRegister<WorldPacket> PacketMethods[] =
 {
     // Getters
@@ -1161,6 +1254,7 @@ ElunaRegister<WorldPacket> PacketMethods[] =
     { "ReadString", &LuaPacket::ReadString },
     { "ReadFloat", &LuaPacket::ReadFloat },
     { "ReadDouble", &LuaPacket::ReadDouble },
+    { "ReadMany", &LuaPacket::ReadMany },
 
     // Writers
     { "WriteByte", &LuaPacket::WriteByte },                   // :WriteByte(val) - Writes an int8 value
@@ -1173,6 +1267,10 @@ ElunaRegister<WorldPacket> PacketMethods[] =
     { "WriteString", &LuaPacket::WriteString },               // :WriteString(val) - Writes a string value
     { "WriteFloat", &LuaPacket::WriteFloat },                 // :WriteFloat(val) - Writes a float value
     { "WriteDouble", &LuaPacket::WriteDouble },               // :WriteDouble(val) - Writes a double value
+    { "WriteMany", &LuaPacket::WriteMany },
+
+    // Other
+    { "Release", &LuaPacket::Release },
 
     { NULL, NULL },
 };
@@ -1188,6 +1286,12 @@ ElunaRegister<Map> MapMethods[] =
     { "GetAreaId", &LuaMap::GetAreaId },                      // :GetAreaId(x, y, z) - Returns the map's area ID based on coords UNDOCUMENTED
     { "GetHeight", &LuaMap::GetHeight },                      // :GetHeight(x, y[, phasemask]) - Returns ground Z coordinate. UNDOCUMENTED
     { "GetWorldObject", &LuaMap::GetWorldObject },            // :GetWorldObject(guid) - Returns a worldobject (player, creature, gameobject..) from the map by it's guid
+    { "GetNearestTargets", &LuaMap::GetNearestTargets },      // :GetNearestTargets(origins, range[, type, entry, hostile, filter]) - Returns the nearest target of each origin, nearby origins share one grid search
+    { "GetTargetsInRange", &LuaMap::GetTargetsInRange },      // :GetTargetsInRange(origins, range[, type, entry, hostile, filter]) - Returns the targets in range of each origin, nearby origins share one grid search
+    { "GetData", &LuaMap::GetData },                          // :GetData([field]) - Returns a variable set with SetData or the table of all of them
+
+    // Setters
+    { "SetData", &LuaMap::SetData },                          // :SetData(field, value) - Sets a variable on the map instance
 
     // Booleans
 #ifndef CLASSIC
@@ -1282,6 +1386,32 @@ template<> int ElunaTemplate<Vehicle>::CollectGarbage(lua_State* L)
 }
 #endif
 
+// packets created by lua are recycled through the packet pool
+template<> int ElunaTemplate<WorldPacket>::CollectGarbage(lua_State* L)
+{
+    // Get object pointer (and check type, no error)
+    ElunaObject* obj = Eluna::CHECKOBJ<ElunaObject>(L, 1, false);
+    if (!obj)
+        return 0;
+
+    if (!obj->IsBorrowed())
+    {
+        Eluna* E = static_cast<Eluna*>(lua_touserdata(L, lua_upvalueindex(1)));
+        if (E && E->packetPool)
+            E->packetPool->Release(static_cast<WorldPacket*>(obj->GetObj()));
+        else
+            delete static_cast<WorldPacket*>(obj->GetObj());
+    }
+
+    // Eluna::PushBorrowed places the object in the userdata itself
+    ElunaObject** ptrHold = static_cast<ElunaObject**>(lua_touserdata(L, 1));
+    if (obj == reinterpret_cast<ElunaObject*>(ptrHold + 1))
+        obj->~ElunaObject();
+    else
+        delete obj;
+    return 0;
+}
+
 // Template by Mud from http://stackoverflow.com/questions/4484437/lua-integer-type/4485511#4485511
 template<> int ElunaTemplate<unsigned long long>::Add(lua_State* L) { Eluna::Push(L, Eluna::CHECKVAL<unsigned long long>(L, 1) + Eluna::CHECKVAL<unsigned long long>(L, 2)); return 1; }
 template<> int ElunaTemplate<unsigned long long>::Substract(lua_State* L) { Eluna::Push(L, Eluna::CHECKVAL<unsigned long long>(L, 1) - Eluna::CHECKVAL<unsigned long long>(L, 2)); return 1; }
@@ -1411,6 +1541,9 @@ void RegisterFunctions(Eluna* E)
     ElunaTemplate<ElunaQuery>::Register(E, "ElunaQuery", true);
     ElunaTemplate<ElunaQuery>::SetMethods(E, QueryMethods);
 
+    ElunaTemplate<ElunaCachedQuery>::Register(E, "CachedQuery", true);
+    ElunaTemplate<ElunaCachedQuery>::SetMethods(E, CachedQueryMethods);
+
     ElunaTemplate<long long>::Register(E, "long long", true);
 
     ElunaTemplate<unsigned long long>::Register(E, "unsigned long long", true);
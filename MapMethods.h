@@ -235,5 +235,275 @@ namespace LuaMap
 #endif
         return 1;
     }
+
+    // Reads the origins from the table at narg, origins that aren't on the map are NULL
+    static void CheckTargetOrigins(lua_State* L, int narg, Map* map, std::vector<WorldObject*>& origins)
+    {
+        for (int i = 1;; ++i)
+        {
+            lua_rawgeti(L, narg, i);
+            if (lua_isnil(L, -1))
+            {
+                lua_pop(L, 1);
+                break;
+            }
+            WorldObject* origin = Eluna::CHECKOBJ<WorldObject>(L, lua_gettop(L), false);
+            origins.push_back(origin && origin->GetMap() == map ? origin : NULL);
+            lua_pop(L, 1);
+        }
+    }
+
+    /*
+     * Groups the origins that are within range of the first origin of the group and searches the cells
+     * around each group once, so a search never covers more than twice the range however far apart the origins are.
+     * groups[i] is the index in candidates of the group of origins[i], or -1 if the origin isn't on the map.
+     * Line of sight and hostility depend on the origin and are left to IsTargetOf.
+     */
+    static void CollectTargetCandidates(std::vector<WorldObject*> const& origins, float range, uint16 type, uint32 entry,
+        ElunaUtil::WorldObjectFilter& filter, ElunaUtil::WorldObjectFilter const* pFilter,
+        std::vector<std::vector<WorldObject*> >& candidates, std::vector<int>& groups)
+    {
+        bool los = filter.los;
+        filter.los = false;
+
+        groups.assign(origins.size(), -1);
+        for (uint32 i = 0; i < origins.size(); ++i)
+        {
+            WorldObject* center = origins[i];
+            if (!center || groups[i] >= 0)
+                continue;
+
+            int group = candidates.size();
+            float radius = range;
+            for (uint32 j = i; j < origins.size(); ++j)
+            {
+                if (!origins[j] || groups[j] >= 0)
+                    continue;
+                float dist = center->GetDistance(origins[j]);
+                if (dist > range)
+                    continue;
+                groups[j] = group;
+                radius = std::max(radius, dist + range);
+            }
+
+            candidates.push_back(std::vector<WorldObject*>());
+            std::vector<WorldObject*>& found = candidates.back();
+
+            WorldObject* target = NULL;
+            ElunaUtil::WorldObjectInRangeCheck checker(false, center, radius, type, entry, 0, pFilter);
+            ElunaUtil::WorldObjectInRangeCollector collector(checker, &found);
+#ifndef TRINITY
+            MaNGOS::WorldObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(target, collector);
+            Cell::VisitAllObjects(center, searcher, radius);
+#else
+            Trinity::WorldObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(center, target, collector);
+            center->VisitNearbyObject(radius, searcher);
+#endif
+
+            // The center isn't returned by its own check, but can be the target of the others
+            Unit* centerUnit = center->ToUnit();
+#ifdef CMANGOS
+            bool alive = !centerUnit || centerUnit->isAlive();
+#else
+            bool alive = !centerUnit || centerUnit->IsAlive();
+#endif
+            if (alive && (!type || center->isType(TypeMask(type))) && (!entry || center->GetEntry() == entry) &&
+                (!pFilter || filter(center, center)))
+                found.push_back(center);
+        }
+
+        filter.los = los;
+    }
+
+    // Checks the requirements of a collected candidate that depend on the origin
+    static bool IsTargetOf(WorldObject* origin, WorldObject* candidate, float range, uint32 hostile, bool los)
+    {
+        if (candidate == origin || !origin->IsWithinDistInMap(candidate, range))
+            return false;
+
+        if (hostile)
+        {
+            Unit const* originUnit = origin->ToUnit();
+            Unit const* unit = candidate->ToUnit();
+            if (originUnit && unit && (hostile == 1) != originUnit->IsHostileTo(unit))
+                return false;
+        }
+        return !los || origin->IsWithinLOSInMap(candidate);
+    }
+
+    /**
+     * Returns the nearest matching [WorldObject] for each of the given origin [WorldObject]s, searching the shared grid cells once.
+     * The type, entry and hostility requirements are the same as for [WorldObject:GetNearObjects].
+     *
+     * Origins within range of each other share one search, so origins close to each other,
+     * like the adds of an encounter, cost about as much as a single origin. Origins far apart are searched separately.
+     * The returned table has the nearest [WorldObject] for `origins[i]` at index `i`,
+     * or `false` if there was none or the origin isn't on this [Map].
+     *
+     *     local targets = map:GetNearestTargets(adds, 40, 0x10, 0, 1)
+     *     for i, add in ipairs(adds) do
+     *         if targets[i] then
+     *             add:AttackStart(targets[i])
+     *         end
+     *     end
+     *
+     * @param table origins : table of [WorldObject]s to search around
+     * @param float range : the range to search in around each origin
+     * @param [TypeMask] type = 0 : the [TypeMask] that the [WorldObject] must be. This can contain multiple types. 0 will be ingored
+     * @param uint32 entry = 0 : the entry of the [WorldObject], 0 will be ingored
+     * @param uint32 hostile = 0 : specifies whether the [WorldObject] needs to be 1 hostile, 2 friendly or 0 either, relative to each origin
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     *
+     * @return table nearestTargets
+     */
+    int GetNearestTargets(Eluna* /*E*/, lua_State* L, Map* map)
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        float range = Eluna::CHECKVAL<float>(L, 3);
+        uint16 type = Eluna::CHECKVAL<uint16>(L, 4, 0); // TypeMask
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 5, 0);
+        uint32 hostile = Eluna::CHECKVAL<uint32>(L, 6, 0); // 0 none, 1 hostile, 2 friendly
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = LuaWorldObject::CheckObjectFilter(L, 7, filter);
+
+        std::vector<WorldObject*> origins;
+        CheckTargetOrigins(L, 2, map, origins);
+
+        std::vector<std::vector<WorldObject*> > candidates;
+        std::vector<int> groups;
+        CollectTargetCandidates(origins, range, type, entry, filter, pFilter, candidates, groups);
+
+        lua_createtable(L, origins.size(), 0);
+        int tbl = lua_gettop(L);
+
+        for (uint32 i = 0; i < origins.size(); ++i)
+        {
+            WorldObject* origin = origins[i];
+            WorldObject* nearest = NULL;
+            float nearestDist = 0.0f;
+
+            if (groups[i] >= 0)
+            {
+                std::vector<WorldObject*> const& found = candidates[groups[i]];
+                for (std::vector<WorldObject*>::const_iterator it = found.begin(); it != found.end(); ++it)
+                {
+                    float dist = origin->GetDistance(*it);
+                    if (nearest && dist >= nearestDist)
+                        continue;
+                    if (!IsTargetOf(origin, *it, range, hostile, filter.los))
+                        continue;
+
+                    nearest = *it;
+                    nearestDist = dist;
+                }
+            }
+
+            if (nearest)
+                Eluna::Push(L, nearest);
+            else
+                Eluna::Push(L, false);
+            lua_rawseti(L, tbl, i + 1);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+
+    /**
+     * Returns the matching [WorldObject]s in range of each of the given origin [WorldObject]s, searching the shared grid cells once.
+     * The grouping of the origins and the requirements are the same as for [Map:GetNearestTargets].
+     *
+     * The returned table has a table of the [WorldObject]s in range of `origins[i]` at index `i`,
+     * which is empty if there were none or the origin isn't on this [Map].
+     *
+     *     local inRange = map:GetTargetsInRange(adds, 10, 0x10, 0, 1)
+     *     for i, add in ipairs(adds) do
+     *         if #inRange[i] > 2 then
+     *             add:CastSpell(add, SPELL_NOVA)
+     *         end
+     *     end
+     *
+     * @param table origins : table of [WorldObject]s to search around
+     * @param float range : the range to search in around each origin
+     * @param [TypeMask] type = 0 : the [TypeMask] that the [WorldObject] must be. This can contain multiple types. 0 will be ingored
+     * @param uint32 entry = 0 : the entry of the [WorldObject], 0 will be ingored
+     * @param uint32 hostile = 0 : specifies whether the [WorldObject] needs to be 1 hostile, 2 friendly or 0 either, relative to each origin
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     *
+     * @return table targetsInRange
+     */
+    int GetTargetsInRange(Eluna* /*E*/, lua_State* L, Map* map)
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        float range = Eluna::CHECKVAL<float>(L, 3);
+        uint16 type = Eluna::CHECKVAL<uint16>(L, 4, 0); // TypeMask
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 5, 0);
+        uint32 hostile = Eluna::CHECKVAL<uint32>(L, 6, 0); // 0 none, 1 hostile, 2 friendly
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = LuaWorldObject::CheckObjectFilter(L, 7, filter);
+
+        std::vector<WorldObject*> origins;
+        CheckTargetOrigins(L, 2, map, origins);
+
+        std::vector<std::vector<WorldObject*> > candidates;
+        std::vector<int> groups;
+        CollectTargetCandidates(origins, range, type, entry, filter, pFilter, candidates, groups);
+
+        lua_createtable(L, origins.size(), 0);
+        int tbl = lua_gettop(L);
+
+        for (uint32 i = 0; i < origins.size(); ++i)
+        {
+            WorldObject* origin = origins[i];
+            lua_newtable(L);
+            int targets = lua_gettop(L);
+            int count = 0;
+
+            if (groups[i] >= 0)
+            {
+                std::vector<WorldObject*> const& found = candidates[groups[i]];
+                for (std::vector<WorldObject*>::const_iterator it = found.begin(); it != found.end(); ++it)
+                {
+                    if (!IsTargetOf(origin, *it, range, hostile, filter.los))
+                        continue;
+
+                    Eluna::Push(L, *it);
+                    lua_rawseti(L, targets, ++count);
+                }
+            }
+
+            lua_rawseti(L, tbl, i + 1);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+
+    /**
+     * Returns the value of a variable set with [Map:SetData], or the table of all variables when no field is given.
+     *
+     * The variables belong to the instance and are kept until the [Map] is destroyed.
+     *
+     * @param field = nil : the key of the variable
+     * @return value : the value of the variable, `nil` if it isn't set
+     */
+    int GetData(Eluna* E, lua_State* L, Map* map)
+    {
+        return LuaWorldObject::PushObjectData(L, E->objectData, ElunaObjectData::STORE_MAP,
+            ElunaObjectData::MakeMapKey(map->GetId(), map->GetInstanceId()));
+    }
+
+    /**
+     * Sets a variable on the [Map]. Values are stored as is, tables by reference.
+     * Setting a field to `nil` removes it.
+     *
+     * @param field : the key of the variable, can't be `nil`
+     * @param value : the value to set
+     */
+    int SetData(Eluna* E, lua_State* L, Map* map)
+    {
+        return LuaWorldObject::SetObjectData(L, E->objectData, ElunaObjectData::STORE_MAP,
+            ElunaObjectData::MakeMapKey(map->GetId(), map->GetInstanceId()));
+    }
 };
 #endif
@@ -2968,6 +2968,61 @@ namespace LuaPlayer
         return 0;
     }
 
+    /**
+     * Clears the [Player]'s gossip menu and sends a menu created with [Global:CreateGossipMenu].
+     *
+     * Only the items whose conditions the [Player] meets are added.
+     *
+     * @param uint32 menuId : ID of the menu
+     * @param [Object] sender : the [Creature], [GameObject], [Item] or [Player] showing the menu
+     * @param uint32 npcText : npc_text id to show instead of the menu's text
+     */
+    int GossipSendCachedMenu(Eluna* E, lua_State* L, Player* player)
+    {
+        uint32 menuId = Eluna::CHECKVAL<uint32>(L, 2);
+        Object* sender = Eluna::CHECKOBJ<Object>(L, 3);
+        ElunaGossipMenus::Menu const* menu = E->gossipMenus->Get(menuId);
+        if (!menu)
+            return luaL_argerror(L, 2, "valid gossip menu ID expected");
+        uint32 npcText = Eluna::CHECKVAL<uint32>(L, 4, menu->textId);
+
+        PlayerMenu* talkClass = player->PlayerTalkClass;
+        talkClass->ClearMenus();
+        for (std::vector<ElunaGossipMenus::Item>::const_iterator itr = menu->items.begin(); itr != menu->items.end(); ++itr)
+        {
+            if (!itr->IsAvailable(player))
+                continue;
+#ifndef TRINITY
+#ifndef CLASSIC
+            talkClass->GetGossipMenu().AddMenuItem(itr->icon, itr->text, itr->sender, itr->intid, itr->popup, itr->money, itr->code);
+#else
+            talkClass->GetGossipMenu().AddMenuItem(itr->icon, itr->text, itr->sender, itr->intid, itr->popup, itr->code);
+#endif
+#else
+            talkClass->GetGossipMenu().AddMenuItem(-1, itr->icon, itr->text, itr->sender, itr->intid, itr->popup, itr->money, itr->code);
+#endif
+        }
+
+        if (menu->quests)
+        {
+            if (sender->GetTypeId() == TYPEID_UNIT)
+            {
+                if (sender->GetUInt32Value(UNIT_NPC_FLAGS) & UNIT_NPC_FLAG_QUESTGIVER)
+                    player->PrepareQuestMenu(sender->GET_GUID());
+            }
+            else if (sender->GetTypeId() == TYPEID_GAMEOBJECT)
+            {
+                if (((GameObject*)sender)->GetGoType() == GAMEOBJECT_TYPE_QUESTGIVER)
+                    player->PrepareQuestMenu(sender->GET_GUID());
+            }
+        }
+
+        if (sender->GetTypeId() == TYPEID_PLAYER)
+            talkClass->GetGossipMenu().SetMenuId(menu->menuId);
+        talkClass->SendGossipMenu(npcText, sender->GET_GUID());
+        return 0;
+    }
+
     /**
      * Clears the [Player]s currently open Gossip Menu
      * 
@@ -598,6 +598,60 @@ namespace LuaUnit
         return 1;
     }
 
+    /**
+     * Calls the function when the [Unit]'s health percent falls to the given percent, or rises to it if above is true.
+     * The condition is checked natively on each update of the [Unit] and the function is only called when it
+     * becomes true. The watcher is re-armed when the health moves back past the percent by the hysteresis,
+     * or when a [Creature] resets. The function is called as `(watcherId, value, unit)`.
+     * Watchers are removed with [WorldObject:RemoveWatcher] and when the object is removed or Eluna is reloaded.
+     *
+     * @param float pct : health percent to watch for
+     * @param function function : function to call when the health crosses the percent
+     * @param bool above = false : call the function when the health rises to the percent instead
+     * @param float hysteresis = 0 : how far the health has to move back before the function can be called again
+     * @return int watcherId : unique ID for the watcher used to remove it or nil
+     */
+    int WatchHealthPct(Eluna* /*E*/, lua_State* L, Unit* unit)
+    {
+        return LuaWorldObject::AddWatcherHelper(L, unit, ElunaWatcher::WATCH_HEALTH_PCT, 0, 2, 3, 4, false);
+    }
+
+    /**
+     * Calls the function when the [Unit]'s power percent falls to the given percent, or rises to it if above is true.
+     * See [Unit:WatchHealthPct] for how watchers work.
+     *
+     * @param int powerType : the power to watch, -1 for the current power type
+     * @param float pct : power percent to watch for
+     * @param function function : function to call when the power crosses the percent
+     * @param bool above = false : call the function when the power rises to the percent instead
+     * @param float hysteresis = 0 : how far the power has to move back before the function can be called again
+     * @return int watcherId : unique ID for the watcher used to remove it or nil
+     */
+    int WatchPowerPct(Eluna* E, lua_State* L, Unit* unit)
+    {
+        int type = Eluna::CHECKVAL<int>(L, 2);
+        Powers power = PowerSelectorHelper(E, L, unit, type);
+
+        return LuaWorldObject::AddWatcherHelper(L, unit, ElunaWatcher::WATCH_POWER_PCT, power, 3, 4, 5, false);
+    }
+
+    /**
+     * Calls the function when the stack amount of the [Aura] on the [Unit] reaches the given amount.
+     * See [Unit:WatchHealthPct] for how watchers work.
+     *
+     * @param uint32 spellId : the [Aura]'s spell ID
+     * @param uint32 stacks : stack amount to watch for
+     * @param function function : function to call when the stack amount is reached
+     * @param float hysteresis = 0 : how far the stack amount has to drop before the function can be called again
+     * @return int watcherId : unique ID for the watcher used to remove it or nil
+     */
+    int WatchAuraStacks(Eluna* /*E*/, lua_State* L, Unit* unit)
+    {
+        uint32 spellId = Eluna::CHECKVAL<uint32>(L, 2);
+
+        return LuaWorldObject::AddWatcherHelper(L, unit, ElunaWatcher::WATCH_AURA_STACKS, spellId, 3, 4, 0, true);
+    }
+
     int GetPowerType(Eluna* /*E*/, lua_State* L, Unit* unit)
     {
 #ifdef TRINITY
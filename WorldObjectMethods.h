@@ -9,6 +9,64 @@
 
 namespace LuaWorldObject
 {
+    static bool CheckFilterField(lua_State* L, int narg, const char* field)
+    {
+        lua_getfield(L, narg, field);
+        return !lua_isnil(L, -1);
+    }
+
+    // Reads an optional filter table for the range searches, see GetNearObjects. Returns NULL if there is none
+    static ElunaUtil::WorldObjectFilter const* CheckObjectFilter(lua_State* L, int narg, ElunaUtil::WorldObjectFilter& filter)
+    {
+        if (lua_isnoneornil(L, narg))
+            return NULL;
+        luaL_checktype(L, narg, LUA_TTABLE);
+
+        int top = lua_gettop(L);
+        if (CheckFilterField(L, narg, "inCombat"))
+            filter.inCombat = Eluna::CHECKVAL<bool>(L, top + 1) ? 1 : 0;
+        if (CheckFilterField(L, narg, "gm"))
+            filter.gameMaster = Eluna::CHECKVAL<bool>(L, top + 2) ? 1 : 0;
+        if (CheckFilterField(L, narg, "minHealthPct"))
+            filter.minHealthPct = Eluna::CHECKVAL<float>(L, top + 3);
+        if (CheckFilterField(L, narg, "maxHealthPct"))
+            filter.maxHealthPct = Eluna::CHECKVAL<float>(L, top + 4);
+        if (CheckFilterField(L, narg, "minLevel"))
+            filter.minLevel = Eluna::CHECKVAL<uint32>(L, top + 5);
+        if (CheckFilterField(L, narg, "maxLevel"))
+            filter.maxLevel = Eluna::CHECKVAL<uint32>(L, top + 6);
+        if (CheckFilterField(L, narg, "faction"))
+            filter.faction = Eluna::CHECKVAL<uint32>(L, top + 7);
+        if (CheckFilterField(L, narg, "aura"))
+            filter.aura = Eluna::CHECKVAL<uint32>(L, top + 8);
+        if (CheckFilterField(L, narg, "notAura"))
+            filter.notAura = Eluna::CHECKVAL<uint32>(L, top + 9);
+        if (CheckFilterField(L, narg, "los"))
+            filter.los = Eluna::CHECKVAL<bool>(L, top + 10);
+        lua_settop(L, top);
+        return &filter;
+    }
+
+    // Registers the function at funcArg as a watcher of the object, the threshold is read from thresholdArg.
+    // Pushes the watcher ID
+    static int AddWatcherHelper(lua_State* L, WorldObject* obj, ElunaWatcher::WatchType type, uint32 param, int thresholdArg, int funcArg, int aboveArg, bool above)
+    {
+        float threshold = Eluna::CHECKVAL<float>(L, thresholdArg);
+        luaL_checktype(L, funcArg, LUA_TFUNCTION);
+        if (aboveArg)
+            above = Eluna::CHECKVAL<bool>(L, aboveArg, above);
+        float hysteresis = Eluna::CHECKVAL<float>(L, aboveArg ? aboveArg + 1 : funcArg + 1, 0.0f);
+
+        lua_pushvalue(L, funcArg);
+        int functionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        if (functionRef != LUA_REFNIL && functionRef != LUA_NOREF)
+        {
+            obj->elunaEvents->AddWatcher(functionRef, type, param, threshold, hysteresis, above);
+            Eluna::Push(L, functionRef);
+        }
+        return 1;
+    }
+
     /**
      * Returns the name of the [WorldObject]
      *
@@ -232,15 +290,18 @@ namespace LuaWorldObject
      * Returns a table of [Player] objects in sight of the [WorldObject] or within the given range
      *
      * @param float range = 533.33333 : optionally set range. Default range is grid size
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
      *
      * @return table playersInRange : table of [Player]s
      */
     int GetPlayersInRange(Eluna* /*E*/, lua_State* L, WorldObject* obj)
     {
         float range = Eluna::CHECKVAL<float>(L, 2, SIZE_OF_GRIDS);
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 3, filter);
 
         std::list<Player*> list;
-        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_PLAYER);
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_PLAYER, 0, 0, pFilter);
 #ifndef TRINITY
         MaNGOS::PlayerListSearcher<ElunaUtil::WorldObjectInRangeCheck> searcher(list, checker);
         Cell::VisitWorldObjects(obj, searcher, range);
@@ -269,6 +330,7 @@ namespace LuaWorldObject
      *
      * @param float range = 533.33333 : optionally set range. Default range is grid size
      * @param uint32 entryId = 0 : optionally set entry ID of creatures to find
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
      *
      * @return table creaturesInRange : table of [Creature]s
      */
@@ -276,9 +338,11 @@ namespace LuaWorldObject
     {
         float range = Eluna::CHECKVAL<float>(L, 2, SIZE_OF_GRIDS);
         uint32 entry = Eluna::CHECKVAL<uint32>(L, 3, 0);
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 4, filter);
 
         std::list<Creature*> list;
-        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_UNIT, entry);
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_UNIT, entry, 0, pFilter);
 #ifndef TRINITY
         MaNGOS::CreatureListSearcher<ElunaUtil::WorldObjectInRangeCheck> searcher(list, checker);
         Cell::VisitGridObjects(obj, searcher, range);
@@ -379,10 +443,27 @@ namespace LuaWorldObject
      * Returns a table of [WorldObject]s in sight of the [WorldObject].
      * The distance, type, entry and hostility requirements the [WorldObject] must match can be passed.
      *
+     * The filter table is checked natively while searching, before anything is pushed to Lua.
+     * All keys are optional. Objects that aren't units never match the unit conditions.
+     *
+     *     {
+     *         inCombat = true,     -- in or out of combat
+     *         gm = false,          -- a game master or not
+     *         minHealthPct = 0,    -- health percent range
+     *         maxHealthPct = 100,
+     *         minLevel = 0,        -- level range, maxLevel 0 for no limit
+     *         maxLevel = 0,
+     *         faction = 0,         -- faction template ID
+     *         aura = 0,            -- must have this aura
+     *         notAura = 0,         -- must not have this aura
+     *         los = false          -- must be in line of sight of the [WorldObject]
+     *     }
+     *
      * @param float range = 533.33333 : optionally set range. Default range is grid size
      * @param [TypeMask] type = 0 : the [TypeMask] that the [WorldObject] must be. This can contain multiple types. 0 will be ingored
      * @param uint32 entry = 0 : the entry of the [WorldObject], 0 will be ingored
      * @param uint32 hostile = 0 : specifies whether the [WorldObject] needs to be 1 hostile, 2 friendly or 0 either
+     * @param table filter : optional filter table, see above
      *
      * @return table worldObjectList : table of [WorldObject]s
      */
@@ -392,10 +473,12 @@ namespace LuaWorldObject
         uint16 type = Eluna::CHECKVAL<uint16>(L, 3, 0); // TypeMask
         uint32 entry = Eluna::CHECKVAL<uint32>(L, 4, 0);
         uint32 hostile = Eluna::CHECKVAL<uint32>(L, 5, 0); // 0 none, 1 hostile, 2 friendly
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 6, filter);
 
         float x, y, z;
         obj->GetPosition(x, y, z);
-        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, type, entry, hostile);
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, type, entry, hostile, pFilter);
 
         std::list<WorldObject*> list;
 #ifndef TRINITY
@@ -421,6 +504,267 @@ namespace LuaWorldObject
         return 1;
     }
 
+    /**
+     * Returns a table of the n [WorldObject]s nearest to the [WorldObject], nearest first.
+     * The distance, type, entry and hostility requirements the [WorldObject] must match can be passed.
+     *
+     * Only the n nearest objects are kept during the search, so this is cheaper than
+     * sorting the result of [WorldObject:GetNearObjects] in Lua.
+     *
+     *     -- the three closest hostile players
+     *     local targets = creature:GetNearestN(40, 3, 0x10, 0, 1)
+     *
+     * @param float range : the range to search in
+     * @param uint32 n : the maximum amount of [WorldObject]s to return
+     * @param [TypeMask] type = 0 : the [TypeMask] that the [WorldObject] must be. This can contain multiple types. 0 will be ingored
+     * @param uint32 entry = 0 : the entry of the [WorldObject], 0 will be ingored
+     * @param uint32 hostile = 0 : specifies whether the [WorldObject] needs to be 1 hostile, 2 friendly or 0 either
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     *
+     * @return table nearestObjects : table of [WorldObject]s
+     */
+    int GetNearestN(Eluna* /*E*/, lua_State* L, WorldObject* obj)
+    {
+        float range = Eluna::CHECKVAL<float>(L, 2);
+        uint32 n = Eluna::CHECKVAL<uint32>(L, 3);
+        uint16 type = Eluna::CHECKVAL<uint16>(L, 4, 0); // TypeMask
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 5, 0);
+        uint32 hostile = Eluna::CHECKVAL<uint32>(L, 6, 0); // 0 none, 1 hostile, 2 friendly
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 7, filter);
+
+        WorldObject* target = NULL;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, type, entry, hostile, pFilter);
+        ElunaUtil::WorldObjectNearestCollector collector(checker, n);
+#ifndef TRINITY
+        MaNGOS::WorldObjectLastSearcher<ElunaUtil::WorldObjectNearestCollector> searcher(target, collector);
+        Cell::VisitAllObjects(obj, searcher, range);
+#else
+        Trinity::WorldObjectLastSearcher<ElunaUtil::WorldObjectNearestCollector> searcher(obj, target, collector);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+
+        std::vector<WorldObject*> objects;
+        collector.GetSorted(objects);
+
+        lua_createtable(L, objects.size(), 0);
+        int tbl = lua_gettop(L);
+        uint32 i = 0;
+
+        for (std::vector<WorldObject*>::const_iterator it = objects.begin(); it != objects.end(); ++it)
+        {
+            Eluna::Push(L, ++i);
+            Eluna::Push(L, *it);
+            lua_settable(L, tbl);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+
+    /**
+     * Returns a table of [WorldObject]s in sight of the [WorldObject], sorted by their distance to it.
+     * The distance, type, entry and hostility requirements the [WorldObject] must match can be passed.
+     *
+     * @param float range = 533.33333 : optionally set range. Default range is grid size
+     * @param [TypeMask] type = 0 : the [TypeMask] that the [WorldObject] must be. This can contain multiple types. 0 will be ingored
+     * @param uint32 entry = 0 : the entry of the [WorldObject], 0 will be ingored
+     * @param uint32 hostile = 0 : specifies whether the [WorldObject] needs to be 1 hostile, 2 friendly or 0 either
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     * @param bool descending = false : sort the farthest [WorldObject]s first
+     *
+     * @return table worldObjectList : table of [WorldObject]s
+     */
+    int GetObjectsSortedByDistance(Eluna* /*E*/, lua_State* L, WorldObject* obj)
+    {
+        float range = Eluna::CHECKVAL<float>(L, 2, SIZE_OF_GRIDS);
+        uint16 type = Eluna::CHECKVAL<uint16>(L, 3, 0); // TypeMask
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 4, 0);
+        uint32 hostile = Eluna::CHECKVAL<uint32>(L, 5, 0); // 0 none, 1 hostile, 2 friendly
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 6, filter);
+        bool descending = Eluna::CHECKVAL<bool>(L, 7, false);
+
+        std::vector<WorldObject*> objects;
+        WorldObject* target = NULL;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, type, entry, hostile, pFilter);
+        ElunaUtil::WorldObjectInRangeCollector collector(checker, &objects);
+#ifndef TRINITY
+        MaNGOS::WorldObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(target, collector);
+        Cell::VisitAllObjects(obj, searcher, range);
+#else
+        Trinity::WorldObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(obj, target, collector);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+
+        std::sort(objects.begin(), objects.end(), ElunaUtil::ObjectDistanceOrderPred(obj));
+        if (descending)
+            std::reverse(objects.begin(), objects.end());
+
+        lua_createtable(L, objects.size(), 0);
+        int tbl = lua_gettop(L);
+        uint32 i = 0;
+
+        for (std::vector<WorldObject*>::const_iterator it = objects.begin(); it != objects.end(); ++it)
+        {
+            Eluna::Push(L, ++i);
+            Eluna::Push(L, *it);
+            lua_settable(L, tbl);
+        }
+
+        lua_settop(L, tbl);
+        return 1;
+    }
+
+    /**
+     * Calls a function for each [WorldObject] in sight of the [WorldObject], without building a table.
+     * The distance, type, entry and hostility requirements the [WorldObject] must match can be passed.
+     *
+     * The function is called with the [WorldObject] as its only argument. Returning `false` from it stops the iteration.
+     * Returns the amount of objects the function was called for.
+     *
+     *     local found
+     *     creature:ForEachInRange(30, 0x10, function(player)
+     *         if player:IsGM() then
+     *             found = player
+     *             return false
+     *         end
+     *     end)
+     *
+     * @param float range : the range to search in
+     * @param [TypeMask] type : the [TypeMask] that the [WorldObject] must be. This can contain multiple types. 0 will be ingored
+     * @param function func : function called for each [WorldObject]
+     * @param uint32 entry = 0 : the entry of the [WorldObject], 0 will be ingored
+     * @param uint32 hostile = 0 : specifies whether the [WorldObject] needs to be 1 hostile, 2 friendly or 0 either
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     *
+     * @return uint32 count
+     */
+    int ForEachInRange(Eluna* E, lua_State* L, WorldObject* obj)
+    {
+        float range = Eluna::CHECKVAL<float>(L, 2);
+        uint16 type = Eluna::CHECKVAL<uint16>(L, 3); // TypeMask
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 5, 0);
+        uint32 hostile = Eluna::CHECKVAL<uint32>(L, 6, 0); // 0 none, 1 hostile, 2 friendly
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 7, filter);
+
+        std::vector<WorldObject*> objects;
+        WorldObject* target = NULL;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, type, entry, hostile, pFilter);
+        ElunaUtil::WorldObjectInRangeCollector collector(checker, &objects);
+#ifndef TRINITY
+        MaNGOS::WorldObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(target, collector);
+        Cell::VisitAllObjects(obj, searcher, range);
+#else
+        Trinity::WorldObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(obj, target, collector);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+
+        // The objects are collected first so the function can't modify the grid while it is visited
+        uint32 count = 0;
+        for (std::vector<WorldObject*>::const_iterator it = objects.begin(); it != objects.end(); ++it)
+        {
+            lua_pushvalue(L, 4);
+            Eluna::Push(L, *it);
+            ++count;
+            if (!E->CallForEach(L, 1))
+                break;
+        }
+
+        Eluna::Push(L, count);
+        return 1;
+    }
+
+    /**
+     * Returns the amount of [Player]s in sight of the [WorldObject] or within the given range, without building a table.
+     *
+     * @param float range = 533.33333 : optionally set range. Default range is grid size
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     *
+     * @return uint32 count
+     */
+    int CountPlayersInRange(Eluna* /*E*/, lua_State* L, WorldObject* obj)
+    {
+        float range = Eluna::CHECKVAL<float>(L, 2, SIZE_OF_GRIDS);
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 3, filter);
+
+        Unit* target = NULL;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_PLAYER, 0, 0, pFilter);
+        ElunaUtil::WorldObjectInRangeCollector counter(checker);
+#ifndef TRINITY
+        MaNGOS::UnitLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(target, counter);
+        Cell::VisitWorldObjects(obj, searcher, range);
+#else
+        Trinity::UnitLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(obj, target, counter);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+
+        Eluna::Push(L, counter.i_count);
+        return 1;
+    }
+
+    /**
+     * Returns the amount of [Creature]s in sight of the [WorldObject] or within the given range and/or with a specific entry ID, without building a table.
+     *
+     * @param float range = 533.33333 : optionally set range. Default range is grid size
+     * @param uint32 entryId = 0 : optionally set entry ID of creatures to count
+     * @param table filter : optional filter table, see [WorldObject:GetNearObjects]
+     *
+     * @return uint32 count
+     */
+    int CountCreaturesInRange(Eluna* /*E*/, lua_State* L, WorldObject* obj)
+    {
+        float range = Eluna::CHECKVAL<float>(L, 2, SIZE_OF_GRIDS);
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 3, 0);
+        ElunaUtil::WorldObjectFilter filter;
+        ElunaUtil::WorldObjectFilter const* pFilter = CheckObjectFilter(L, 4, filter);
+
+        Creature* target = NULL;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_UNIT, entry, 0, pFilter);
+        ElunaUtil::WorldObjectInRangeCollector counter(checker);
+#ifndef TRINITY
+        MaNGOS::CreatureLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(target, counter);
+        Cell::VisitGridObjects(obj, searcher, range);
+#else
+        Trinity::CreatureLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(obj, target, counter);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+
+        Eluna::Push(L, counter.i_count);
+        return 1;
+    }
+
+    /**
+     * Returns the amount of [GameObject]s in sight of the [WorldObject] or within the given range and/or with a specific entry ID, without building a table.
+     *
+     * @param float range = 533.33333 : optionally set range. Default range is grid size
+     * @param uint32 entryId = 0 : optionally set entry ID of game objects to count
+     *
+     * @return uint32 count
+     */
+    int CountGameObjectsInRange(Eluna* /*E*/, lua_State* L, WorldObject* obj)
+    {
+        float range = Eluna::CHECKVAL<float>(L, 2, SIZE_OF_GRIDS);
+        uint32 entry = Eluna::CHECKVAL<uint32>(L, 3, 0);
+
+        GameObject* target = NULL;
+        ElunaUtil::WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_GAMEOBJECT, entry);
+        ElunaUtil::WorldObjectInRangeCollector counter(checker);
+#ifndef TRINITY
+        MaNGOS::GameObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(target, counter);
+        Cell::VisitGridObjects(obj, searcher, range);
+#else
+        Trinity::GameObjectLastSearcher<ElunaUtil::WorldObjectInRangeCollector> searcher(obj, target, counter);
+        obj->VisitNearbyObject(range, searcher);
+#endif
+
+        Eluna::Push(L, counter.i_count);
+        return 1;
+    }
+
     /**
      * Returns the distance from this [WorldObject] to another [WorldObject], or from this [WorldObject] to a point.
      *
@@ -659,6 +1003,28 @@ namespace LuaWorldObject
         return 0;
     }
 
+    /**
+     * Removes the watcher from a [WorldObject] by the specified watcher ID, see [Unit:WatchHealthPct]
+     *
+     * @param int watcherId : watcher Id to remove
+     */
+    int RemoveWatcher(Eluna* /*E*/, lua_State* L, WorldObject* obj)
+    {
+        int watcherId = Eluna::CHECKVAL<int>(L, 2);
+        obj->elunaEvents->RemoveWatcher(watcherId);
+        return 0;
+    }
+
+    /**
+     * Removes all watchers from a [WorldObject]
+     *
+     */
+    int RemoveWatchers(Eluna* /*E*/, lua_State* /*L*/, WorldObject* obj)
+    {
+        obj->elunaEvents->RemoveWatchers();
+        return 0;
+    }
+
     /**
      * Returns true if the given [WorldObject] or coordinates are in the [WorldObject]'s line of sight
      *
@@ -687,5 +1053,75 @@ namespace LuaWorldObject
 
         return 1;
     }
+
+    static int PushObjectData(lua_State* L, ElunaObjectData* objectData, ElunaObjectData::StoreType type, uint64 key)
+    {
+        objectData->Push(L, type, key, false);
+        if (lua_isnoneornil(L, 2) || lua_isnil(L, -1))
+            return 1;
+
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        return 1;
+    }
+
+    static int SetObjectData(lua_State* L, ElunaObjectData* objectData, ElunaObjectData::StoreType type, uint64 key)
+    {
+        if (lua_isnoneornil(L, 2))
+            return luaL_argerror(L, 2, "field was nil");
+        lua_settop(L, 3);
+
+        // Setting nil doesn't create the table
+        objectData->Push(L, type, key, !lua_isnil(L, 3));
+        if (lua_isnil(L, -1))
+            return 0;
+
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, 3);
+        lua_rawset(L, -3);
+        return 0;
+    }
+
+    /**
+     * Returns the value of a variable set with [WorldObject:SetData], or the table of all variables when no field is given.
+     *
+     * The variables are kept until the [Creature] or [GameObject] is removed from the world or the [Player] logs out.
+     *
+     * @param field = nil : the key of the variable
+     * @return value : the value of the variable, `nil` if it isn't set
+     */
+    int GetData(Eluna* E, lua_State* L, WorldObject* obj)
+    {
+        return PushObjectData(L, E->objectData, ElunaObjectData::STORE_OBJECT, obj->GET_GUID());
+    }
+
+    /**
+     * Sets a variable on the [WorldObject]. Values are stored as is, tables by reference.
+     * Setting a field to `nil` removes it.
+     *
+     * Only [Player]s, [Creature]s and [GameObject]s can store variables.
+     *
+     *     creature:SetData("phase", 2)
+     *     if creature:GetData("phase") == 2 then
+     *         ...
+     *     end
+     *
+     * @param field : the key of the variable, can't be `nil`
+     * @param value : the value to set
+     */
+    int SetData(Eluna* E, lua_State* L, WorldObject* obj)
+    {
+        switch (obj->GetTypeId())
+        {
+            case TYPEID_UNIT:
+            case TYPEID_PLAYER:
+            case TYPEID_GAMEOBJECT:
+                break;
+            default:
+                return luaL_argerror(L, 1, "Player, Creature or GameObject expected");
+        }
+
+        return SetObjectData(L, E->objectData, ElunaObjectData::STORE_OBJECT, obj->GET_GUID());
+    }
 };
 #endif
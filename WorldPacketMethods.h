@@ -15,9 +15,138 @@
  *   the client has sent a message that its [Player] wants to logout.
  *
  * The packet can contain further data, the format of which depends on the opcode.
+ *
+ * Packets passed to packet events are borrowed from the server and are only valid during the event.
+ * Writing to such a packet changes a copy of it, return the packet from the event to replace the original.
+ * Use `packet:SetInvalidation(false)` to keep a copy of the packet after the event.
  */
 namespace LuaPacket
 {
+    // Packets passed to packet hooks are borrowed from the core, they are copied on first modification
+    static WorldPacket* GetWritable(lua_State* L, WorldPacket* packet)
+    {
+        ElunaObject* obj = Eluna::CHECKOBJ<ElunaObject>(L, 1);
+        if (!obj->IsBorrowed())
+            return packet;
+
+        WorldPacket* copy = new WorldPacket(*packet);
+        obj->SetObj(copy);
+        obj->SetBorrowed(false);
+        obj->SetValidation(false);
+        return copy;
+    }
+
+    enum PacketFieldType
+    {
+        PACKET_FIELD_INT8,
+        PACKET_FIELD_UINT8,
+        PACKET_FIELD_INT16,
+        PACKET_FIELD_UINT16,
+        PACKET_FIELD_INT32,
+        PACKET_FIELD_UINT32,
+        PACKET_FIELD_INT64,
+        PACKET_FIELD_UINT64,
+        PACKET_FIELD_FLOAT,
+        PACKET_FIELD_DOUBLE,
+        PACKET_FIELD_GUID,
+        PACKET_FIELD_STRING
+    };
+
+    // Plain data so it can be on the stack while Lua errors are raised
+    struct PacketFormat
+    {
+        uint8 fields[64];
+        uint32 count;
+    };
+
+    // Parses a format like "u32 u32 f f f guid s". The formats are short, so they are parsed on each call
+    static bool ParsePacketFormat(const char* fmt, PacketFormat& format)
+    {
+        static const struct { const char* name; PacketFieldType type; } types[] =
+        {
+            { "i8", PACKET_FIELD_INT8 }, { "u8", PACKET_FIELD_UINT8 },
+            { "i16", PACKET_FIELD_INT16 }, { "u16", PACKET_FIELD_UINT16 },
+            { "i32", PACKET_FIELD_INT32 }, { "u32", PACKET_FIELD_UINT32 },
+            { "i64", PACKET_FIELD_INT64 }, { "u64", PACKET_FIELD_UINT64 },
+            { "f", PACKET_FIELD_FLOAT }, { "d", PACKET_FIELD_DOUBLE },
+            { "guid", PACKET_FIELD_GUID }, { "s", PACKET_FIELD_STRING }
+        };
+
+        format.count = 0;
+        while (*fmt)
+        {
+            if (*fmt == ' ')
+            {
+                ++fmt;
+                continue;
+            }
+
+            size_t len = strcspn(fmt, " ");
+            bool found = false;
+            for (size_t i = 0; i < sizeof(types) / sizeof(types[0]) && !found; ++i)
+            {
+                if (strlen(types[i].name) == len && !strncmp(types[i].name, fmt, len))
+                {
+                    if (format.count >= sizeof(format.fields))
+                        return false;
+                    format.fields[format.count++] = types[i].type;
+                    found = true;
+                }
+            }
+            if (!found)
+                return false;
+            fmt += len;
+        }
+        return true;
+    }
+
+    // Raises a Lua error if the argument can't be written as the field type
+    static void CheckField(lua_State* L, PacketFieldType type, int narg)
+    {
+        switch (type)
+        {
+            case PACKET_FIELD_INT8:   Eluna::CHECKVAL<int8>(L, narg); break;
+            case PACKET_FIELD_UINT8:  Eluna::CHECKVAL<uint8>(L, narg); break;
+            case PACKET_FIELD_INT16:  Eluna::CHECKVAL<int16>(L, narg); break;
+            case PACKET_FIELD_UINT16: Eluna::CHECKVAL<uint16>(L, narg); break;
+            case PACKET_FIELD_INT32:  Eluna::CHECKVAL<int32>(L, narg); break;
+            case PACKET_FIELD_UINT32: Eluna::CHECKVAL<uint32>(L, narg); break;
+            case PACKET_FIELD_INT64:  Eluna::CHECKVAL<int64>(L, narg); break;
+            case PACKET_FIELD_UINT64: Eluna::CHECKVAL<uint64>(L, narg); break;
+            case PACKET_FIELD_FLOAT:  Eluna::CHECKVAL<float>(L, narg); break;
+            case PACKET_FIELD_DOUBLE: Eluna::CHECKVAL<double>(L, narg); break;
+            case PACKET_FIELD_GUID:   Eluna::CHECKVAL<uint64>(L, narg); break;
+            case PACKET_FIELD_STRING: Eluna::CHECKVAL<const char*>(L, narg); break;
+        }
+    }
+
+    // Returns false without reading if the value doesn't fit in the rest of the packet
+    template<typename T>
+    static bool ReadField(lua_State* L, WorldPacket* packet)
+    {
+        if (packet->rpos() + sizeof(T) > packet->size())
+            return false;
+        T val;
+        (*packet) >> val;
+        Eluna::Push(L, val);
+        return true;
+    }
+
+    // Returns false without reading if the string has no terminating null in the rest of the packet
+    static bool ReadStringField(lua_State* L, WorldPacket* packet)
+    {
+        size_t rpos = packet->rpos();
+        if (rpos >= packet->size())
+            return false;
+        const char* str = reinterpret_cast<const char*>(packet->contents()) + rpos;
+        const char* end = static_cast<const char*>(memchr(str, 0, packet->size() - rpos));
+        if (!end)
+            return false;
+        lua_pushlstring(L, str, end - str);
+        packet->rpos(rpos + (end - str) + 1);
+        return true;
+    }
+
     /**
      * Returns the opcode of the [WorldPacket].
      *
@@ -50,6 +179,7 @@ namespace LuaPacket
         uint32 opcode = Eluna::CHECKVAL<uint32>(L, 2);
         if (opcode >= NUM_MSG_TYPES)
             return luaL_argerror(L, 2, "valid opcode expected");
+        packet = GetWritable(L, packet);
         packet->SetOpcode((OpcodesList)opcode);
         return 0;
     }
@@ -192,6 +322,7 @@ namespace LuaPacket
     int WriteGUID(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         uint64 guid = Eluna::CHECKVAL<uint64>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << guid;
         return 0;
     }
@@ -204,6 +335,7 @@ namespace LuaPacket
     int WriteString(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         std::string _val = Eluna::CHECKVAL<std::string>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _val;
         return 0;
     }
@@ -216,6 +348,7 @@ namespace LuaPacket
     int WriteByte(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         int8 byte = Eluna::CHECKVAL<int8>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << byte;
         return 0;
     }
@@ -228,6 +361,7 @@ namespace LuaPacket
     int WriteUByte(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         uint8 byte = Eluna::CHECKVAL<uint8>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << byte;
         return 0;
     }
@@ -240,6 +374,7 @@ namespace LuaPacket
     int WriteShort(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         int16 _short = Eluna::CHECKVAL<int16>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _short;
         return 0;
     }
@@ -252,6 +387,7 @@ namespace LuaPacket
     int WriteUShort(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         uint16 _ushort = Eluna::CHECKVAL<uint16>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _ushort;
         return 0;
     }
@@ -264,6 +400,7 @@ namespace LuaPacket
     int WriteLong(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         int32 _long = Eluna::CHECKVAL<int32>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _long;
         return 0;
     }
@@ -276,6 +413,7 @@ namespace LuaPacket
     int WriteULong(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         uint32 _ulong = Eluna::CHECKVAL<uint32>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _ulong;
         return 0;
     }
@@ -288,6 +426,7 @@ namespace LuaPacket
     int WriteFloat(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         float _val = Eluna::CHECKVAL<float>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _val;
         return 0;
     }
@@ -300,9 +439,153 @@ namespace LuaPacket
     int WriteDouble(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
     {
         double _val = Eluna::CHECKVAL<double>(L, 2);
+        packet = GetWritable(L, packet);
         (*packet) << _val;
         return 0;
     }
+
+    /**
+     * Reads many values from the [WorldPacket] in one call and returns them in order.
+     *
+     * The format is a space separated list of the following field types:
+     *
+     *  - `i8`, `u8`, `i16`, `u16`, `i32`, `u32` : signed and unsigned integers
+     *  - `i64`, `u64` : signed and unsigned 64-bit integers
+     *  - `f`, `d` : single and double-precision floating-point values
+     *  - `guid` : an unsigned 64-bit integer, same as [WorldPacket:ReadGUID]
+     *  - `s` : a null terminated string
+     *
+     * A format can have up to 64 fields. If the packet is too short for any of them,
+     * an error is raised and the read position is left unchanged.
+     *
+     *     local entry, count, x, y, z, guid, name = packet:ReadMany("u32 u32 f f f guid s")
+     *
+     * @param string format : the types of the values to read
+     * @return ... values
+     */
+    int ReadMany(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
+    {
+        PacketFormat format;
+        if (!ParsePacketFormat(Eluna::CHECKVAL<const char*>(L, 2), format))
+            return luaL_argerror(L, 2, "invalid packet format");
+        if (!lua_checkstack(L, format.count))
+            return luaL_error(L, "too many values to read");
+
+        // Nothing is read if any field is past the end of the packet
+        int top = lua_gettop(L);
+        size_t rpos = packet->rpos();
+        bool read = true;
+        for (uint32 i = 0; read && i < format.count; ++i)
+        {
+            switch (format.fields[i])
+            {
+                case PACKET_FIELD_INT8:   read = ReadField<int8>(L, packet); break;
+                case PACKET_FIELD_UINT8:  read = ReadField<uint8>(L, packet); break;
+                case PACKET_FIELD_INT16:  read = ReadField<int16>(L, packet); break;
+                case PACKET_FIELD_UINT16: read = ReadField<uint16>(L, packet); break;
+                case PACKET_FIELD_INT32:  read = ReadField<int32>(L, packet); break;
+                case PACKET_FIELD_UINT32: read = ReadField<uint32>(L, packet); break;
+                case PACKET_FIELD_INT64:  read = ReadField<int64>(L, packet); break;
+                case PACKET_FIELD_UINT64: read = ReadField<uint64>(L, packet); break;
+                case PACKET_FIELD_FLOAT:  read = ReadField<float>(L, packet); break;
+                case PACKET_FIELD_DOUBLE: read = ReadField<double>(L, packet); break;
+                case PACKET_FIELD_GUID:   read = ReadField<uint64>(L, packet); break;
+                case PACKET_FIELD_STRING: read = ReadStringField(L, packet); break;
+            }
+        }
+
+        if (!read)
+        {
+            int failed = int(packet->rpos());
+            packet->rpos(rpos);
+            lua_settop(L, top);
+            return luaL_error(L, "attempt to read past the end of the packet (position %d, size %d)", failed, int(packet->size()));
+        }
+        return format.count;
+    }
+
+    /**
+     * Writes many values to the [WorldPacket] in one call.
+     *
+     * Uses the same format as [WorldPacket:ReadMany]. Nothing is written if any of the values is invalid.
+     *
+     *     packet:WriteMany("u32 f f f s", entry, x, y, z, "name")
+     *
+     * @param string format : the types of the values to write
+     * @param ... values : the values to write
+     */
+    int WriteMany(Eluna* /*E*/, lua_State* L, WorldPacket* packet)
+    {
+        PacketFormat format;
+        if (!ParsePacketFormat(Eluna::CHECKVAL<const char*>(L, 2), format))
+            return luaL_argerror(L, 2, "invalid packet format");
+
+        // Checked before anything is written so the packet is left untouched on errors.
+        // CHECKVAL raises Lua errors, so no C++ objects may be alive while checking
+        int narg = 3;
+        for (uint32 i = 0; i < format.count; ++i, ++narg)
+            CheckField(L, PacketFieldType(format.fields[i]), narg);
+
+        if (!format.count)
+            return 0;
+
+        packet = GetWritable(L, packet);
+        narg = 3;
+        for (uint32 i = 0; i < format.count; ++i, ++narg)
+        {
+            switch (format.fields[i])
+            {
+                case PACKET_FIELD_INT8:   (*packet) << Eluna::CHECKVAL<int8>(L, narg); break;
+                case PACKET_FIELD_UINT8:  (*packet) << Eluna::CHECKVAL<uint8>(L, narg); break;
+                case PACKET_FIELD_INT16:  (*packet) << Eluna::CHECKVAL<int16>(L, narg); break;
+                case PACKET_FIELD_UINT16: (*packet) << Eluna::CHECKVAL<uint16>(L, narg); break;
+                case PACKET_FIELD_INT32:  (*packet) << Eluna::CHECKVAL<int32>(L, narg); break;
+                case PACKET_FIELD_UINT32: (*packet) << Eluna::CHECKVAL<uint32>(L, narg); break;
+                case PACKET_FIELD_INT64:  (*packet) << Eluna::CHECKVAL<int64>(L, narg); break;
+                case PACKET_FIELD_UINT64: (*packet) << Eluna::CHECKVAL<uint64>(L, narg); break;
+                case PACKET_FIELD_FLOAT:  (*packet) << Eluna::CHECKVAL<float>(L, narg); break;
+                case PACKET_FIELD_DOUBLE: (*packet) << Eluna::CHECKVAL<double>(L, narg); break;
+                case PACKET_FIELD_GUID:   (*packet) << Eluna::CHECKVAL<uint64>(L, narg); break;
+                case PACKET_FIELD_STRING: (*packet) << Eluna::CHECKVAL<const char*>(L, narg); break;
+            }
+        }
+        return 0;
+    }
+
+    /* OTHER */
+
+    /**
+     * Returns the [WorldPacket] to the packet pool right away instead of waiting for garbage collection.
+     *
+     * The [WorldPacket] can't be used after releasing it.
+     * Does nothing for packets passed to packet hooks, those belong to the core.
+     *
+     *     local packet = CreatePacket(opcode, 8)
+     *     packet:WriteULong(value)
+     *     player:SendPacket(packet)
+     *     packet:Release()
+     */
+    int Release(Eluna* E, lua_State* L, WorldPacket* packet)
+    {
+        ElunaObject* obj = Eluna::CHECKOBJ<ElunaObject>(L, 1);
+        if (obj->IsBorrowed())
+            return 0;
+
+        // Forget the pointer, the pool can hand it out again
+        lua_getglobal(L, ELUNA_OBJECT_STORE);
+        lua_pushfstring(L, "%p", packet);
+        lua_pushnil(L);
+        lua_settable(L, -3);
+        lua_pop(L, 1);
+
+        // Keep garbage collection from releasing it again
+        obj->SetBorrowed(true);
+        obj->SetValidation(true);
+        obj->Invalidate();
+
+        E->packetPool->Release(packet);
+        return 0;
+    }
 };
 
 #endif